@@ -0,0 +1,91 @@
+#ifndef RON_ARENA_HPP
+#define RON_ARENA_HPP
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include "../ron/slice.hpp"
+#include "key.hpp"
+
+namespace ron {
+
+/** Append-only memory for frame bytes. Frames are copied into big slabs,
+ * so thousands of writes cost a few allocations. Slices stay valid while
+ * the arena lives (slabs never move); the arena moves, never copies. */
+class Arena {
+    std::vector<std::unique_ptr<Char[]>> slabs_;
+    Char* free_;
+    fsize_t room_;
+
+    Char* Allocate(fsize_t size) {
+        slabs_.emplace_back(new Char[size]);
+        return slabs_.back().get();
+    }
+
+   public:
+    static constexpr fsize_t SLAB = 1 << 16;
+
+    Arena() : slabs_{}, free_{nullptr}, room_{0} {}
+
+    Arena(Arena&& b) noexcept
+        : slabs_{std::move(b.slabs_)}, free_{b.free_}, room_{b.room_} {
+        b.Clear();
+    }
+
+    Arena& operator=(Arena&& b) noexcept {
+        slabs_ = std::move(b.slabs_);
+        free_ = b.free_;
+        room_ = b.room_;
+        b.Clear();
+        return *this;
+    }
+
+    /** @return the copy of the data, valid while the arena lives */
+    Slice Append(Slice data) {
+        fsize_t size = data.size();
+        if (size > SLAB / 2) {  // big frames get slabs of their own
+            Char* own = Allocate(size);
+            memcpy(own, data.data(), size);
+            return Slice{own, size};
+        }
+        if (size > room_) {
+            free_ = Allocate(SLAB);
+            room_ = SLAB;
+        }
+        Char* at = free_;
+        if (size) memcpy(at, data.data(), size);
+        free_ += size;
+        room_ -= size;
+        return Slice{at, size};
+    }
+
+    /** Takes over the other arena's slabs; its slices stay valid. */
+    void Absorb(Arena& b) {
+        if (slabs_.empty()) {
+            *this = std::move(b);
+            return;
+        }
+        for (auto& slab : b.slabs_) {
+            slabs_.push_back(std::move(slab));
+        }
+        b.Clear();
+    }
+
+    inline size_t slabs() const { return slabs_.size(); }
+
+    void Clear() {
+        slabs_.clear();
+        free_ = nullptr;
+        room_ = 0;
+    }
+};
+
+/** A batch of records referencing the bytes in its own arena, e.g. a
+ * commit's changes handed over by InMemoryStore::Release. */
+struct ArenaBatch {
+    Arena arena;
+    std::vector<std::pair<Key, Slice>> records;
+};
+
+}  // namespace ron
+
+#endif
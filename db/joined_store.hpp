@@ -1,3 +1,5 @@
+#include <map>
+#include <memory>
 #include "../rdt/rdt.hpp"
 #include "../ron/ron.hpp"
 #include "key.hpp"
@@ -6,43 +8,176 @@ namespace ron {
 
 template <class StoreA, class StoreB>
 class JoinedStore {
-    StoreA& a_;
-    StoreB& b_;
-
    public:
     using Frame = typename StoreA::Frame;
     using Record = typename StoreA::Record;
     using Records = typename StoreA::Records;
+    using Keys = std::vector<Key>;
     using Frames = std::vector<Frame>;
     using Cursor = typename Frame::Cursor;
     using Cursors = typename Frame::Cursors;
     using Builder = typename Frame::Builder;
+    using SharedFrame = std::shared_ptr<const Frame>;
 
-    JoinedStore(StoreA& a, StoreB& b) : a_{a}, b_{b} {}
+   private:
+    StoreA& a_;
+    StoreB& b_;
+    /** A's records read ahead by Prefetch(), misses included (empty) */
+    std::map<Key, SharedFrame> cache_;
+    /** A+B merges, kept till the next write to the key */
+    std::map<Key, SharedFrame> merged_;
+
+    Status ReadA(Key key, Frame& into) {
+        auto i = cache_.find(key);
+        if (i == cache_.end()) {
+            return a_.Read(key, into);
+        }
+        into = *i->second;
+        return Status::OK;
+    }
+
+    /** Merges the cursors (no frame copies) by the key's form, like the
+     * stores do, and caches the result. */
+    Status Merge(Key key, Cursor a, Cursor b, SharedFrame& into) {
+        Cursors inputs{a, b};
+        auto merged = std::make_shared<Frame>();
+        IFOK(MergeCursors(*merged, key.form(), inputs));
+        into = merged;
+        merged_[key] = into;
+        return Status::OK;
+    }
+
+   public:
+    JoinedStore(StoreA& a, StoreB& b) : a_{a}, b_{b}, cache_{}, merged_{} {}
 
     Word id() const { return a_.id(); }
 
     Status Write(Key key, const Frame& data) {
         LOG('W', key, data.data());
+        merged_.erase(key);
         return b_.Write(key, data);
     }
 
     Status Read(Key key, Frame& into) {
+        auto m = merged_.find(key);
+        if (m != merged_.end()) {
+            into = *m->second;
+            return Status::OK;
+        }
         Frame a, b;
-        IFOK(a_.Read(key, a));
+        IFOK(ReadA(key, a));
         IFOK(b_.Read(key, b));
         if (a.empty()) {
             std::swap(b, into);
         } else if (b.empty()) {
             std::swap(a, into);
         } else {
-            IFOK(MergeFrames(into, Frames{a, b}));
+            SharedFrame merged;
+            IFOK(Merge(key, a.cursor(), b.cursor(), merged));
+            into = *merged;
         }
         LOG('R', key, into.data());
         return Status::OK;
     }
 
-    Status Write(const Records& batch) { return a_.Write(batch); }
+    /** A zero-copy read (see RocksDBStore::Pinned) unless the key has
+     * changes in B. */
+    template <class Pinned>
+    Status Read(Key key, Pinned& into) {
+        auto m = merged_.find(key);
+        if (m != merged_.end()) {
+            into.Own(m->second);
+            return Status::OK;
+        }
+        Frame b;
+        IFOK(b_.Read(key, b));
+        auto cached = cache_.find(key);
+        if (cached == cache_.end()) {
+            IFOK(a_.Read(key, into));
+        } else if (cached->second->empty()) {
+            into.Release();
+        } else {
+            into.Own(cached->second);
+        }
+        if (b.empty()) {
+            return Status::OK;
+        }
+        if (into.empty()) {
+            into.Own(b);
+        } else {
+            SharedFrame merged;
+            IFOK(Merge(key, into.cursor(), b.cursor(), merged));
+            into.Own(merged);
+        }
+        LOG('R', key, String{(const char*)into.data().data(),
+                             into.data().size()});
+        return Status::OK;
+    }
+
+    Status MultiRead(const Keys& keys, Frames& into) {
+        Keys uncached;
+        std::vector<size_t> at;
+        Frames a, b;
+        a.resize(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto c = cache_.find(keys[i]);
+            if (c == cache_.end()) {
+                uncached.push_back(keys[i]);
+                at.push_back(i);
+            } else {
+                a[i] = *c->second;
+            }
+        }
+        if (!uncached.empty()) {
+            Frames read;
+            IFOK(a_.MultiRead(uncached, read));
+            for (size_t j = 0; j < at.size(); ++j) {
+                std::swap(a[at[j]], read[j]);
+            }
+        }
+        IFOK(b_.MultiRead(keys, b));
+        into.clear();
+        into.resize(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (a[i].empty()) {
+                std::swap(b[i], into[i]);
+            } else if (b[i].empty()) {
+                std::swap(a[i], into[i]);
+            } else {
+                SharedFrame merged;
+                IFOK(Merge(keys[i], a[i].cursor(), b[i].cursor(), merged));
+                into[i] = *merged;
+            }
+        }
+        return Status::OK;
+    }
+
+    /** Reads A's records for the keys in one batch (see MultiRead), so
+     * the subsequent Read()s cost no A round trips. A must not change
+     * meanwhile (Commit writes go to B). */
+    Status Prefetch(const Keys& keys) {
+        Keys fresh;
+        for (auto& key : keys) {
+            if (cache_.find(key) == cache_.end()) {
+                fresh.push_back(key);
+            }
+        }
+        if (fresh.empty()) {
+            return Status::OK;
+        }
+        Frames frames;
+        IFOK(a_.MultiRead(fresh, frames));
+        for (size_t i = 0; i < fresh.size(); ++i) {
+            cache_[fresh[i]] = std::make_shared<Frame>(std::move(frames[i]));
+        }
+        return Status::OK;
+    }
+
+    Status Write(const Records& batch) {
+        cache_.clear();
+        merged_.clear();
+        return a_.Write(batch);
+    }
 
     class Iterator {
         typename StoreA::Iterator ai_;
@@ -56,15 +191,28 @@ class JoinedStore {
         }
 
        public:
-        Iterator(JoinedStore& host)
-            : ai_{host.a_}, bi_{host.b_}, at_{Key::END}, merged_{} {}
+        Iterator(JoinedStore& host, bool same_prefix = false)
+            : ai_{host.a_, same_prefix},
+              bi_{host.b_, same_prefix},
+              at_{Key::END},
+              merged_{} {}
+
+        /** A range scan of both stores, see Range */
+        Iterator(JoinedStore& host, const Range& range)
+            : ai_{host.a_, range},
+              bi_{host.b_, range},
+              at_{Key::END},
+              merged_{} {}
 
         Status Next() {
+            // one side may end before the other
             if (ai_.key() == at_) {
-                IFOK(ai_.Next());
+                Status ok = ai_.Next();
+                if (!ok && ok != Status::ENDOFINPUT) return ok;
             }
             if (bi_.key() == at_) {
-                IFOK(bi_.Next());
+                Status ok = bi_.Next();
+                if (!ok && ok != Status::ENDOFINPUT) return ok;
             }
             pick();
             return Status::OK;
@@ -99,11 +247,14 @@ class JoinedStore {
                 LOG('=', at_, ai_.value().data().str());
                 return ai_.value();
             }
+            if (!merged_.empty()) {  // merged at this key already
+                return Cursor{merged_};
+            }
             // have to merge then
             Cursors inputs;
             inputs.push_back(ai_.value());
             inputs.push_back(bi_.value());
-            Status ok = MergeCursors<Frame>(merged_, inputs);
+            Status ok = MergeCursors<Frame>(merged_, at_.form(), inputs);
             LOG('_', at_, merged_.data());
             return ok ? Cursor{merged_}
                       : OneOp<Frame>(ok.code(), Uuid::FATAL).cursor();
@@ -71,6 +71,54 @@ struct Key {
     static bool trace_by_key;
 };
 
+/**
+ *  A key range to scan, [from, till), for the stores' range iterators:
+ *  `Iterator i{store, Range::Yarn(META_META_FORM, origin)}`. Long scans
+ *  (dumps, copies) may read ahead and skip the caches, so they don't
+ *  evict the hot data of concurrent queries.
+ */
+struct Range {
+    Key from;
+    Key till;
+    /** bytes to read ahead, 0 for the store's default */
+    size_t readahead;
+    /** whether the scanned data goes to the caches */
+    bool fill_cache;
+
+    explicit Range(Key f = Key{}, Key t = Key::END, size_t ahead = 0,
+                   bool cache = true)
+        : from{f}, till{t}, readahead{ahead}, fill_cache{cache} {}
+
+    inline bool has(const Key& key) const {
+        return !(key < from) && key < till;
+    }
+
+    /** the greatest key in the range (till is not empty) */
+    inline Key last() const {
+        uint64pair b = till.bits;
+        if (b.second-- == 0) --b.first;
+        return Key{b};
+    }
+
+    /** all the keys of a form, e.g. all the meta records */
+    static Range Form(FORM form) {
+        return Range{Key{uint64pair{uint64_t(form) << 56U, 0}},
+                     Key{uint64pair{uint64_t(form + 1) << 56U, 0}}};
+    }
+
+    /** the keys of a form having the origin, e.g. a yarn's chains */
+    static Range Yarn(FORM form, Word origin) {
+        Key from{Uuid{0, origin}, form};
+        uint64pair b = from.bits;
+        b.second += 1ULL << 60U;  // origin+1, carry included
+        if (b.second < from.bits.second) ++b.first;
+        return Range{from, Key{b}};
+    }
+
+    /** everything, reading ahead and bypassing the caches */
+    static Range Bulk() { return Range{Key{}, Key::END, 2UL << 20U, false}; }
+};
+
 inline void LOG(char code, const Key& key, const String& value) {
 #ifndef NDEBUG
     if (Key::trace_by_key) {
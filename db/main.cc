@@ -310,7 +310,8 @@ Status CommandDump(RonReplica& replica, Args& args) {
         if (rdt == ZERO_RAW_FORM) return Status::BADARGS.comment("unknown RDT");
     }*/
     if (!replica.open()) return Status::BAD_STATE.comment("db is not open?");
-    StoreIterator i{replica.GetActiveStore()};
+    // a bulk scan: no cache churn for concurrent queries
+    StoreIterator i{replica.GetActiveStore(), Range::Bulk()};
     IFOK(i.SeekTo(Key{}));
     do {
         cout << i.key().str() << '\t' << i.value().data().str();
@@ -677,7 +678,12 @@ Status OpenReplica(RonReplica& replica) {
     if (!file_exists(ROCKSDB_STORE_DIR)) {
         return Status::NOT_FOUND.comment("no replica found (.swarmdb)");
     }
-    IFOK(replica.Open());
+    // logs only, states served off a cache (set it on every run)
+    if (getenv("SWARMDB_LAZY_STATES") != nullptr) {
+        replica.set_mode(LAZY_STATE_MODE);
+    }
+    // a query-only process next to the writer
+    IFOK(replica.Open(getenv("SWARMDB_READONLY") != nullptr));
     return Status::OK;
 }
 
@@ -757,6 +763,15 @@ int main(int argn, char** args) {
     if (getenv("TRACE")) {
         Key::trace_by_key = true;
     }
+    if (getenv("SWARMDB_PROFILE")) {
+        ROCKSDB_STORE_PROFILE = getenv("SWARMDB_PROFILE");
+    }
+    if (getenv("SWARMDB_WAL_TTL")) {
+        ROCKSDB_WAL_TTL = strtoull(getenv("SWARMDB_WAL_TTL"), nullptr, 10);
+    }
+    if (getenv("SWARMDB_FORM_FAMILIES")) {
+        ROCKSDB_FORM_FAMILIES = true;
+    }
 
     Status ok = RunCommands(arguments);
 
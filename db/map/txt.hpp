@@ -9,7 +9,7 @@ template <typename Commit>
 Status TxtMapper<Commit>::Read(Builder& response, Cursor& query, Commit& branch) {
     Uuid id = query.id().event();
     Frame state;
-    IFOK( branch.Read(Key{id, RGA_RDT_FORM}, state) );
+    IFOK( branch.GetObject(state, id, RGA_FORM_UUID) );
     vector<bool> tombs;
     ScanRGA<Frame>(tombs, state);
     // now, walk em both
@@ -5,6 +5,7 @@
 #include <vector>
 #include "../rdt/rdt.hpp"
 #include "../ron/ron.hpp"
+#include "arena.hpp"
 #include "key.hpp"
 
 using namespace btree;
@@ -20,43 +21,56 @@ class InMemoryStore {
     using Cursors = typename Frame::Cursors;
 
    private:
-    using Map = btree_multimap<Key, Frame>;
+    /** the frames' bytes live in the arena */
+    using Map = btree_multimap<Key, Slice>;
     using MapIter = typename Map::iterator;
 
     Map state_;
+    Arena arena_;
 
     static Status Merge(Frame& merged, MapIter from, MapIter till) {
         Key key = from->first;
         Cursors inputs;
         while (from != till) {
             assert(from->first == key);
-            inputs.push_back(from->second.cursor());
+            inputs.push_back(Cursor{from->second});
             ++from;
         }
         return MergeCursors(merged, key.form(), inputs);
     }
 
+    /** Replaces a key's records with their merge. */
+    MapIter Replace(MapIter from, MapIter till, const Frame& merged) {
+        Key key = from->first;
+        state_.erase(from, till);
+        return state_.insert(std::make_pair(key, arena_.Append(merged.data())));
+    }
+
    public:
     using Record = std::pair<Key, Frame>;
     using Records = std::vector<Record>;
+    using Keys = std::vector<Key>;
+    using Frames = std::vector<Frame>;
 
-    InMemoryStore() : state_{} {}
+    InMemoryStore() : state_{}, arena_{} {}
 
     Status Open(Uuid id) {
         Frame meta = OneOp<Frame>(id, YARN_FORM_UUID);
         Key zero{};
-        state_.insert(Record{zero, meta});
-        state_.insert(Record{Key::END, Frame{}});  // FIXME WTF?!
+        IFOK(Write(zero, meta));
+        state_.insert(std::make_pair(Key::END, Slice{}));  // FIXME WTF?!
         return Status::OK;
     }
 
     Status Create(Uuid id) { return Status::OK; }
 
     class Iterator {
+        InMemoryStore& host_;
         Map& store_;
         MapIter b_, e_;
         Frame merged_;
         fsize_t len_;
+        Range range_;
         friend class InMemoryStore;
 
         void scroll() {
@@ -67,10 +81,36 @@ class InMemoryStore {
             }
         }
 
+        /** ends a range scan at range_.till */
+        Status clip() {
+            if (len_ && b_->first != Key::END && !range_.has(b_->first)) {
+                len_ = 0;
+                return Status::ENDOFINPUT;
+            }
+            return Status::OK;
+        }
+
        public:
-        /** Creates a new iterator positioned at 0 */
-        explicit Iterator(InMemoryStore& host)
-            : store_{host.state_}, b_{}, e_{}, merged_{}, len_{0} {}
+        /** Creates a new iterator positioned at 0; no prefix filters here,
+         * so same_prefix changes nothing */
+        explicit Iterator(InMemoryStore& host, bool same_prefix = false)
+            : host_{host},
+              store_{host.state_},
+              b_{},
+              e_{},
+              merged_{},
+              len_{0},
+              range_{} {}
+
+        /** A range scan, stops at range.till; nothing to cache here */
+        Iterator(InMemoryStore& host, const Range& range)
+            : host_{host},
+              store_{host.state_},
+              b_{},
+              e_{},
+              merged_{},
+              len_{0},
+              range_{range} {}
 
         Cursor value() {
             if (len_ == 0) {
@@ -97,16 +137,14 @@ class InMemoryStore {
                 return Status::BAD_STATE.comment("invalid iterator");
             }
             if (len_ > 1 && !merged_.empty()) {
-                auto k = key();
-                store_.erase(b_, e_);
-                e_ = store_.insert(Record{k, std::move(merged_)});
+                e_ = host_.Replace(b_, e_, merged_);
                 ++e_;
             }
             b_ = e_;
             merged_.Clear();
             scroll();
             // TODO merge'em here - kill merged_, len_, make val()/key() const
-            return Status::OK;
+            return clip();
         }
 
         /**
@@ -116,6 +154,11 @@ class InMemoryStore {
          * @return OK or error if something really bad happened
          */
         Status SeekTo(ron::Key key, bool prev = false) {
+            if (prev && range_.till != Key::END && !(key < range_.till)) {
+                key = range_.last();
+            } else if (!prev && key < range_.from) {
+                key = range_.from;
+            }
             b_ = store_.lower_bound(key);
             e_ = b_;
             if (b_ == store_.end()) {
@@ -135,6 +178,7 @@ class InMemoryStore {
                 }
             }
             scroll();
+            clip();
             return Status::OK;
         }
 
@@ -148,7 +192,7 @@ class InMemoryStore {
     Status Write(Key key, const Frame& change) {
         if (key == Key::END)
             return Status::BADARGS.comment("can't write at Key::END");
-        state_.insert(Record{key, change});
+        state_.insert(std::make_pair(key, arena_.Append(change.data())));
         return Status::OK;
     }
 
@@ -162,13 +206,21 @@ class InMemoryStore {
         auto i = range.first;
         ++i;
         if (range.second == i) {
-            result = range.first->second;
+            result = Frame{range.first->second};
             return Status::OK;
         }
-        Status ok = Merge(result, range.first, range.second);
-        state_.erase(range.first, range.second);
-        state_.insert(Record{key, result});
-        return ok;
+        IFOK(Merge(result, range.first, range.second));
+        Replace(range.first, range.second, result);
+        return Status::OK;
+    }
+
+    /** No round trips to save here, so key by key. */
+    Status MultiRead(const Keys& keys, Frames& results) {
+        results.resize(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            IFOK(Read(keys[i], results[i]));
+        }
+        return Status::OK;
     }
 
     Status Write(const Records& batch) {
@@ -181,20 +233,24 @@ class InMemoryStore {
 
     Status Compact() { return Status::NOT_IMPLEMENTED; }
 
-    bool Release(Records& data) {
+    /** Moves the records out, bytes and all (no copies); the store is
+     * empty afterwards. */
+    bool Release(ArenaBatch& batch) {
         if (state_.empty()) {
             return false;
         }
-        auto i = state_.begin();
-        while (i != state_.end()) {
-            data.push_back(*i);
-            ++i;
+        batch.records.reserve(batch.records.size() + state_.size());
+        for (auto& rec : state_) {
+            batch.records.push_back(rec);
         }
+        state_.clear();
+        batch.arena.Absorb(arena_);
         return true;
     }
 
     Status Close() {
         state_.clear();
+        arena_.Clear();
         return Status::OK;
     }
 };
@@ -0,0 +1,897 @@
+#include "mmap_store.hpp"
+#include <btree_map.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <list>
+#include <mutex>
+
+namespace ron {
+
+String MMAP_STORE_DIR{".swarmmap"};
+
+size_t MMAP_STORE_COMPACT{64UL << 20U};
+
+size_t MMAP_STORE_OPEN_LIMIT{256};
+
+//  F I L E S
+
+/** The files are host-endian: a store is not meant to travel. */
+constexpr uint64_t SEGMENT_MAGIC{0x746e656d67657352UL};  // "Rsegment"
+constexpr uint64_t LOG_MAGIC{0x2020676f4c6e6f52UL};      // "RonLog  "
+
+static const char* SEGMENT_EXT{".seg"};
+static const char* LOG_EXT{".log"};
+
+/** A segment index entry; the index is sorted by key. */
+struct IndexEntry {
+    uint64pair key;
+    uint64_t offset;
+    uint64_t size;
+};
+
+/** The last bytes of a segment. */
+struct SegmentFooter {
+    uint64_t magic;
+    uint64_t index_offset;
+    uint64_t entries;
+    /** the generation of the last log merged into the segment */
+    uint64_t log_gen;
+};
+
+/** The first bytes of a log; the log is dropped once a segment of its
+ * generation is written, so a crash mid-compaction merges nothing twice. */
+struct LogHeader {
+    uint64_t magic;
+    uint64_t gen;
+};
+
+/** The records of one Write(), replayed all or none: a crash mid-append
+ * leaves a batch that is short or fails the checksum. */
+struct BatchHeader {
+    /** the records' bytes */
+    uint64_t size;
+    uint32_t count;
+    /** CRC-32C of the records' bytes */
+    uint32_t crc;
+};
+
+struct RecordHeader {
+    /** the key bits; plain words, so the header is memcpy-able */
+    uint64_t key[2];
+    uint32_t size;
+    uint32_t flags;
+};
+
+/** The record overwrites the key's earlier records (Put). */
+constexpr uint32_t RECORD_PUT{1};
+
+static inline Status iofail(const String& path) {
+    return Status::IOFAIL.comment(path + ": " + strerror(errno));
+}
+
+/** CRC-32C (Castagnoli), bytewise */
+static uint32_t crc32c(const char* data, size_t size) {
+    static const struct Table {
+        uint32_t t[256];
+        Table() : t{} {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k) {
+                    c = (c >> 1U) ^ (0x82F63B78U & (0U - (c & 1U)));
+                }
+                t[i] = c;
+            }
+        }
+    } table;
+    uint32_t crc = ~0U;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table.t[(crc ^ uint8_t(data[i])) & 0xffU] ^ (crc >> 8U);
+    }
+    return ~crc;
+}
+
+static Status write_all(int fd, const void* data, size_t size,
+                        const String& path) {
+    auto at = static_cast<const char*>(data);
+    while (size) {
+        ssize_t w = ::write(fd, at, size);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return iofail(path);
+        }
+        at += w;
+        size -= w;
+    }
+    return Status::OK;
+}
+
+/** A read-only mapping of a whole file, unmapped with the last pin. */
+struct Mapping {
+    const Char* data;
+    size_t size;
+
+    Mapping() : data{nullptr}, size{0} {}
+    Mapping(const Mapping&) = delete;
+    ~Mapping() {
+        if (data) munmap(const_cast<Char*>(data), size);
+    }
+};
+
+using SharedMapping = shared_ptr<const Mapping>;
+
+/** Maps the file; a missing file maps empty. */
+static Status map_file(const String& path, SharedMapping& into) {
+    auto map = make_shared<Mapping>();
+    into = map;
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return errno == ENOENT ? Status::OK : iofail(path);
+    }
+    struct stat st {};
+    if (fstat(fd, &st)) {
+        ::close(fd);
+        return iofail(path);
+    }
+    if (st.st_size) {
+        void* at = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (at == MAP_FAILED) {
+            ::close(fd);
+            return iofail(path);
+        }
+        map->data = static_cast<const Char*>(at);
+        map->size = st.st_size;
+    }
+    ::close(fd);
+    return Status::OK;
+}
+
+//  S T A T E
+
+struct MmapSlot;
+
+struct MmapDir {
+    String path;
+    /** guards the list and the slots' states: stores (branches) are used
+     * from many threads, and loading one may unload another */
+    std::mutex mutex;
+    /** the stores with their state loaded, most recently used first */
+    std::list<MmapSlot*> loaded;
+
+    explicit MmapDir(String p) : path{std::move(p)}, mutex{}, loaded{} {}
+};
+
+struct TailRecord {
+    Slice data;
+    bool put;
+};
+
+struct MmapState {
+    /** the file path sans extension */
+    String path;
+    SharedMapping segment;
+    const IndexEntry* index;
+    size_t entries;
+    uint64_t segment_gen;
+    /** the records since the last compaction, bytes in the arena */
+    btree::btree_multimap<Key, TailRecord> tail;
+    Arena arena;
+    size_t tail_bytes;
+    int log_fd;
+    uint64_t log_gen;
+    /** the log's length up to its last whole batch */
+    size_t log_size;
+    /** opened side by side with a writer: the files are not touched */
+    bool read_only;
+
+    MmapState()
+        : path{},
+          segment{},
+          index{nullptr},
+          entries{0},
+          segment_gen{0},
+          tail{},
+          arena{},
+          tail_bytes{0},
+          log_fd{-1},
+          log_gen{0},
+          log_size{0},
+          read_only{false} {}
+
+    MmapState(const MmapState&) = delete;
+
+    ~MmapState() {
+        if (log_fd >= 0) ::close(log_fd);
+    }
+
+    String segment_path() const { return path + SEGMENT_EXT; }
+    String log_path() const { return path + LOG_EXT; }
+
+    Status MapSegment() {
+        IFOK(map_file(segment_path(), segment));
+        index = nullptr;
+        entries = 0;
+        segment_gen = 0;
+        if (!segment->size) {
+            return Status::OK;
+        }
+        SegmentFooter footer{};
+        if (segment->size < sizeof(footer)) {
+            return Status::BADFRAME.comment("no segment footer");
+        }
+        memcpy(&footer, segment->data + segment->size - sizeof(footer),
+               sizeof(footer));
+        if (footer.magic != SEGMENT_MAGIC ||
+            footer.index_offset + footer.entries * sizeof(IndexEntry) +
+                    sizeof(footer) !=
+                segment->size) {
+            return Status::BADFRAME.comment("bad segment " + segment_path());
+        }
+        index = reinterpret_cast<const IndexEntry*>(segment->data +
+                                                     footer.index_offset);
+        entries = footer.entries;
+        segment_gen = footer.log_gen;
+        return Status::OK;
+    }
+
+    /** @return the first index entry not less than the key */
+    size_t lower_bound(Key key) const {
+        return std::lower_bound(index, index + entries, key.bits,
+                                [](const IndexEntry& e, const uint64pair& k) {
+                                    return e.key < k;
+                                }) -
+               index;
+    }
+
+    inline Key key_at(size_t at) const { return Key{index[at].key}; }
+
+    inline Slice base_at(size_t at) const {
+        return Slice{segment->data + index[at].offset,
+                     (fsize_t)index[at].size};
+    }
+
+    void Apply(Key key, Slice data, uint32_t flags) {
+        if (flags & RECORD_PUT) {
+            auto range = tail.equal_range(key);
+            tail.erase(range.first, range.second);
+        }
+        tail.insert(std::make_pair(
+            key, TailRecord{arena.Append(data), (flags & RECORD_PUT) != 0}));
+        tail_bytes += sizeof(RecordHeader) + data.size();
+    }
+
+    /** Starts a new (empty) log of the next generation. */
+    Status ResetLog() {
+        String tmp = log_path() + ".tmp";
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return iofail(tmp);
+        LogHeader header{LOG_MAGIC, segment_gen + 1};
+        Status ok = write_all(fd, &header, sizeof(header), tmp);
+        if (ok && fsync(fd)) ok = iofail(tmp);
+        ::close(fd);
+        if (!ok) return ok;
+        if (rename(tmp.c_str(), log_path().c_str())) return iofail(tmp);
+        if (log_fd >= 0) ::close(log_fd);
+        log_fd = ::open(log_path().c_str(), O_WRONLY | O_APPEND);
+        if (log_fd < 0) return iofail(log_path());
+        log_gen = header.gen;
+        log_size = sizeof(header);
+        tail.clear();
+        arena.Clear();
+        tail_bytes = 0;
+        return Status::OK;
+    }
+
+    /** Checks that the batch is count whole records, applies them if
+     * asked to. @return whether the batch is whole */
+    bool ReplayBatch(const char* data, size_t size, uint32_t count,
+                     bool apply) {
+        size_t at = 0;
+        for (; count && at + sizeof(RecordHeader) <= size; --count) {
+            RecordHeader rec{};
+            memcpy(&rec, data + at, sizeof(rec));
+            if (rec.size > size - at - sizeof(rec)) return false;
+            if (apply) {
+                Apply(Key{uint64pair{rec.key[0], rec.key[1]}},
+                      Slice{data + at + sizeof(rec), rec.size}, rec.flags);
+            }
+            at += sizeof(rec) + rec.size;
+        }
+        return !count && at == size;
+    }
+
+    /** Replays the log into the tail, whole batches only; a torn or
+     * garbled tail (a crash mid-append) is cut off. */
+    Status ReadLog() {
+        String log;
+        int fd = ::open(log_path().c_str(), O_RDONLY);
+        if (fd < 0 && errno == ENOENT && read_only) {
+            return Status::OK;
+        }
+        if (fd < 0) {
+            return errno == ENOENT ? ResetLog() : iofail(log_path());
+        }
+        char buf[1U << 16U];
+        ssize_t r;
+        while ((r = ::read(fd, buf, sizeof(buf))) != 0) {
+            if (r < 0 && errno == EINTR) continue;
+            if (r < 0) {
+                ::close(fd);
+                return iofail(log_path());
+            }
+            log.append(buf, r);
+        }
+        ::close(fd);
+        LogHeader header{};
+        if (log.size() < sizeof(header)) {
+            return read_only ? Status::OK : ResetLog();
+        }
+        memcpy(&header, log.data(), sizeof(header));
+        if (header.magic != LOG_MAGIC) {
+            return Status::BADFRAME.comment("bad log " + log_path());
+        }
+        if (header.gen <= segment_gen) {  // compacted already
+            return read_only ? Status::OK : ResetLog();
+        }
+        size_t at = sizeof(header);
+        while (at + sizeof(BatchHeader) <= log.size()) {
+            BatchHeader batch{};
+            memcpy(&batch, log.data() + at, sizeof(batch));
+            const char* body = log.data() + at + sizeof(batch);
+            if (batch.size > log.size() - at - sizeof(batch) ||
+                crc32c(body, batch.size) != batch.crc ||
+                !ReplayBatch(body, batch.size, batch.count, false)) {
+                break;
+            }
+            ReplayBatch(body, batch.size, batch.count, true);
+            at += sizeof(batch) + batch.size;
+        }
+        log_gen = header.gen;
+        log_size = at;
+        if (read_only) {
+            return Status::OK;  // a torn batch may be an ongoing append
+        }
+        log_fd = ::open(log_path().c_str(), O_WRONLY | O_APPEND);
+        if (log_fd < 0) return iofail(log_path());
+        if (at < log.size() && ftruncate(log_fd, at)) {
+            return iofail(log_path());
+        }
+        return Status::OK;
+    }
+
+    /** The bytes of one Append(), the header filled in there. */
+    struct LogBatch {
+        String bytes;
+        uint32_t count;
+        LogBatch() : bytes(sizeof(BatchHeader), '\0'), count{0} {}
+    };
+
+    static void Encode(LogBatch& into, Key key, Slice data, uint32_t flags) {
+        RecordHeader rec{{key.bits.first, key.bits.second},
+                         (uint32_t)data.size(),
+                         flags};
+        into.bytes.append(reinterpret_cast<const char*>(&rec), sizeof(rec));
+        into.bytes.append(reinterpret_cast<const char*>(data.data()),
+                          data.size());
+        ++into.count;
+    }
+
+    /** Appends the batch in one write(); a failed write is cut off, so
+     * the log never keeps a part of a batch the tail lacks. */
+    Status Append(LogBatch& batch) {
+        if (read_only) return Status::BAD_STATE.comment("read-only store");
+        const char* body = batch.bytes.data() + sizeof(BatchHeader);
+        size_t size = batch.bytes.size() - sizeof(BatchHeader);
+        BatchHeader header{size, batch.count, crc32c(body, size)};
+        memcpy(&batch.bytes[0], &header, sizeof(header));
+        Status ok = write_all(log_fd, batch.bytes.data(), batch.bytes.size(),
+                              log_path());
+        if (!ok) {
+            if (ftruncate(log_fd, log_size)) return iofail(log_path());
+            return ok;
+        }
+        log_size += batch.bytes.size();
+        return Status::OK;
+    }
+
+    /** Collects the key's records in merge order: the segment's one, then
+     * the tail's (a tail put hides the former).
+     * @return whether the segment has a (visible) record */
+    bool RecordsOf(Key key, std::vector<Slice>& into) const {
+        into.clear();
+        bool based = false;
+        auto range = tail.equal_range(key);
+        if (range.first == range.second || !range.first->second.put) {
+            size_t at = lower_bound(key);
+            if (at < entries && key_at(at) == key) {
+                into.push_back(base_at(at));
+                based = true;
+            }
+        }
+        for (auto i = range.first; i != range.second; ++i) {
+            into.push_back(i->second.data);
+        }
+        return based;
+    }
+
+    /** @return the first key not less than (greater than, if after) the
+     * given one, Key::END if none */
+    Key Seek(Key key, bool after) const {
+        Key ret = Key::END;
+        size_t at = lower_bound(key);
+        if (after && at < entries && key_at(at) == key) ++at;
+        if (at < entries) ret = key_at(at);
+        auto t = after ? tail.upper_bound(key) : tail.lower_bound(key);
+        if (t != tail.end() && t->first < ret) ret = t->first;
+        return ret;
+    }
+
+    /** @return the last key not greater than the given one, Key::END if
+     * none */
+    Key SeekBack(Key key) const {
+        bool found = false;
+        Key ret{};
+        size_t at = lower_bound(key);
+        if (at < entries && key_at(at) == key) return key;
+        if (at > 0) {
+            ret = key_at(at - 1);
+            found = true;
+        }
+        auto t = tail.upper_bound(key);
+        if (t != tail.begin()) {
+            --t;
+            if (!found || ret < t->first) ret = t->first;
+            found = true;
+        }
+        return found ? ret : Key::END;
+    }
+};
+
+/** A store as the dir listing knows it; the state (the mapping, the tail,
+ * the log fd) is loaded on first use and unloaded once
+ * MMAP_STORE_OPEN_LIMIT others were used since. A call that uses the
+ * state pins it, so an unloaded state lives till that call ends. */
+struct MmapSlot {
+    shared_ptr<MmapDir> dir;
+    /** the file path sans extension */
+    String path;
+    bool read_only;
+    /** guarded by the dir's mutex, as is lru */
+    shared_ptr<MmapState> state;
+    std::list<MmapSlot*>::iterator lru;
+
+    MmapSlot(shared_ptr<MmapDir> d, String p, bool ro)
+        : dir{std::move(d)},
+          path{std::move(p)},
+          read_only{ro},
+          state{},
+          lru{} {}
+
+    MmapSlot(const MmapSlot&) = delete;
+
+    ~MmapSlot() {
+        std::lock_guard<std::mutex> lock{dir->mutex};
+        Unload();
+    }
+
+    /** the dir's mutex held */
+    void Unload() {
+        if (!state) return;
+        dir->loaded.erase(lru);
+        state.reset();
+    }
+
+    /** Loads the state, if not yet, under the dir's mutex, so the loads
+     * of the dir's stores go one at a time. */
+    Status Load(shared_ptr<MmapState>& into) {
+        std::lock_guard<std::mutex> lock{dir->mutex};
+        if (state) {
+            dir->loaded.splice(dir->loaded.begin(), dir->loaded, lru);
+            into = state;
+            return Status::OK;
+        }
+        shared_ptr<MmapState> st = make_shared<MmapState>();
+        st->path = path;
+        st->read_only = read_only;
+        IFOK(st->MapSegment());
+        IFOK(st->ReadLog());
+        state = std::move(st);
+        dir->loaded.push_front(this);
+        lru = dir->loaded.begin();
+        // the tail is in the log, so unloading loses nothing
+        while (MMAP_STORE_OPEN_LIMIT &&
+               dir->loaded.size() > MMAP_STORE_OPEN_LIMIT) {
+            dir->loaded.back()->Unload();
+        }
+        into = state;
+        return Status::OK;
+    }
+};
+
+static inline Status load(const shared_ptr<void>& st,
+                          shared_ptr<MmapState>& into) {
+    if (!st) return Status::BAD_STATE.comment("closed");
+    return static_cast<MmapSlot*>(st.get())->Load(into);
+}
+
+static inline const String& dir_of(const shared_ptr<void>& db) {
+    return static_cast<MmapDir*>(db.get())->path;
+}
+
+template <typename Frame>
+static Status merge_records(Frame& into, Key key,
+                            const std::vector<Slice>& records) {
+    typename Frame::Cursors inputs;
+    inputs.reserve(records.size());
+    for (auto& rec : records) inputs.push_back(typename Frame::Cursor{rec});
+    return MergeCursors(into, key.form(), inputs);
+}
+
+//  S T O R E
+
+template <typename Frame>
+Status MmapStore<Frame>::OpenStore(Uuid id, bool load_now, bool read_only) {
+    auto slot = make_shared<MmapSlot>(static_pointer_cast<MmapDir>(db_),
+                                      dir_of(db_) + '/' + id.str(), read_only);
+    if (load_now) {
+        shared_ptr<MmapState> st;
+        IFOK(slot->Load(st));
+    }
+    st_ = slot;
+    return Status::OK;
+}
+
+template <typename Frame>
+Status MmapStore<Frame>::Create(Uuid id) {
+    if (mkdir(MMAP_STORE_DIR.c_str(), 0755) && errno != EEXIST) {
+        return iofail(MMAP_STORE_DIR);
+    }
+    if (!db_) {
+        db_ = make_shared<MmapDir>(MMAP_STORE_DIR);
+    }
+    String path = dir_of(db_) + '/' + id.str() + LOG_EXT;
+    struct stat st {};
+    if (id != Uuid::NIL && stat(path.c_str(), &st) == 0) {
+        return Status::BADARGS.comment("store exists: " + id.str());
+    }
+    IFOK(OpenStore(id, true, false));
+
+    tip = Uuid::NIL;
+    Frame now = OneOp<Frame>(tip, ZERO_FORM_UUID);
+    IFOK(Write(Key::ZERO, now));
+
+    return Status::OK;
+}
+
+template <typename Frame>
+Status MmapStore<Frame>::Open(Uuid id) {
+    if (st_) return Status::BAD_STATE.comment("store open already");
+    if (!db_) {
+        db_ = make_shared<MmapDir>(MMAP_STORE_DIR);
+    }
+    return OpenStore(id, true, false);
+}
+
+template <class Frame>
+Status MmapStore<Frame>::OpenAll(Branches& branches, bool read_only) {
+    DIR* dir = opendir(MMAP_STORE_DIR.c_str());
+    if (!dir) return iofail(MMAP_STORE_DIR);
+    Strings names;
+    size_t ext = strlen(LOG_EXT);
+    for (struct dirent* e = readdir(dir); e; e = readdir(dir)) {
+        String name{e->d_name};
+        if (name.size() > ext &&
+            name.compare(name.size() - ext, ext, LOG_EXT) == 0) {
+            names.push_back(name.substr(0, name.size() - ext));
+        }
+    }
+    closedir(dir);
+
+    branches.clear();
+    branches.reserve(names.size());
+    SharedPtr db = make_shared<MmapDir>(MMAP_STORE_DIR);
+    for (auto& name : names) {
+        Uuid id{name};
+        MmapStore<Frame> next{db};
+        IFOK(next.OpenStore(id, false, read_only));  // no reads till used
+        branches.emplace(id, next);
+    }
+    return Status::OK;
+}
+
+template <typename Frame>
+Status MmapStore<Frame>::Compact() {
+    shared_ptr<MmapState> s;
+    IFOK(load(st_, s));
+    MmapState& st = *s;
+    if (st.read_only) return Status::BAD_STATE.comment("read-only store");
+    if (st.tail.empty()) {
+        return Status::OK;
+    }
+    String tmp = st.segment_path() + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return iofail(tmp);
+
+    std::vector<IndexEntry> index;
+    index.reserve(st.entries + st.tail.size());
+    String buf;
+    uint64_t offset = 0;
+    std::vector<Slice> records;
+    Frame merged;
+    Status ok = Status::OK;
+    for (Key key = st.Seek(Key{}, false); ok && key != Key::END;
+         key = st.Seek(key, true)) {
+        st.RecordsOf(key, records);
+        Slice data = records.front();
+        if (records.size() > 1) {
+            ok = merge_records(merged, key, records);
+            data = Slice{merged.data()};
+        }
+        index.push_back(IndexEntry{key.bits, offset, data.size()});
+        buf.append(reinterpret_cast<const char*>(data.data()), data.size());
+        offset += data.size();
+        if (ok && buf.size() >= (1U << 20U)) {
+            ok = write_all(fd, buf.data(), buf.size(), tmp);
+            buf.clear();
+        }
+    }
+    // the index is read in place, so it is aligned
+    buf.append((8 - offset % 8) % 8, '\0');
+    offset += (8 - offset % 8) % 8;
+    buf.append(reinterpret_cast<const char*>(index.data()),
+               index.size() * sizeof(IndexEntry));
+    SegmentFooter footer{SEGMENT_MAGIC, offset, index.size(), st.log_gen};
+    buf.append(reinterpret_cast<const char*>(&footer), sizeof(footer));
+    if (ok) ok = write_all(fd, buf.data(), buf.size(), tmp);
+    if (ok && fsync(fd)) ok = iofail(tmp);
+    ::close(fd);
+    if (!ok) {
+        unlink(tmp.c_str());
+        return ok;
+    }
+    if (rename(tmp.c_str(), st.segment_path().c_str())) return iofail(tmp);
+
+    // pinned reads keep the old mapping alive
+    IFOK(st.MapSegment());
+    return st.ResetLog();
+}
+
+template <typename Frame>
+Status MmapStore<Frame>::Drop() {
+    shared_ptr<MmapState> s;
+    IFOK(load(st_, s));
+    MmapState& st = *s;
+    if (st.read_only) return Status::BAD_STATE.comment("read-only store");
+    if (unlink(st.log_path().c_str())) return iofail(st.log_path());
+    if (unlink(st.segment_path().c_str()) && errno != ENOENT) {
+        return iofail(st.segment_path());
+    }
+    return Close();
+}
+
+template <typename Frame>
+Status MmapStore<Frame>::Close() {
+    if (!db_.use_count()) return Status::BAD_STATE.comment("already closed");
+    st_.reset();
+    db_.reset();
+    return Status::OK;
+}
+
+template <typename Frame>
+Status MmapStore<Frame>::Write(Key key, const Frame& change) {
+    if (key == Key::END) {
+        return Status::BADARGS.comment("can't write to Key::END");
+    }
+    shared_ptr<MmapState> s;
+    IFOK(load(st_, s));
+    MmapState& st = *s;
+    LOG('w', key, change.data());
+    MmapState::LogBatch rec;
+    MmapState::Encode(rec, key, Slice{change.data()}, 0);
+    IFOK(st.Append(rec));
+    st.Apply(key, Slice{change.data()}, 0);
+    if (MMAP_STORE_COMPACT && st.tail_bytes > MMAP_STORE_COMPACT) {
+        return Compact();
+    }
+    return Status::OK;
+}
+
+template <typename Frame>
+Status MmapStore<Frame>::Write(const Records& batch) {
+    shared_ptr<MmapState> s;
+    IFOK(load(st_, s));
+    MmapState& st = *s;
+    MmapState::LogBatch recs;
+    for (auto& rec : batch) {
+        if (rec.first == Key::END) {
+            return Status::BADARGS.comment("can't write to Key::END");
+        }
+        MmapState::Encode(recs, rec.first, Slice{rec.second.data()}, 0);
+        LOG('m', rec.first, rec.second.data());
+    }
+    IFOK(st.Append(recs));
+    for (auto& rec : batch) st.Apply(rec.first, Slice{rec.second.data()}, 0);
+    if (MMAP_STORE_COMPACT && st.tail_bytes > MMAP_STORE_COMPACT) {
+        return Compact();
+    }
+    return Status::OK;
+}
+
+template <typename Frame>
+Status MmapStore<Frame>::Write(const ArenaBatch& batch) {
+    shared_ptr<MmapState> s;
+    IFOK(load(st_, s));
+    MmapState& st = *s;
+    MmapState::LogBatch recs;
+    for (auto& rec : batch.records) {
+        if (rec.first == Key::END) {
+            return Status::BADARGS.comment("can't write to Key::END");
+        }
+        MmapState::Encode(recs, rec.first, rec.second, 0);
+        LOG('m', rec.first, String{(const char*)rec.second.data(),
+                                   rec.second.size()});
+    }
+    IFOK(st.Append(recs));
+    for (auto& rec : batch.records) st.Apply(rec.first, rec.second, 0);
+    if (MMAP_STORE_COMPACT && st.tail_bytes > MMAP_STORE_COMPACT) {
+        return Compact();
+    }
+    return Status::OK;
+}
+
+template <typename Frame>
+Status MmapStore<Frame>::Put(Key key, const Frame& state) {
+    if (key == Key::END) {
+        return Status::BADARGS.comment("can't write to Key::END");
+    }
+    shared_ptr<MmapState> s;
+    IFOK(load(st_, s));
+    MmapState& st = *s;
+    LOG('p', key, state.data());
+    MmapState::LogBatch rec;
+    MmapState::Encode(rec, key, Slice{state.data()}, RECORD_PUT);
+    IFOK(st.Append(rec));
+    st.Apply(key, Slice{state.data()}, RECORD_PUT);
+    if (MMAP_STORE_COMPACT && st.tail_bytes > MMAP_STORE_COMPACT) {
+        return Compact();
+    }
+    return Status::OK;
+}
+
+template <typename Frame>
+Status MmapStore<Frame>::Read(Key key, Frame& result) {
+    result.Clear();
+    if (!st_) return Status::BAD_STATE.comment("closed");
+    if (key == Key::END) {
+        return Status::OK;
+    }
+    shared_ptr<MmapState> st;
+    IFOK(load(st_, st));
+    std::vector<Slice> records;
+    st->RecordsOf(key, records);
+    if (records.size() == 1) {
+        result = Frame{records.front()};
+    } else if (records.size() > 1) {
+        IFOK(merge_records(result, key, records));
+    }
+    LOG('r', key, result.data());
+    return Status::OK;
+}
+
+template <typename Frame>
+Status MmapStore<Frame>::Read(Key key, Pinned& result) {
+    result.Release();
+    if (!st_) return Status::BAD_STATE.comment("closed");
+    if (key == Key::END) {
+        return Status::OK;
+    }
+    shared_ptr<MmapState> s;
+    IFOK(load(st_, s));
+    MmapState& st = *s;
+    std::vector<Slice> records;
+    bool based = st.RecordsOf(key, records);
+    if (records.empty()) {
+        LOG('r', key, "");
+        return Status::OK;
+    }
+    if (records.size() == 1 && based) {
+        result.data_ = records.front();
+        result.pin_ = st.segment;
+    } else if (records.size() == 1) {
+        // the arena goes with the next compaction
+        result.Own(Frame{records.front()});
+    } else {
+        auto merged = make_shared<Frame>();
+        IFOK(merge_records(*merged, key, records));
+        result.Own(merged);
+    }
+    return Status::OK;
+}
+
+template <typename Frame>
+Status MmapStore<Frame>::MultiRead(const Keys& keys, Frames& results) {
+    results.resize(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        IFOK(Read(keys[i], results[i]));
+    }
+    return Status::OK;
+}
+
+//  I T E R A T O R
+
+template <typename Frame>
+MmapStore<Frame>::Iterator::Iterator(MmapStore& host, bool same_prefix)
+    : db_{host.db_}, st_{host.st_}, range_{}, key_{Key::END}, value_{} {}
+
+template <typename Frame>
+MmapStore<Frame>::Iterator::Iterator(MmapStore& host, const Range& range)
+    : db_{host.db_},
+      st_{host.st_},
+      range_{range},
+      key_{Key::END},
+      value_{} {}
+
+template <typename Frame>
+typename Frame::Cursor MmapStore<Frame>::Iterator::value() {
+    if (key_ == Key::END || !st_) {
+        return Cursor{""};
+    }
+    if (value_.empty()) {
+        MmapStore host{db_, st_};
+        Status ok = host.Read(key_, value_);
+        if (!ok) return Cursor{""};
+    }
+    return value_.cursor();
+}
+
+template <typename Frame>
+Status MmapStore<Frame>::Iterator::Next() {
+    if (!st_) {
+        return Status::BAD_STATE.comment("closed");
+    }
+    if (key_ == Key::END) {
+        return Status::ENDOFINPUT;
+    }
+    value_.Release();
+    shared_ptr<MmapState> st;
+    IFOK(load(st_, st));
+    key_ = st->Seek(key_, true);
+    if (!range_.has(key_)) key_ = Key::END;
+    return key_ == Key::END ? Status::ENDOFINPUT : Status::OK;
+}
+
+template <typename Frame>
+Status MmapStore<Frame>::Iterator::SeekTo(Key key, bool prev) {
+    if (!st_) {
+        return Status::BAD_STATE.comment("closed");
+    }
+    value_.Release();
+    shared_ptr<MmapState> st;
+    IFOK(load(st_, st));
+    if (prev && !(key < range_.till)) {
+        key = range_.last();
+    } else if (!prev && key < range_.from) {
+        key = range_.from;
+    }
+    key_ = prev ? st->SeekBack(key) : st->Seek(key, false);
+    if (!range_.has(key_)) key_ = Key::END;
+    return Status::OK;
+}
+
+template <typename Frame>
+Status MmapStore<Frame>::Iterator::Close() {
+    value_.Release();
+    st_.reset();
+    db_.reset();
+    key_ = Key::END;
+    return Status::OK;
+}
+
+template class MmapStore<TextFrame>;
+
+}  // namespace ron
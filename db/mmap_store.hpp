@@ -0,0 +1,178 @@
+#ifndef RON_MMAP_STORE_HPP
+#define RON_MMAP_STORE_HPP
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../rdt/rdt.hpp"
+#include "../ron/ron.hpp"
+#include "arena.hpp"
+#include "key.hpp"
+
+namespace ron {
+
+/**
+ * An append-only store with no db engine underneath, e.g. for read-mostly
+ * replicas. Each store (branch) is two files in MMAP_STORE_DIR:
+ *  * `id.seg`, the compacted segment: merged frames, one per key, followed
+ *    by their sorted Key->offset index,
+ *  * `id.log`, the tail: records appended since the last compaction,
+ *    a checksummed batch per write, replayed whole or not at all.
+ * The segment is memory-mapped, so a cold start costs an mmap plus a
+ * replay of the tail, and reads of compacted keys are zero-copy.
+ * Compact() merges the tail into a new segment; writes trigger it once
+ * the tail exceeds MMAP_STORE_COMPACT bytes.
+ * OpenAll() only lists the dir; a store's files are opened on its first
+ * use, and at most MMAP_STORE_OPEN_LIMIT stores stay open (LRU).
+ * Stores are safe to use from many threads, as a Replica does: reads
+ * may run concurrently; a store's writes may not overlap its reads.
+ */
+template <class FrameP>
+class MmapStore {
+   public:
+    using Frame = FrameP;
+    using Cursor = typename Frame::Cursor;
+    using Cursors = typename Frame::Cursors;
+    using Builder = typename Frame::Builder;
+    using Record = std::pair<Key, Frame>;
+    using Records = std::vector<Record>;
+    using Keys = std::vector<Key>;
+    using Frames = std::vector<Frame>;
+    using Branches = std::unordered_map<Uuid, MmapStore<Frame>>;
+    using SharedPtr = std::shared_ptr<void>;
+
+   private:
+    /** the directory; shared by all the stores (branches) */
+    SharedPtr db_;
+
+    /** the segment mapping, the tail, the files, loaded lazily; the types
+     * are hidden in the implementation, like RocksDBStore does with
+     * rocksdb types */
+    SharedPtr st_;
+
+    MmapStore(SharedPtr db, SharedPtr st)
+        : db_{std::move(db)}, st_{std::move(st)} {}
+
+    /** @param load_now whether to map/replay the files now or on first
+     * use (OpenAll) */
+    Status OpenStore(Uuid id, bool load_now, bool read_only);
+
+   public:
+    /** used by Commit and others to cache the last written event id */
+    Uuid tip;
+
+    MmapStore() : db_{nullptr}, st_{nullptr}, tip{} {}
+
+    explicit MmapStore(SharedPtr db) : db_{std::move(db)}, st_{nullptr} {}
+
+    inline SharedPtr db() const { return db_; }
+
+    /** A zero-copy read, see RocksDBStore::Pinned; pins the mapping of
+     * the segment the record is in. */
+    class Pinned {
+        std::shared_ptr<const void> pin_;
+        Slice data_;
+        friend class MmapStore;
+
+       public:
+        Pinned() : pin_{nullptr}, data_{} {}
+        inline Slice data() const { return data_; }
+        inline Cursor cursor() const { return Cursor{data_}; }
+        inline bool empty() const { return data_.empty(); }
+        void Own(const Frame& frame) { Own(std::make_shared<Frame>(frame)); }
+        void Own(std::shared_ptr<const Frame> frame) {
+            data_ = Slice{frame->data()};
+            pin_ = std::move(frame);
+        }
+        void Release() {
+            pin_.reset();
+            data_ = Slice{};
+        }
+    };
+
+    /** Walks the merged view of the segment and the tail. Steps by key,
+     * not by position, so writes and compactions don't invalidate it. */
+    class Iterator {
+        SharedPtr db_;
+        SharedPtr st_;
+        Range range_;
+        Key key_;
+        Pinned value_;
+
+       public:
+        /** no prefix filters here, so same_prefix changes nothing */
+        explicit Iterator(MmapStore& host, bool same_prefix = false);
+        /** A range scan, stops at range.till; the page cache is the only
+         * cache here, so the other hints change nothing. */
+        Iterator(MmapStore& host, const Range& range);
+        Key key() const { return key_; }
+        Cursor value();
+        Status Next();
+        Status SeekTo(Key key, bool prev = false);
+        Status Close();
+    };
+    friend class Iterator;
+
+    inline bool open() const { return st_ != nullptr; }
+
+    /** Creates a new store (files) in MMAP_STORE_DIR, creating the dir
+     * if needed; the NIL store may exist already, like the default column
+     * family of RocksDBStore. */
+    Status Create(Uuid id);
+
+    Status Open(Uuid id);
+
+    /** @param read_only opens the stores side by side with the process
+     * that writes them: the files are not touched, writes fail; reopen
+     * to catch up */
+    static Status OpenAll(Branches& branches, bool read_only = false);
+
+    Status Write(Key key, const Frame& change);
+
+    Status Write(const Records& batch);
+
+    Status Write(const ArenaBatch& batch);
+
+    /** Overwrites the record (Write merges into it). */
+    Status Put(Key key, const Frame& state);
+
+    Status Read(Key key, Frame& result);
+
+    Status Read(Key key, Pinned& result);
+
+    Status MultiRead(const Keys& keys, Frames& results);
+
+    /** Merges the tail into a new segment and index, then truncates it.
+     * Pinned reads of the old segment stay valid. */
+    Status Compact();
+
+    /** Not yet: the files would need layering, see RocksDBStore::Fork.
+     * @return NOT_IMPLEMENTED, so the caller copies the records */
+    Status Fork(Uuid fork_id, MmapStore& fork) {
+        return Status::NOT_IMPLEMENTED.comment("no layers in mmap stores");
+    }
+
+    /** No layers, see Fork() */
+    inline bool layered() const { return false; }
+
+    Status Flatten(size_t limit = 0) { return Status::ENDOFINPUT; }
+
+    Status DropBases() { return Status::OK; }
+
+    Status Drop();
+
+    Status Close();
+};
+
+extern String MMAP_STORE_DIR;
+
+/** The tail size (bytes) that triggers a compaction on write. */
+extern size_t MMAP_STORE_COMPACT;
+
+/** The max number of stores with their files open and mapped; the least
+ * recently used ones get closed (0 for no limit). */
+extern size_t MMAP_STORE_OPEN_LIMIT;
+
+}  // namespace ron
+
+#endif
@@ -1,4 +1,6 @@
 #include "replica.hpp"
+#include <deque>
+#include <thread>
 #include "map.hpp"
 
 namespace ron {
@@ -9,6 +11,30 @@ template <typename Store>
 const Uuid Replica<Store>::NOW_UUID{915334634030497792UL, 0};
 const Uuid ACTIVE_STORE_UUID{"0000active+0"};
 
+uint64_t REPLICA_CATCH_UP_MS{1000};
+
+size_t REPLICA_TIP_CACHE_SIZE{1UL << 14U};
+
+size_t REPLICA_STATE_CACHE_SIZE{1UL << 12U};
+
+size_t REPLICA_SPAN_OPS{64};
+
+size_t REPLICA_LOG_SEGMENT_BYTES{1UL << 16U};
+
+size_t REPLICA_INGEST_THREADS{4};
+
+size_t REPLICA_INGEST_BYTES{1UL << 20U};
+
+size_t REPLICA_INGEST_CHAINS{1UL << 10U};
+
+uint64_t REPLICA_GC_MS{60000};
+
+size_t REPLICA_GC_BATCH{1UL << 10U};
+
+static inline Status read_only_error() {
+    return Status::BAD_STATE.comment("read-only replica");
+}
+
 //  L I F E C Y C L E
 
 template <typename Store>
@@ -31,89 +57,200 @@ Status Replica<Store>::CreateReplica() {
 }
 
 template <typename Store>
-Status Replica<Store>::Open() {
+Status Replica<Store>::Open(bool read_only) {
+    std::lock_guard<std::recursive_mutex> lock{admin_mutex_};
     if (open()) {
         return Status::BAD_STATE.comment("already open");
     }
+    return OpenStores(read_only);
+}
 
-    IFOK(Store::OpenAll(stores_));
+template <typename Store>
+Status Replica<Store>::OpenStores(bool read_only) {
+    typename Store::Branches opened;
+    IFOK(Store::OpenAll(opened, read_only));
+    auto map = std::make_shared<StoreMap>();
+    for (auto& p : opened) {
+        map->emplace(p.first, std::make_shared<StoreSlot>(p.second));
+    }
+    read_only_ = read_only;
+    opened_ = std::chrono::steady_clock::now().time_since_epoch().count();
 
-    for (auto& i : stores_) {
-        Uuid id = i.first;
-        Store& store = i.second;
-        Frame meta_rec;
-        IFOK(store.Read(Key{}, meta_rec));
-        Cursor mc{meta_rec};
-        if (!mc.valid()) {
-            return Status::BADFRAME.comment("tip record is corrupted");
-        }
-        Uuid tip = mc.id();
-        if (tip.origin() != id.origin() && id != Uuid::NIL) {
-            return Status::BADFRAME.comment(
-                "tip record is from a different origin; " + tip.str() +
-                " for " + id.str());
-        }
-        store.tip = tip;
+    untipped_.clear();
+    untipped_.reserve(map->size());
+    for (auto& i : *map) {
+        untipped_.insert(i.first);
     }
+    all_tipped_ = untipped_.empty();
+    std::atomic_store(&stores_, std::shared_ptr<const StoreMap>{map});
+    IFOK(LoadTip(Uuid::NIL));
 
     Frame active;
     if (GetMetaStore().Read(Key{ACTIVE_STORE_UUID, ZERO_RAW_FORM}, active)) {
         Cursor c{active};
         if (HasStore(c.ref())) {
+            std::lock_guard<std::mutex> lock{active_mutex_};
             active_ = c.ref();
         }
     }
 
+    return LoadTip(active_store());
+}
+
+template <typename Store>
+Status Replica<Store>::CatchUp() {
+    if (!read_only_) {
+        return Status::OK;
+    }
+    std::lock_guard<std::recursive_mutex> lock{admin_mutex_};
+    // the old stores close once the Commits on them are gone
+    Uuid active = active_store();
+    DropTips(nullptr);
+    DropStates(nullptr);
+    IFOK(OpenStores(true));
+    if (HasStore(active)) {
+        {
+            std::lock_guard<std::mutex> active_lock{active_mutex_};
+            active_ = active;
+        }
+        IFOK(LoadTip(active));
+    }
+    return Status::OK;
+}
+
+template <typename Store>
+void Replica<Store>::PutStore(Uuid id, const Store& store) {
+    std::lock_guard<std::recursive_mutex> lock{admin_mutex_};
+    auto map = std::make_shared<StoreMap>(*stores());
+    (*map)[id] = std::make_shared<StoreSlot>(store);
+    std::atomic_store(&stores_, std::shared_ptr<const StoreMap>{map});
+}
+
+template <typename Store>
+void Replica<Store>::EraseStore(Uuid id) {
+    std::lock_guard<std::recursive_mutex> lock{admin_mutex_};
+    auto map = std::make_shared<StoreMap>(*stores());
+    map->erase(id);
+    std::atomic_store(&stores_, std::shared_ptr<const StoreMap>{map});
+}
+
+template <typename Store>
+Status Replica<Store>::LoadTip(Uuid store_id) {
+    std::lock_guard<std::recursive_mutex> lock{admin_mutex_};
+    auto u = untipped_.find(store_id);
+    if (u == untipped_.end()) {
+        return Status::OK;
+    }
+    auto slot = FindSlot(store_id);
+    if (!slot) {
+        return Status::NOT_FOUND.comment("no such store: " + store_id.str());
+    }
+    Store& store = slot->store;
+    Frame meta_rec;
+    IFOK(store.Read(Key{}, meta_rec));
+    Cursor mc{meta_rec};
+    if (!mc.valid()) {
+        return Status::BADFRAME.comment("tip record is corrupted");
+    }
+    Uuid tip = mc.id();
+    if (tip.origin() != store_id.origin() && store_id != Uuid::NIL) {
+        return Status::BADFRAME.comment(
+            "tip record is from a different origin; " + tip.str() + " for " +
+            store_id.str());
+    }
+    store.tip = tip;
+    untipped_.erase(u);
+    all_tipped_ = untipped_.empty();
     return Status::OK;
 }
 
 template <typename Store>
 inline Status Replica<Store>::SetActiveStore(Uuid store) {
+    std::lock_guard<std::recursive_mutex> lock{admin_mutex_};
     if (!HasStore(store)) {
         return Status::NOT_FOUND.comment("no such store: " + store.str());
     }
+    if (read_only_) {
+        return read_only_error();
+    }
+    IFOK(LoadTip(store));
     Frame ac_rec = OneOp<Frame>(Now(), store);
     IFOK(GetMetaStore().Write(Key{ACTIVE_STORE_UUID, ZERO_RAW_FORM}, ac_rec));
+    std::lock_guard<std::mutex> active_lock{active_mutex_};
     active_ = store;
     return Status::OK;
 }
 
 template <typename Store>
 Status Replica<Store>::CreateBranch(Word yarn_id, bool transcendent) {
+    std::lock_guard<std::recursive_mutex> lock{admin_mutex_};
     Uuid branch_id = yarn2branch(yarn_id);
     Uuid event_id = transcendent ? Uuid::Time(0, yarn_id) : Now(yarn_id);
     if (HasBranch(yarn_id)) {
         return Status::BADARGS.comment("branch already exists");
     }
+    if (read_only_) {
+        return read_only_error();
+    }
     const Store& meta = GetMetaStore();
     Store new_branch_tmp{meta.db()};
     IFOK(new_branch_tmp.Create(branch_id));
-    stores_.emplace(branch_id, new_branch_tmp);
-
-    Commit commit{*this, branch_id};
-    Frame yarn_init = OneOp<Frame>(event_id, YARN_FORM_UUID);
-    Cursor c{yarn_init};
-    Builder b;
-    commit.SaveChain(b, c);
+    PutStore(branch_id, new_branch_tmp);
 
     /*
     Frame names = OneOp<Frame>(Uuid::NIL, LWW_FORM_UUID);
     IFOK(new_branch.Write(Key{Uuid::NIL, LWW_FORM_UUID}, names));
     */
 
+    return InitBranch(branch_id, event_id);
+}
+
+template <typename Store>
+Status Replica<Store>::InitBranch(Uuid branch_id, Uuid event_id) {
+    Commit commit{*this, branch_id};
+    IFOK(commit.Lock(true));
+    Frame yarn_init = OneOp<Frame>(event_id, YARN_FORM_UUID);
+    Cursor c{yarn_init};
+    Builder b;
+    commit.SaveChain(b, c);
     return commit.Save();
 }
 
 template <typename Store>
 Status Replica<Store>::ForkBranch(Word new_yarn_id, Word orig_yarn_id) {
+    std::lock_guard<std::recursive_mutex> lock{admin_mutex_};
     if (!HasBranch(orig_yarn_id)) {
         return Status::NOT_FOUND.comment("no such branch: " +
                                          orig_yarn_id.str());
     }
+    if (HasBranch(new_yarn_id)) {
+        return Status::BADARGS.comment("branch already exists");
+    }
+    if (read_only_) {
+        return read_only_error();
+    }
+    IFOK(LoadTip(yarn2branch(orig_yarn_id)));
+    Uuid branch_id = yarn2branch(new_yarn_id);
+    // no writes to the original while forking
+    Commit pause{*this, yarn2branch(orig_yarn_id)};
+    IFOK(pause.Lock(true));
+    Store& orig = pause.main_;
+    Store fork{orig.db()};
+    pause.BeginSave();  // Fork() swaps the store's layers under the readers
+    Status ok = orig.Fork(branch_id, fork);
+    pause.EndSave();
+    if (ok) {
+        PutStore(branch_id, fork);
+        return InitBranch(branch_id, Now(new_yarn_id));
+    }
+    if (ok != Status::NOT_IMPLEMENTED) {
+        return ok;
+    }
+
+    // no layers in the store: copy the records, O(data)
     IFOK(CreateBranch(new_yarn_id));
-    Store& orig = GetBranch(orig_yarn_id);
     Store& created = GetBranch(new_yarn_id);
-    StoreIterator i{orig};
+    StoreIterator i{orig, Range::Bulk()};
     IFOK(i.SeekTo(Key{}));
 
     while (i.Next()) {
@@ -125,14 +262,66 @@ Status Replica<Store>::ForkBranch(Word new_yarn_id, Word orig_yarn_id) {
     return Status::OK;
 }
 
+template <typename Store>
+Status Replica<Store>::CreateSnapshotOffBranch(Uuid point) {
+    std::lock_guard<std::recursive_mutex> lock{admin_mutex_};
+    Word yarn_id = point.origin();
+    if (!HasBranch(yarn_id)) {
+        return Status::NOT_FOUND.comment("no such branch: " + yarn_id.str());
+    }
+    if (point.value() == NEVER || HasStore(point)) {
+        return Status::BADARGS.comment("bad snapshot id: " + point.str());
+    }
+    if (read_only_) {
+        return read_only_error();
+    }
+    IFOK(LoadTip(yarn2branch(yarn_id)));
+    Commit pause{*this, yarn2branch(yarn_id)};
+    IFOK(pause.Lock(true));
+    Store& branch = pause.main_;
+    if (point < branch.tip) {
+        return Status::NOT_IMPLEMENTED.comment("can only snapshot the tip");
+    }
+    Store snapshot{branch.db()};
+    pause.BeginSave();  // see ForkBranch()
+    Status ok = branch.Fork(point, snapshot);
+    pause.EndSave();
+    IFOK(ok);
+    // the snapshot's tip is the branch's one
+    Frame zero;
+    IFOK(branch.Read(Key::ZERO, zero));
+    IFOK(snapshot.Write(Key::ZERO, zero));
+    snapshot.tip = branch.tip;
+    PutStore(point, snapshot);
+    return Status::OK;
+}
+
 template <typename Store>
 inline Status Replica<Store>::DropStore(Uuid store) {
+    std::lock_guard<std::recursive_mutex> lock{admin_mutex_};
     if (!HasStore(store)) {
         return Status::NOT_FOUND.comment("no such store: " + store.str());
     }
-    Store& kill = GetStore(store);
-    IFOK(kill.Drop());
-    stores_.erase(store);
+    if (read_only_) {
+        return read_only_error();
+    }
+    // unlisted first, then wait for the Commits in it
+    Commit last{*this, store};
+    EraseStore(store);
+    untipped_.erase(store);
+    all_tipped_ = untipped_.empty();
+    IFOK(last.Lock(true));
+    last.BeginSave();
+    Store& kill = last.main_;
+    DropTips(&kill);
+    DropStates(&kill);
+    Status ok = kill.Drop();
+    {
+        std::lock_guard<std::mutex> dropping{last.slot_->mutex};
+        last.slot_->dropped = true;  // the Commits queued after it fail
+    }
+    last.EndSave();
+    IFOK(ok);
     // TODO consistency checks
     return Status::OK;
 }
@@ -176,20 +365,144 @@ Uuid Replica<Store>::Now(Word origin) {
         origin = active_store().origin();
     }
     Word next = Uuid::HybridTime(time(nullptr));
-    now_ = next > now_ ? next : now_.inc();
-    return Uuid::Time(now_, origin);
+    uint64_t was = now_.load();
+    Word now;
+    do {
+        now = next > Word{was} ? next : Word{was}.inc();
+    } while (!now_.compare_exchange_weak(was, now._64));
+    return Uuid::Time(now, origin);
+}
+
+template <typename Store>
+Status Replica<Store>::GC(const VV& stable) {
+    for (auto& p : *stores()) {
+        if (p.first.value() != NEVER) {
+            continue;  // the 0-store, snapshots
+        }
+        IFOK(GCBranch(p.first.origin(), stable));
+    }
+    return Status::OK;
+}
+
+template <typename Store>
+Status Replica<Store>::GCBranch(Word yarn_id, const VV& stable) {
+    Key from{};
+    do {
+        IFOK(GCBatch(yarn_id, stable, from));
+    } while (from != Key::END);
+    return Status::OK;
+}
+
+template <typename Store>
+Status Replica<Store>::GCBatch(Word yarn_id, const VV& stable, Key& from) {
+    if (!HasBranch(yarn_id)) {
+        return Status::NOT_FOUND.comment("no such branch: " + yarn_id.str());
+    }
+    if (read_only_) {
+        return read_only_error();
+    }
+    Commit gc{*this, yarn2branch(yarn_id)};
+    IFOK(gc.Lock(true));
+    Store& branch = gc.main_;
+    if (branch.layered()) {  // flat first, then the states can be Put
+        Status flat = branch.Flatten(REPLICA_GC_BATCH);
+        if (flat != Status::ENDOFINPUT) {
+            return flat;  // the rest in the next batch
+        }
+        gc.BeginSave();  // DropBases() swaps the layers under the readers
+        flat = branch.DropBases();
+        gc.EndSave();
+        IFOK(flat);
+    }
+    RGArrayRDT<Frame> rga;
+    StoreIterator i{branch, Range::Form(RGA_RDT_FORM)};
+    IFOK(i.SeekTo(from));
+    size_t collected = 0;
+    while (i.key() != Key::END) {  // no RGA objects: invalid already
+        if (REPLICA_GC_BATCH && collected == REPLICA_GC_BATCH) {
+            break;  // the rest in the next batch, the writers first
+        }
+        Key key = i.key();
+        if (key.form() == RGA_RDT_FORM) {
+            Frame state{i.value().data()};
+            Builder b;
+            IFOK(rga.GC(b, state, stable));
+            Frame gced = b.Release();
+            if (gced.data() != state.data()) {
+                Status put = branch.Put(key, gced);
+                IFOK(put);
+            }
+            ++collected;
+        }
+        Status ok = i.Next();
+        if (!ok && ok != Status::ENDOFINPUT) return ok;
+    }
+    from = i.key();
+    return Status::OK;
 }
 
 template <typename Store>
-Status Replica<Store>::GC() {
+Status Replica<Store>::StartGC(const VV& stable) {
+    if (read_only_) {
+        return read_only_error();
+    }
+    std::lock_guard<std::mutex> lock{gc_mutex_};
+    gc_stable_ = stable;
+    if (!gc_thread_.joinable()) {
+        gc_stop_ = false;
+        gc_thread_ = std::thread{&Replica::RunGC, this};
+    }
     return Status::OK;
 }
 
+template <typename Store>
+void Replica<Store>::StopGC() {
+    {
+        std::lock_guard<std::mutex> lock{gc_mutex_};
+        if (!gc_thread_.joinable()) {
+            return;
+        }
+        gc_stop_ = true;
+    }
+    gc_wake_.notify_all();
+    gc_thread_.join();
+}
+
+template <typename Store>
+void Replica<Store>::RunGC() {
+    std::unique_lock<std::mutex> lock{gc_mutex_};
+    while (!gc_wake_.wait_for(lock, std::chrono::milliseconds(REPLICA_GC_MS),
+                              [this] { return gc_stop_.load(); })) {
+        VV stable = gc_stable_;
+        lock.unlock();
+        for (auto& p : *stores()) {
+            if (p.first.value() != NEVER) {
+                continue;  // the 0-store, snapshots
+            }
+            for (Key from{}; !gc_stop_;) {
+                Status ok = GCBatch(p.first.origin(), stable, from);
+                if (!ok || from == Key::END) {
+                    break;  // a failed branch gets another try next pass
+                }
+            }
+        }
+        lock.lock();
+    }
+}
+
 template <typename Store>
 Status Replica<Store>::Close() {
-    if (!stores_.empty()) {
+    StopGC();  // it takes the admin lock
+    std::lock_guard<std::recursive_mutex> lock{admin_mutex_};
+    if (open()) {
         GetMetaStore().Close();
-        stores_.clear();
+        DropTips(nullptr);
+        DropStates(nullptr);
+        std::atomic_store(&stores_,
+                          std::shared_ptr<const StoreMap>{
+                              std::make_shared<StoreMap>()});
+        untipped_.clear();
+        all_tipped_ = true;
     }
     return Status::OK;
 }
@@ -201,18 +514,195 @@ Replica<Store>::~Replica() {
 
 //  O B J E C T  L O G S
 
+template <typename Store>
+bool Replica<Store>::FindTip(const Store& store, Word yarn, OpMeta& meta) {
+    std::lock_guard<std::mutex> lock{cache_mutex_};
+    auto i = tip_index_.find(tipkey_t{&store, yarn});
+    if (i == tip_index_.end()) {
+        return false;
+    }
+    tips_.splice(tips_.begin(), tips_, i->second);
+    meta = i->second->second;
+    return true;
+}
+
+template <typename Store>
+void Replica<Store>::SaveTip(const Store& store, const OpMeta& meta) {
+    std::lock_guard<std::mutex> lock{cache_mutex_};
+    tipkey_t key{&store, meta.id.origin()};
+    auto i = tip_index_.find(key);
+    if (i != tip_index_.end()) {
+        i->second->second = meta;
+        tips_.splice(tips_.begin(), tips_, i->second);
+        return;
+    }
+    if (!REPLICA_TIP_CACHE_SIZE) {
+        return;
+    }
+    while (tips_.size() >= REPLICA_TIP_CACHE_SIZE) {
+        tip_index_.erase(tips_.back().first);
+        tips_.pop_back();
+    }
+    tips_.emplace_front(key, meta);
+    tip_index_[key] = tips_.begin();
+}
+
+template <typename Store>
+void Replica<Store>::DropTips(const Store* store) {
+    std::lock_guard<std::mutex> lock{cache_mutex_};
+    for (auto i = tips_.begin(); i != tips_.end();) {
+        if (store && i->first.first != store) {
+            ++i;
+            continue;
+        }
+        tip_index_.erase(i->first);
+        i = tips_.erase(i);
+    }
+}
+
+template <typename Store>
+bool Replica<Store>::FindState(const Store& store, Uuid id, Frame& state) {
+    std::lock_guard<std::mutex> lock{cache_mutex_};
+    auto i = state_index_.find(statekey_t{&store, id});
+    if (i == state_index_.end()) {
+        return false;
+    }
+    states_.splice(states_.begin(), states_, i->second);
+    state = i->second->second;
+    return true;
+}
+
+template <typename Store>
+void Replica<Store>::SaveState(const Store& store, Uuid id,
+                               const Frame& state) {
+    std::lock_guard<std::mutex> lock{cache_mutex_};
+    statekey_t key{&store, id};
+    auto i = state_index_.find(key);
+    if (i != state_index_.end()) {
+        i->second->second = state;
+        states_.splice(states_.begin(), states_, i->second);
+        return;
+    }
+    if (!REPLICA_STATE_CACHE_SIZE) {
+        return;
+    }
+    while (states_.size() >= REPLICA_STATE_CACHE_SIZE) {
+        state_index_.erase(states_.back().first);
+        states_.pop_back();
+    }
+    states_.emplace_front(key, state);
+    state_index_[key] = states_.begin();
+}
+
+template <typename Store>
+void Replica<Store>::DropState(const Store& store, Uuid id) {
+    std::lock_guard<std::mutex> lock{cache_mutex_};
+    auto i = state_index_.find(statekey_t{&store, id});
+    if (i != state_index_.end()) {
+        states_.erase(i->second);
+        state_index_.erase(i);
+    }
+}
+
+template <typename Store>
+void Replica<Store>::DropStates(const Store* store) {
+    std::lock_guard<std::mutex> lock{cache_mutex_};
+    for (auto i = states_.begin(); i != states_.end();) {
+        if (store && i->first.first != store) {
+            ++i;
+            continue;
+        }
+        state_index_.erase(i->first);
+        i = states_.erase(i);
+    }
+}
+
+template <typename Store>
+Status Replica<Store>::Commit::FindState(Frame& state, Uuid id) {
+    auto mine = states_.find(id);
+    if (mine != states_.end()) {
+        state = mine->second;
+        return Status::OK;
+    }
+    if (host_.FindState(main_, id, state)) {
+        return Status::OK;
+    }
+    Frame log;
+    IFOK(FindObjectLog(log, id));
+    Builder built;
+    IFOK(ObjectLogIntoState(built, log));
+    state = built.Release();
+    states_[id] = state;
+    return Status::OK;
+}
+
+template <typename Store>
+Status Replica<Store>::Commit::UpdateState(Uuid id, Uuid rdt,
+                                           const Frame& chainlet) {
+    Frame state;
+    auto mine = states_.find(id);
+    if (mine != states_.end()) {
+        state = mine->second;
+    } else if (!host_.FindState(main_, id, state)) {
+        stale_.insert(id);
+        return Status::OK;
+    }
+    Cursors inputs{Cursor{state}, Cursor{chainlet}};
+    Frame merged;
+    IFOK(MergeCursors(merged, uuid2form(rdt), inputs));
+    states_[id] = merged;
+    return Status::OK;
+}
+
+template <typename Store>
+bool Replica<Store>::Commit::FindTipMeta(OpMeta& meta, Uuid op_id) {
+    Word yarn = op_id.origin();
+    auto mine = tips_.find(yarn);
+    if (mine != tips_.end()) {
+        meta = mine->second;
+    } else if (!host_.FindTip(main_, yarn, meta)) {
+        return false;
+    }
+    // NEVER picks the yarn tip, see FindOpMeta
+    return meta.id == op_id || op_id.value() == NEVER;
+}
+
 template <typename Store>
 Status Replica<Store>::Commit::FindOpMeta(OpMeta& meta, Uuid op_id) {
-    // find head rec
+    if (FindTipMeta(meta, op_id)) {
+        return Status::OK;
+    }
+    // find the span head rec: the nearest indexed op
     IFOK(FindChainHeadMeta(meta, op_id));
     if (meta.id == op_id) {
         return Status::OK;
     }
-    // load object log
-    Frame object_log;
-    IFOK(FindObjectLog(object_log, meta.object));
+    // the span's log segment, or the object log from the chain on if
+    // the span goes on in later segments (or there is no span record)
+    Uuid since = meta.chain_id();
+    Frame span;
+    IFOK(join_.Read(Key{meta.id, SPAN_FORM_UUID}, span));
+    Cursor rec{span};
+    if (rec.valid() && op_id.value() != NEVER) {  // the tip: the last one
+        Pinned segment;
+        IFOK(join_.Read(Key{rec.ref(), LOG_FORM_UUID}, segment));
+        OpMeta head = meta;
+        Status ok = FindOpInLog(meta, op_id, segment.cursor());
+        if (ok != Status::NOT_FOUND) {
+            return ok;
+        }
+        meta = head;
+        since = rec.ref();
+    }
+    Pinned ops;
+    IFOK(FindObjectLog(ops, meta.object, since));
+    return FindOpInLog(meta, op_id, ops.cursor());
+}
+
+template <typename Store>
+Status Replica<Store>::Commit::FindOpInLog(OpMeta& meta, Uuid op_id,
+                                           Cursor cur) {
     // seek to the head
-    Cursor cur{object_log};
     while (cur.valid() && cur.id() != meta.id) {
         cur.Next();
     }
@@ -244,11 +734,14 @@ Status Replica<Store>::Commit::FindOpMeta(OpMeta& meta, Uuid op_id) {
 
 template <typename Store>
 Status Replica<Store>::Commit::FindChainHeadMeta(OpMeta& meta, Uuid op_id) {
-    Iterator i{join_};
+    Iterator i{join_, true};
     Status ok = i.SeekTo(Key{op_id, META_FORM_UUID}, true);
     if (!ok) {
         return ok;
     }
+    if (i.key() == Key::END) {  // the prefix filters say there is none
+        return Status::NOT_FOUND.comment("no such yarn?");
+    }
     Cursor metac{i.value()};
     if (!metac.valid()) {
         return Status::BAD_STATE.comment("unparseable meta record?!");
@@ -268,8 +761,93 @@ Status Replica<Store>::Commit::FindYarnTipMeta(OpMeta& meta, Word yarn) {
 }
 
 template <typename Store>
-Status Replica<Store>::Commit::FindObjectLog(Frame& frame, Uuid id) {
-    return join_.Read(Key{id, LOG_RAW_FORM}, frame);
+Status Replica<Store>::Commit::FindLogSegments(Uuids& heads, Uuid id,
+                                               Uuid since) {
+    heads.clear();
+    Frame link;
+    IFOK(join_.Read(Key{id, TAIL_FORM_UUID}, link));
+    // no manifest: one segment (or a log saved before segments)
+    Uuid head = link.empty() ? id : Cursor{link}.id();
+    while (true) {
+        heads.push_back(head);
+        if (head == id || head <= since) {
+            break;
+        }
+        IFOK(join_.Read(Key{head, TAIL_FORM_UUID}, link));
+        if (link.empty()) {
+            return Status::BAD_STATE.comment("no log segment before " +
+                                             head.str());
+        }
+        head = Cursor{link}.ref();
+    }
+    std::reverse(heads.begin(), heads.end());
+    return Status::OK;
+}
+
+template <typename Store>
+Status Replica<Store>::Commit::FindObjectLog(Frame& frame, Uuid id,
+                                             Uuid since, Uuid till) {
+    Uuids heads;
+    IFOK(FindLogSegments(heads, id, since));
+    if (heads.size() == 1) {
+        return join_.Read(Key{heads.front(), LOG_FORM_UUID}, frame);
+    }
+    Builder log;
+    Frame segment;
+    for (auto& head : heads) {
+        if (head > till) {  // its chains are all newer
+            break;
+        }
+        IFOK(join_.Read(Key{head, LOG_FORM_UUID}, segment));
+        Cursor c{segment};
+        log.AppendAll(c);
+    }
+    frame = log.Release();
+    return Status::OK;
+}
+
+template <typename Store>
+Status Replica<Store>::Commit::FindObjectLog(Pinned& log, Uuid id,
+                                             Uuid since) {
+    Uuids heads;
+    IFOK(FindLogSegments(heads, id, since));
+    if (heads.size() == 1) {
+        return join_.Read(Key{heads.front(), LOG_FORM_UUID}, log);
+    }
+    Frame frame;
+    IFOK(FindObjectLog(frame, id, since));
+    log.Own(frame);
+    return Status::OK;
+}
+
+template <typename Store>
+Status Replica<Store>::Commit::AppendObjectLog(Uuid id, Uuid head,
+                                               const Frame& chainlet,
+                                               Uuid& at) {
+    Frame manifest;
+    IFOK(join_.Read(Key{id, TAIL_FORM_UUID}, manifest));
+    Uuid last = manifest.empty() ? id : Cursor{manifest}.id();
+    if (head < last) {  // a late chain, goes between the older ones
+        Uuids heads;
+        IFOK(FindLogSegments(heads, id, head));
+        at = heads.front();
+        return join_.Write(Key{at, LOG_FORM_UUID}, chainlet);
+    }
+    if (REPLICA_LOG_SEGMENT_BYTES && head != last) {
+        Pinned segment;
+        IFOK(join_.Read(Key{last, LOG_FORM_UUID}, segment));
+        if (segment.data().size() >= REPLICA_LOG_SEGMENT_BYTES) {
+            // link the new segment, then make it the last one
+            Builder prev, next;
+            prev.AppendNewOp(head, last);
+            IFOK(join_.Write(Key{head, TAIL_FORM_UUID}, prev.Release()));
+            next.AppendNewOp(head, id);
+            IFOK(join_.Write(Key{id, TAIL_FORM_UUID}, next.Release()));
+            last = head;
+        }
+    }
+    at = last;
+    return join_.Write(Key{last, LOG_FORM_UUID}, chainlet);
 }
 
 //  E V E N T  Q U E R I E S
@@ -281,21 +859,21 @@ Status Replica<Store>::See(Uuid timestamp) {
     if (timestamp.version() != TIME) {
         return Status::BADARGS.comment("not an event: " + timestamp.str());
     }
-    if (timestamp.value() < now_) {
-        return Status::OK;
-    }
     if (timestamp.value() >= NEVER) {
         return Status::BADARGS.comment("an event timestamped NEVER: " +
                                        timestamp.str());
     }
-
-    now_ = timestamp.value();  // TODO(gritzko) concurrent access
+    uint64_t was = now_.load();
+    while (Word{was} < timestamp.value() &&
+           !now_.compare_exchange_weak(was, timestamp.value()._64)) {
+    }
     return Status::OK;
 }
 
 template <typename Store>
-Status Replica<Store>::Commit::SaveChainlet(Builder& to, OpMeta& meta,
+Status Replica<Store>::Commit::SaveChainlet(Chainlet& into, OpMeta& meta,
                                             Cursor& from) {
+    Builder to;
     to.AppendOp(from);
     Status ok;
     while ((ok = from.Next())) {
@@ -304,10 +882,18 @@ Status Replica<Store>::Commit::SaveChainlet(Builder& to, OpMeta& meta,
         } else if (meta.is_next(from)) {
             IFOK(CheckEventSanity(from));
             meta.Next(from, meta);
+            if (REPLICA_SPAN_OPS && meta.span_ops > REPLICA_SPAN_OPS) {
+                meta.Index();
+                Builder index;
+                meta.Save(index);
+                into.index.emplace_back(Key{meta.id, META_FORM_UUID},
+                                        index.Release());
+            }
             to.AppendOp(from);
             if (from.id().origin() == base_.origin()) {
                 if (from.id() <= tip_) {
-                    return Status::OK.comment("non-monotonous frame");
+                    ok = Status::OK.comment("non-monotonous frame");
+                    break;
                 }
                 tip_ = from.id();
             } else {
@@ -325,6 +911,9 @@ Status Replica<Store>::Commit::SaveChainlet(Builder& to, OpMeta& meta,
     if (ok == Status::ENDOFFRAME) {
         ok = Status::OK;
     }
+    if (ok) {
+        into.ops = to.Release();
+    }
     return ok;
 }
 
@@ -350,15 +939,13 @@ Status Replica<Store>::Commit::CheckEventSanity(const Cursor& chain) {
     return Status::OK;
 }
 
-/** The key lifecycle method: accepts a new chain of ops, checks it
- * against existing ops, checks integrity/consistency/causality,
- * saves the chain, updates object state.
- * @param batch a WriteBatch for all the db writes
- * @param branch
- * @param chain a cursor positioned on the head of the chain;
- *              will be moved to the first non-chain op (or EOF) */
+/** Checks a new chain of ops against the existing ops: integrity,
+ * consistency, causality; hashes it. Touches no commit state but for
+ * the commit's own yarn, so Ingest() hashes other yarns in parallel. */
 template <typename Store>
-Status Replica<Store>::Commit::SaveChain(Builder&, Cursor& chain) {
+template <class Lookup>
+Status Replica<Store>::Commit::HashChain(Chainlet& into, Cursor& chain,
+                                         Lookup& lookup) {
     Status ok;
     Uuid id = chain.id();
     Uuid ref_id = chain.ref();
@@ -369,7 +956,7 @@ Status Replica<Store>::Commit::SaveChain(Builder&, Cursor& chain) {
     // find the last op on the yarn (the tip) and its metadata
     OpMeta tip_meta;
     Uuid& tip_id = tip_meta.id;
-    ok = FindYarnTipMeta(tip_meta, id.origin());
+    ok = lookup.FindYarnTipMeta(tip_meta, id.origin());
     if (chain.ref() == YARN_FORM_UUID) {
         // actually, it is the first op on the yarn
         if (ok == Status::NOT_FOUND) {
@@ -409,28 +996,332 @@ Status Replica<Store>::Commit::SaveChain(Builder&, Cursor& chain) {
         // we enforce referential integrity but we
         // can't run datatype-specific checks here
         OpMeta ref_meta;
-        IFOK(FindOpMeta(ref_meta, ref_id));
+        IFOK(lookup.FindOpMeta(ref_meta, ref_id));
         tip_meta.Next(chain, ref_meta);
     }
 
-    if (ref_id != tip_id) {
+    if (ref_id != tip_id) {  // a new span, indexed by the record
         Builder chain_record;
+        tip_meta.Index();
         tip_meta.Save(chain_record);
-        IFOK(join_.Write(Key{id, META_FORM_UUID}, chain_record.Release()));
+        into.index.emplace_back(Key{id, META_FORM_UUID},
+                                chain_record.Release());
     }
+    into.id = id;
+    into.head = tip_meta;
 
     // walk/check the chainlet
-    Uuid& obj_id = tip_meta.object;
-    Builder chainlet;
-    IFOK(SaveChainlet(chainlet, tip_meta, chain));
-    IFOK(host_.See(tip_meta.id));  // implausible timestamps etc
-    Frame data = chainlet.Release();
-    IFOK(join_.Write(Key{obj_id, LOG_FORM_UUID}, data));
-    IFOK(join_.Write(Key{obj_id, tip_meta.rdt}, data));
+    IFOK(SaveChainlet(into, tip_meta, chain));
+    into.meta = tip_meta;
+    return Status::OK;
+}
 
-    tip_ = tip_meta.id;
+template <typename Store>
+Status Replica<Store>::Commit::ApplyChain(Chainlet& chain) {
+    for (auto& rec : chain.index) {
+        IFOK(join_.Write(rec.first, rec.second));
+    }
+    const OpMeta& meta = chain.meta;
+    IFOK(host_.See(meta.id));  // implausible timestamps etc
+    Uuid segment;
+    IFOK(AppendObjectLog(meta.object, chain.id, chain.ops, segment));
+    // the spans' segment, see FindOpMeta
+    for (auto& rec : chain.index) {
+        Frame span = OneOp<Frame>(rec.first.id(), segment);
+        IFOK(join_.Write(Key{rec.first.id(), SPAN_FORM_UUID}, span));
+    }
+    if (host_.mode_ & KEEP_STATES) {
+        IFOK(join_.Write(Key{meta.object, meta.rdt}, chain.ops));
+    } else {
+        IFOK(UpdateState(meta.object, meta.rdt, chain.ops));
+    }
+
+    tip_ = meta.id;
+    tips_[meta.id.origin()] = meta;
+
+    return meta.id;
+}
 
-    return tip_meta.id;
+/** The key lifecycle method: accepts a new chain of ops, checks it
+ * against existing ops, checks integrity/consistency/causality,
+ * saves the chain, updates object state.
+ * @param chain a cursor positioned on the head of the chain;
+ *              will be moved to the first non-chain op (or EOF) */
+template <typename Store>
+Status Replica<Store>::Commit::SaveChain(Builder&, Cursor& chain) {
+    Chainlet hashed;
+    IFOK(HashChain(hashed, chain, *this));
+    return ApplyChain(hashed);
+}
+
+//  I N G E S T
+
+template <typename Store>
+struct Replica<Store>::Commit::Pipeline {
+    struct Slot {
+        /** the head op id */
+        Uuid head;
+        /** the ops as cut, till hashed */
+        Frame cut;
+        Chainlet chain;
+        Status ok;
+        bool done;
+    };
+    struct Yarn {
+        size_t lane;
+        /** the yarn's chains, in the frame's order */
+        std::vector<size_t> chains;
+    };
+
+    std::mutex mutex;
+    /** a chain is cut, hashed or saved; or the pipeline stops */
+    std::condition_variable moved;
+    /** all the chains cut, kept for the metas of the ops they have */
+    std::deque<Slot> slots;
+    std::unordered_map<Word, Yarn> yarns;
+    /** the chains each lane is to hash, in the frame's order */
+    std::vector<std::deque<size_t>> lanes;
+    size_t saved;
+    /** no more chains to cut */
+    bool closed;
+    /** a chain failed: no more chains to cut, hash or save */
+    bool stopped;
+    /** the first failure, in the frame's order, or the last chain saved */
+    Status ok;
+    /** guards the commit's records: the writer applies the chains, the
+     * lanes look up the ops the commit saved before the pipeline */
+    std::mutex store;
+
+    explicit Pipeline(size_t threads)
+        : slots{},
+          yarns{},
+          lanes(threads),
+          saved{0},
+          closed{false},
+          stopped{false},
+          ok{Status::OK},
+          store{} {}
+
+    /** Queues a chain, waits if REPLICA_INGEST_CHAINS are queued already.
+     * @return false if stopped */
+    bool Cut(Uuid head, Frame ops) {
+        std::unique_lock<std::mutex> lock{mutex};
+        size_t window = std::max(REPLICA_INGEST_CHAINS, size_t{1});
+        moved.wait(lock,
+                   [&] { return stopped || slots.size() - saved < window; });
+        if (stopped) {
+            return false;
+        }
+        size_t at = slots.size();
+        slots.push_back(
+            Slot{head, std::move(ops), Chainlet{}, Status::OK, false});
+        auto y = yarns.find(head.origin());
+        if (y == yarns.end()) {  // round robin
+            y = yarns.emplace(head.origin(), Yarn{yarns.size() % lanes.size(),
+                                                  std::vector<size_t>{}})
+                    .first;
+        }
+        y->second.chains.push_back(at);
+        lanes[y->second.lane].push_back(at);
+        lock.unlock();
+        moved.notify_all();
+        return true;
+    }
+
+    void Close() {
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            closed = true;
+        }
+        moved.notify_all();
+    }
+
+    /** Finds the meta of an op cut in a chain before the one `at`; waits
+     * for that chain to be hashed.
+     * @return NOT_FOUND if the frame has no such op */
+    Status FindOpMeta(OpMeta& meta, Uuid op_id, size_t at) {
+        std::unique_lock<std::mutex> lock{mutex};
+        auto y = yarns.find(op_id.origin());
+        if (y == yarns.end()) {
+            return Status::NOT_FOUND;
+        }
+        auto& chains = y->second.chains;
+        auto i = std::lower_bound(chains.begin(), chains.end(), at);
+        while (i != chains.begin() && op_id < slots[*(i - 1)].head) {
+            --i;
+        }
+        if (i == chains.begin()) {
+            return Status::NOT_FOUND;
+        }
+        Slot& slot = slots[*(i - 1)];
+        moved.wait(lock, [&] { return stopped || slot.done; });
+        if (!slot.done) {
+            return Status::BAD_STATE.comment("ingest stopped");
+        }
+        if (!slot.ok) {
+            return slot.ok;
+        }
+        lock.unlock();  // a hashed chain does not change
+        meta = slot.chain.head;
+        Cursor cur{slot.chain.ops};
+        while (meta.id != op_id && cur.Next()) {
+            meta.Next(cur, meta);
+        }
+        return meta.id == op_id ? Status::OK : Status::NOT_FOUND;
+    }
+};
+
+template <typename Store>
+struct Replica<Store>::Commit::Lane {
+    Pipeline& pipe;
+    /** the ingesting commit: has the ops saved before the pipeline */
+    Commit& commit;
+    /** reads the store as saved, no locks: an op's meta never changes */
+    Commit saved;
+    /** the commit's yarn tips as of Ingest(), then the tips of the yarns
+     * this lane hashes */
+    tipmap_t tips;
+    /** the chain being hashed */
+    size_t at;
+
+    Lane(Pipeline& pipeline, Commit& ingesting, const tipmap_t& snapshot)
+        : pipe{pipeline},
+          commit{ingesting},
+          saved{ingesting.host_, ingesting.main_},
+          tips{snapshot},
+          at{0} {}
+
+    /** A yarn's chains are all hashed by one lane, so the lane's tip is
+     * the latest one; a yarn the commit has not seen is as saved. */
+    Status FindYarnTipMeta(OpMeta& meta, Word yarn) {
+        auto i = tips.find(yarn);
+        if (i == tips.end()) {
+            return saved.FindYarnTipMeta(meta, yarn);
+        }
+        meta = i->second;
+        return Status::OK;
+    }
+
+    Status FindOpMeta(OpMeta& meta, Uuid op_id) {
+        Status ok = pipe.FindOpMeta(meta, op_id, at);
+        if (ok == Status::NOT_FOUND) {
+            ok = saved.FindOpMeta(meta, op_id);
+        }
+        if (ok != Status::NOT_FOUND) {
+            return ok;
+        }
+        // saved by this commit, e.g. before a query cut the run short
+        std::lock_guard<std::mutex> lock{pipe.store};
+        return commit.FindOpMeta(meta, op_id);
+    }
+};
+
+template <typename Store>
+Status Replica<Store>::Commit::Ingest(Builder& resp, Cursor& c) {
+    // the commit's own yarn moves tip_, see SaveChainlet
+    auto starts_chain = [this](const Cursor& op) {
+        return op.id().version() == TIME && op.term() != QUERY &&
+               op.id().origin().payload() != 0 &&
+               op.id().origin() != yarn_id();
+    };
+    if (!starts_chain(c) || !REPLICA_INGEST_THREADS) {
+        return SaveChain(resp, c);
+    }
+    Pipeline pipe{REPLICA_INGEST_THREADS};
+    const tipmap_t tips{tips_};  // the writer moves tips_ from now on
+
+    std::vector<std::thread> hashers;
+    for (size_t l = 0; l < REPLICA_INGEST_THREADS; ++l) {
+        hashers.emplace_back([this, &pipe, &tips, l] {
+            Lane lane{pipe, *this, tips};
+            auto& queue = pipe.lanes[l];
+            std::unique_lock<std::mutex> lock{pipe.mutex};
+            while (true) {
+                pipe.moved.wait(lock, [&] {
+                    return pipe.stopped || pipe.closed || !queue.empty();
+                });
+                if (pipe.stopped || queue.empty()) {
+                    break;
+                }
+                lane.at = queue.front();
+                queue.pop_front();
+                auto& slot = pipe.slots[lane.at];
+                lock.unlock();
+
+                Cursor cut{slot.cut};
+                Status ok = HashChain(slot.chain, cut, lane);
+                if (ok) {
+                    lane.tips[slot.chain.meta.id.origin()] = slot.chain.meta;
+                }
+
+                lock.lock();
+                slot.cut = Frame{};
+                slot.ok = ok;
+                slot.done = true;
+                pipe.moved.notify_all();
+            }
+        });
+    }
+
+    std::thread writer{[this, &pipe] {
+        std::unique_lock<std::mutex> lock{pipe.mutex};
+        for (size_t at = 0;; ++at) {
+            pipe.moved.wait(lock, [&] {
+                return pipe.stopped ||
+                       (at < pipe.slots.size() ? pipe.slots[at].done
+                                               : pipe.closed);
+            });
+            if (pipe.stopped || at == pipe.slots.size()) {
+                break;
+            }
+            auto& slot = pipe.slots[at];
+            lock.unlock();
+            Status ok = slot.ok;
+            if (ok) {
+                std::lock_guard<std::mutex> applying{pipe.store};
+                ok = ApplyChain(slot.chain);
+            }
+            slot.chain.index.clear();
+            lock.lock();
+            pipe.saved = at + 1;
+            pipe.ok = ok;
+            pipe.stopped = !ok;
+            pipe.moved.notify_all();
+        }
+    }};
+
+    // cut the chains as SaveChainlet walks them
+    Status ok;
+    while (c.valid() && starts_chain(c)) {
+        Builder chain;
+        chain.AppendOp(c);
+        Uuid head = c.id();
+        OpMeta last;
+        last.id = head;
+        while ((ok = c.Next())) {
+            if (c.id() == Uuid::COMMENT) {
+                continue;
+            } else if (last.is_next(c)) {
+                last.id = c.id();
+            } else if (!last.is_check(c)) {
+                break;
+            }
+            chain.AppendOp(c);
+        }
+        if (ok == Status::ENDOFFRAME) {
+            ok = Status::OK;
+        }
+        if (!ok || !pipe.Cut(head, chain.Release())) {
+            break;
+        }
+    }
+    pipe.Close();
+
+    writer.join();
+    for (auto& t : hashers) {
+        t.join();
+    }
+    return pipe.ok ? ok : pipe.ok;
 }
 
 template <typename Store>
@@ -439,6 +1330,9 @@ Status Replica<Store>::Commit::GetFrame(Frame& object, Uuid id, Uuid rdt) {
     if (t == ZERO_RAW_FORM) {
         return Status::NOTYPE;
     }
+    if (!(host_.mode_ & KEEP_STATES) && id.version() == TIME) {
+        return FindState(object, id);
+    }
     Key key{id, rdt};
     return join_.Read(key, object);
 }
@@ -466,17 +1360,17 @@ template <typename Store>
 Status Replica<Store>::Commit::QueryObject(Builder& response, Cursor& query) {
     Key key{query.id(), query.ref()};
     if (host_.mode_ & KEEP_STATES) {
-        Frame f;
-        IFOK(join_.Read(key, f));
-        Cursor c{f};
+        Pinned state;
+        IFOK(join_.Read(key, state));
+        Cursor c = state.cursor();
         response.AppendAll(c);
         query.Next();
         return Status::OK;
     } else if (host_.mode_ & KEEP_OBJECT_LOGS) {
-        Key logkey{query.id(), LOG_FORM_UUID};
-        Frame log;
-        join_.Read(logkey, log);
-        Status ok = ObjectLogIntoState(response, log);
+        Frame state;
+        Status ok = FindState(state, query.id());
+        Cursor c{state};
+        response.AppendAll(c);
         query.Next();
         return ok;
     } else {
@@ -502,22 +1396,65 @@ Status Replica<Store>::Commit::QueryObjectLog(Builder& response,
     OpMeta meta;
     IFOK(FindOpMeta(meta, id));
     Key logkey{meta.object, meta.rdt};
+    bool states = (host_.mode_ & KEEP_STATES) != 0;
     if (id == meta.object) {
         Frame obj;
-        IFOK(join_.Read(logkey, obj));
+        if (states) {
+            IFOK(join_.Read(logkey, obj));
+        } else {
+            IFOK(FindState(obj, id));
+        }
         Cursor objc{obj};
         response.AppendAll(objc);
         return Status::OK;
     }
+    // no state records in LAZY_STATE_MODE: the log till the op's chain
     Frame log;
-    IFOK(join_.Read(logkey, log));
+    if (states) {
+        IFOK(join_.Read(logkey, log));
+    } else {
+        IFOK(FindObjectLog(log, meta.object, Uuid::NIL, meta.chain_id()));
+    }
     // version | since | segment
+    for (Cursor c{log}; c.valid(); c.Next()) {
+        response.AppendOp(c);
+        if (c.id() == id) {
+            return Status::OK;
+        }
+    }
+    return Status::NOT_FOUND.comment("no such op in the log");
+}
+
+template <typename Store>
+Status Replica<Store>::Commit::QueryObjectLogTail(Builder& response,
+                                                  Cursor& query) {
+    Uuid version = query.id();
+    query.Next();
+    OpMeta meta;
+    IFOK(FindOpMeta(meta, version));
+    // the segments from the one that has the op's chain
+    Frame log;
+    IFOK(FindObjectLog(log, meta.object, meta.chain_id()));
     Cursor c{log};
-    do {
+    while (c.valid() && c.id() != version) {
+        c.Next();
+    }
+    if (!c.valid()) {
+        return Status::NOT_FOUND.comment("no such op in the log");
+    }
+    while (c.Next()) {
         response.AppendOp(c);
-    } while (c.id() != id && c.Next());
-    return c.id() == id ? Status::OK
-                        : Status::NOT_FOUND.comment("no such op in the log");
+    }
+    return Status::OK;
+}
+
+/** @return whether the frame has anything but queries */
+template <class Cursor>
+bool has_writes(Cursor c) {
+    for (; c.valid(); c.Next()) {
+        if (c.term() != QUERY) return true;
+    }
+    return false;
 }
 
 template <class Cursor>
@@ -582,6 +1519,7 @@ Status Replica<Store>::Commit::ReceiveWrites(Builder& resp, Cursor& c) {
         case LWW_RDT_FORM:
         case RGA_RDT_FORM:
         case MX_RDT_FORM:
+        case PNC_RDT_FORM:
         case YARN_RAW_FORM:
             return WriteNewEvents(resp, c);
         case TXT_MAP_FORM:
@@ -604,10 +1542,13 @@ Status Replica<Store>::Commit::ReceiveQuery(Builder& response, Cursor& c) {
         case LWW_RDT_FORM:
         case RGA_RDT_FORM:
         case MX_RDT_FORM:
+        case PNC_RDT_FORM:
         case YARN_RAW_FORM:
             return QueryObject(response, c);
         case LOG_RAW_FORM:
             return QueryObjectLog(response, c);
+        case TAIL_RAW_FORM:
+            return QueryObjectLogTail(response, c);
         case TXT_MAP_FORM:
             return host_.txt_.Read(response, c, *this);
         default:
@@ -617,11 +1558,45 @@ Status Replica<Store>::Commit::ReceiveQuery(Builder& response, Cursor& c) {
     c.Next();
 }
 
+template <typename Store>
+Status Replica<Store>::Commit::Prefetch(Cursor frame) {
+    Keys keys;
+    for (; frame.valid(); frame.Next()) {
+        if (frame.term() != QUERY || frame.id().version() != TIME) {
+            continue;
+        }
+        switch (uuid2form(frame.ref())) {
+            case LWW_RDT_FORM:
+            case RGA_RDT_FORM:
+            case MX_RDT_FORM:
+            case PNC_RDT_FORM:
+            case YARN_RAW_FORM:
+                if (host_.mode_ & KEEP_STATES) {
+                    keys.push_back(Key{frame.id(), frame.ref()});
+                } else {
+                    keys.push_back(Key{frame.id(), TAIL_FORM_UUID});
+                    keys.push_back(Key{frame.id(), LOG_FORM_UUID});
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    // a single read gains nothing from batching
+    return keys.size() > 1 ? join_.Prefetch(keys) : Status::OK;
+}
+
 template <typename Store>
 Status Replica<Store>::Commit::Save() {
-    if (tip_ == base_) {
+    if (tip_ == base_) {  // queries only, the states are built off the db
+        for (auto& p : states_) host_.SaveState(main_, p.first, p.second);
+        states_.clear();
+        stale_.clear();
         return Status::OK;
     }
+    if (host_.read_only_) {
+        return read_only_error();
+    }
     if (base_ != Uuid::NIL && tip_.origin() != base_.origin()) {
         return Status::BAD_STATE.comment("tip changes origin? " + base_.str() +
                                          " -> " + tip_.str());
@@ -631,14 +1606,95 @@ Status Replica<Store>::Commit::Save() {
                                          " -> " + tip_.str());
     }
     // FIXME error handling!!!
-    Records save;
+    ArenaBatch save;
     Frame now = OneOp<Frame>(tip_, ZERO_FORM_UUID);
     IFOK(mem_.Write(Key::ZERO, now));
     mem_.Release(save);
-    // Frames are applied transactionally, all or nothing.
-    // We saw no errors => we may save the changes.
+    // We saw no errors => we may save the changes. The batch is atomic
+    // in a single db; a ShardedStore writes the tip last, so a failed
+    // save never moves the tip, but may leave some ops (see there).
     base_ = tip_ = Uuid::NIL;
-    return main_.Write(save);
+    // readers see all of it or none, the caches included
+    BeginSave();
+    Status ok = main_.Write(save);
+    if (ok) {
+        for (auto& p : tips_) host_.SaveTip(main_, p.second);
+        for (auto& p : states_) host_.SaveState(main_, p.first, p.second);
+        for (auto& id : stale_) {
+            if (!states_.count(id)) host_.DropState(main_, id);
+        }
+    }
+    EndSave();
+    tips_.clear();
+    states_.clear();
+    stale_.clear();
+    return ok;
+}
+
+template <typename Store>
+Status Replica<Store>::Commit::Lock(bool write) {
+    if (!slot_) {
+        return Status::NOT_FOUND.comment("no such store");
+    }
+    if (lock_ != UNLOCKED) {
+        return Status::BAD_STATE.comment("locked already");
+    }
+    StoreSlot& slot = *slot_;
+    std::unique_lock<std::mutex> lock{slot.mutex};
+    if (write) {
+        uint64_t ticket = slot.queued++;
+        slot.turn.wait(lock, [&] { return slot.serving == ticket; });
+        lock_ = WRITING;
+    } else {
+        slot.turn.wait(lock, [&] { return !slot.saving; });
+        ++slot.readers;
+        lock_ = READING;
+    }
+    if (slot.dropped) {
+        lock.unlock();
+        Unlock();
+        return Status::NOT_FOUND.comment("the store is dropped");
+    }
+    return Status::OK;
+}
+
+template <typename Store>
+void Replica<Store>::Commit::Unlock() {
+    if (lock_ == UNLOCKED) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock{slot_->mutex};
+        if (lock_ == WRITING) {
+            ++slot_->serving;
+        } else {
+            --slot_->readers;
+        }
+    }
+    slot_->turn.notify_all();
+    lock_ = UNLOCKED;
+}
+
+template <typename Store>
+void Replica<Store>::Commit::BeginSave() {
+    if (lock_ != WRITING) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock{slot_->mutex};
+    slot_->saving = true;
+    slot_->turn.wait(lock, [&] { return slot_->readers == 0; });
+}
+
+template <typename Store>
+void Replica<Store>::Commit::EndSave() {
+    if (lock_ != WRITING) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock{slot_->mutex};
+        slot_->saving = false;
+    }
+    slot_->turn.notify_all();
 }
 
 template <typename Store>
@@ -647,11 +1703,24 @@ Status Replica<Store>::Receive(Builder& resp, Cursor& c, Word yarn_id) {
     if (!open()) {
         return Status::NOTOPEN;
     }
+    if (read_only_ && REPLICA_CATCH_UP_MS) {
+        auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+        auto was = opened_.load();
+        // the receiver that moves opened_ reopens, the others go on
+        if (std::chrono::steady_clock::duration{now - was} >
+                std::chrono::milliseconds(REPLICA_CATCH_UP_MS) &&
+            opened_.compare_exchange_strong(was, now)) {
+            IFOK(CatchUp());
+        }
+    }
     if (!HasBranch(yarn_id)) {
         // TODO 1 such check
         return Status::NOT_FOUND.comment("unknown branch");
     }
-    Commit commit{*this, GetBranch(yarn_id)};
+    IFOK(LoadTip(yarn2branch(yarn_id)));
+    Commit commit{*this, yarn2branch(yarn_id)};
+    IFOK(commit.Lock(!read_only_ && has_writes(c)));
+    ok = commit.Prefetch(c);
 
     while (c.valid() && ok) {
 
@@ -659,14 +1728,18 @@ Status Replica<Store>::Receive(Builder& resp, Cursor& c, Word yarn_id) {
             case TIME:
                 if (c.term()==QUERY) {
                     ok = commit.ReceiveQuery(resp, c);
-                } else if (c.id().origin().payload() != 0) {
-                    ok = commit.SaveChain(resp, c);
-                } else {
+                } else if (read_only_) {
+                    ok = read_only_error();
+                } else if (c.id().origin().payload() == 0) {
                     ok = commit.ReceiveWrites(resp, c);
+                } else if (c.data().size() >= REPLICA_INGEST_BYTES) {
+                    ok = commit.Ingest(resp, c);
+                } else {
+                    ok = commit.SaveChain(resp, c);
                 }
                 break;
             case DERIVED:
-                ok = commit.ReceiveMapWrites(resp, c);
+                ok = read_only_ ? read_only_error() : commit.ReceiveMapWrites(resp, c);
                 break;
             case NAME:
                 if (c.id()==Uuid::COMMENT) {
@@ -711,5 +1784,7 @@ Status Replica<Store>::Recv (Builder& response, const FrameB& input) {
 }*/
 
 template class Replica<RocksDBStore<TextFrame>>;
+template class Replica<MmapStore<TextFrame>>;
+template class Replica<ShardedStore<TextFrame>>;
 
 }  // namespace ron
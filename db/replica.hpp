@@ -1,8 +1,17 @@
 #ifndef RON_REPLICA_HPP
 #define RON_REPLICA_HPP
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include "../rdt/lww.hpp"
 #include "../rdt/rdt.hpp"
 #include "../ron/hash.hpp"
@@ -15,6 +24,8 @@
 #include "map/csv.hpp"
 #include "map/txt.hpp"
 #include "mem_store.hpp"
+#include "mmap_store.hpp"
+#include "shard_store.hpp"
 #include "rocks_store.hpp"
 
 namespace ron {
@@ -25,24 +36,78 @@ enum replica_modes_t : uint64_t {
     KEEP_YARNS = 1UL << 2,
     KEEP_HASHES = 1UL << 3,
     CONSISTENT_MODE = KEEP_STATES | KEEP_OBJECT_LOGS | KEEP_YARNS | KEEP_HASHES,
+    /** object logs only: states are built from the logs on demand and
+     * cached, see Replica::FindState(); pick it when creating a replica,
+     * as the states are not back-filled */
+    LAZY_STATE_MODE = KEEP_OBJECT_LOGS | KEEP_YARNS | KEEP_HASHES,
 };
 
+/** How often (ms) a read-only replica reopens to catch up with the
+ * writer, see Replica::CatchUp(); 0 for never. */
+extern uint64_t REPLICA_CATCH_UP_MS;
+
+/** The max number of yarn tips cached, see Replica::FindTip(). */
+extern size_t REPLICA_TIP_CACHE_SIZE;
+
+/** The max number of object states cached in LAZY_STATE_MODE, see
+ * Replica::FindState(). */
+extern size_t REPLICA_STATE_CACHE_SIZE;
+
+/** The max number of ops in a span: a run of a chain indexed by its
+ * head's meta record, which has a span record naming the head's log
+ * segment. Bounds the scan that finds an op's meta (see
+ * Commit::FindOpMeta); 0 for no bound. */
+extern size_t REPLICA_SPAN_OPS;
+
+/** The size an object log segment grows to before the next chain starts
+ * a new one, see Commit::AppendObjectLog; 0 for a single segment. */
+extern size_t REPLICA_LOG_SEGMENT_BYTES;
+
+/** The number of threads that check and hash the chains of a big frame,
+ * see Commit::Ingest(); 0 to save every frame on the caller's thread. */
+extern size_t REPLICA_INGEST_THREADS;
+
+/** The frame size (bytes) that makes Receive() ingest in a pipeline. */
+extern size_t REPLICA_INGEST_BYTES;
+
+/** The max number of chains in the ingest pipeline: cut, not saved yet. */
+extern size_t REPLICA_INGEST_CHAINS;
+
+/** The pause (ms) between the passes of the background GC, see
+ * Replica::StartGC(). */
+extern uint64_t REPLICA_GC_MS;
+
+/** The max number of objects GCBranch() collects under one writer lock,
+ * letting the writers in between; 0 for no bound. */
+extern size_t REPLICA_GC_BATCH;
+
+/**
+ * A replica is safe to share between threads. Per store (branch), the
+ * Commits that write are queued, one at a time writes; the ones that only
+ * query run concurrently, with the writer too, and see every saved Commit
+ * in full or not at all (see Commit::Lock). Store lookups are lock-free:
+ * the store map is replaced, never changed in place. Creating, forking
+ * and dropping stores is serialized.
+ */
 template <typename Store>
 class Replica {
    public:
     using Frame = typename Store::Frame;
     using Record = std::pair<Key, Frame>;
     using Records = std::vector<Record>;
+    using Keys = std::vector<Key>;
     using Batch = typename Frame::Batch;
     using Builder = typename Frame::Builder;
     using Cursor = typename Frame::Cursor;
     using Cursors = std::vector<Cursor>;
 
     using tipmap_t = std::unordered_map<Word, OpMeta>;
+    using statemap_t = std::unordered_map<Uuid, Frame>;
 
     using MemStore = InMemoryStore<Frame>;
     using CommitStore = JoinedStore<Store, MemStore>;
     using StoreIterator = typename Store::Iterator;
+    using Pinned = typename Store::Pinned;
 
     using Names = std::unordered_map<Uuid, Uuid>;
 
@@ -50,16 +115,56 @@ class Replica {
     class Commit;
 
    private:
-    /** the largest feasible timestamp seen */
-    Word now_;
+    /** the largest feasible timestamp seen, see Now() and See() */
+    std::atomic<uint64_t> now_{0};
 
-    /** the default (active) branch/snapshot */
+    /** the default (active) branch/snapshot, see active_store() */
     Uuid active_;
+    mutable std::mutex active_mutex_;
+
+    /** Serializes the changes of the store map and tips loading. Taken
+     * before a store's Commit::Lock(), never after: a Commit that holds
+     * a store does not change the map. */
+    mutable std::recursive_mutex admin_mutex_;
+
+    /** guards the tip and state caches */
+    std::mutex cache_mutex_;
 
     replica_modes_t mode_{CONSISTENT_MODE};
 
-    // chain cache - skip db reads for ongoing op chains
-    tipmap_t tips_;
+    /** A store's yarn: the tip cache key */
+    using tipkey_t = std::pair<const Store *, Word>;
+    struct tipkey_hash {
+        size_t operator()(const tipkey_t &key) const {
+            return std::hash<const Store *>{}(key.first) ^
+                   std::hash<Word>{}(key.second);
+        }
+    };
+    using tiplru_t = std::list<std::pair<tipkey_t, OpMeta>>;
+
+    /** chain cache - skip db reads for ongoing op chains: the saved yarn
+     * tips' meta, most recently used first, at most REPLICA_TIP_CACHE_SIZE */
+    tiplru_t tips_;
+    std::unordered_map<tipkey_t, typename tiplru_t::iterator, tipkey_hash>
+        tip_index_;
+
+    /** A store's object: the state cache key */
+    using statekey_t = std::pair<const Store *, Uuid>;
+    struct statekey_hash {
+        size_t operator()(const statekey_t &key) const {
+            return std::hash<const Store *>{}(key.first) ^
+                   std::hash<Uuid>{}(key.second);
+        }
+    };
+    using statelru_t = std::list<std::pair<statekey_t, Frame>>;
+
+    /** state cache - LAZY_STATE_MODE keeps no states on disk: the merged
+     * states of the hot objects, most recently used first, at most
+     * REPLICA_STATE_CACHE_SIZE */
+    statelru_t states_;
+    std::unordered_map<statekey_t, typename statelru_t::iterator,
+                       statekey_hash>
+        state_index_;
 
     TxtMapper<Commit> txt_;
 
@@ -70,12 +175,67 @@ class Replica {
      *  private keys etc; it is not replicated unless in cluster
      *  scenarios.
      *   */
-    std::unordered_map<Uuid, Store> stores_;
+    struct StoreSlot;
+    using StoreMap = std::unordered_map<Uuid, std::shared_ptr<StoreSlot>>;
+    std::shared_ptr<const StoreMap> stores_{std::make_shared<StoreMap>()};
+
+    /** Stores whose tips are not read yet; Open() only reads the
+     * meta store's and the active one's, the rest load on first use.
+     * Guarded by admin_mutex_. */
+    std::unordered_set<Uuid> untipped_;
+    std::atomic<bool> all_tipped_{true};
 
     Frame config_;
 
+    /** a query-only replica, see Open() */
+    std::atomic<bool> read_only_{false};
+    /** steady_clock ticks, see CatchUp() */
+    std::atomic<std::chrono::steady_clock::rep> opened_{0};
+
     const static MemStore EMPTY;
 
+    /** the background GC, see StartGC() */
+    std::thread gc_thread_;
+    std::mutex gc_mutex_;
+    std::condition_variable gc_wake_;
+    /** the cutoff of the next pass; guarded by gc_mutex_ */
+    VV gc_stable_;
+    std::atomic<bool> gc_stop_{false};
+
+    /** The background GC: a pass over the branches every REPLICA_GC_MS
+     * till StopGC(). */
+    void RunGC();
+
+    /** Collects up to REPLICA_GC_BATCH objects under the branch's writer
+     * lock.
+     * @param from the key to start at; set to the next one, Key::END
+     *        once the branch is done */
+    Status GCBatch(Word yarn_id, const VV &stable, Key &from);
+
+    /** Starts the branch's yarn, see CreateBranch() */
+    Status InitBranch(Uuid branch_id, Uuid event_id);
+
+    /** Opens all the stores, publishes the new store map. */
+    Status OpenStores(bool read_only);
+
+    /** The current store map: lock-free; a snapshot, stays valid as
+     * long as it is held. */
+    inline std::shared_ptr<const StoreMap> stores() const {
+        return std::atomic_load(&stores_);
+    }
+
+    /** Publishes a copy of the store map with the store added/removed;
+     * under admin_mutex_. */
+    void PutStore(Uuid id, const Store &store);
+    void EraseStore(Uuid id);
+
+    /** @return the store's slot or nullptr */
+    std::shared_ptr<StoreSlot> FindSlot(Uuid id) const {
+        auto map = stores();
+        auto i = map->find(id);
+        return i == map->end() ? nullptr : i->second;
+    }
+
    public:
     Replica() = default;
 
@@ -84,19 +244,77 @@ class Replica {
     /** Create an empty replica (no branches, only the 0-store). */
     static Status CreateReplica();
 
-    /** Open the replica in the current directory (all branches). */
-    Status Open();
+    /** Open the replica in the current directory (all branches). The
+     * cost does not grow with the number of branches: their tips are
+     * read lazily, see LoadTip().
+     * @param read_only a query-only replica, side by side with the
+     * process that writes: sees the data as of the last CatchUp(),
+     * refuses writes (BAD_STATE) */
+    Status Open(bool read_only = false);
+
+    /** Reopens a read-only replica to see the writer's latest data;
+     * Receive() does it every REPLICA_CATCH_UP_MS, on one thread at a
+     * time. Commits may be open meanwhile: they read the stores they
+     * pinned, the old data, till they are gone. */
+    Status CatchUp();
+
+    inline bool read_only() const { return read_only_; }
+
+    /** Reads the store's tip record, unless done already; the entry
+     * points (Receive, ForkBranch...) call it to surface bad tips. */
+    Status LoadTip(Uuid store_id);
 
     Status ListStores(Uuids &stores) {
         stores.clear();
-        for (auto &p : stores_) {
+        for (auto &p : *this->stores()) {
             stores.push_back(p.first);
         }
         return Status::OK;
     }
 
-    Status GC();
+    /** Collects causally stable garbage in all the branches (object states,
+     * see RGArrayRDT::GC), see GCBranch(); StartGC() runs it off the
+     * caller's thread.
+     * @param stable the causal stability cutoff: ops all the peers have */
+    Status GC(const VV &stable);
+
+    /** Collects a branch's garbage in batches of REPLICA_GC_BATCH objects,
+     * taking the writer lock for each batch. A forked store gets flattened
+     * first, in batches of as many keys, see RocksDBStore::Flatten. */
+    Status GCBranch(Word yarn_id, const VV &stable);
+
+    /** Starts the background GC, a pass over all the branches every
+     * REPLICA_GC_MS; if running, moves its cutoff. Close() stops it.
+     * @param stable the causal stability cutoff, as for GC() */
+    Status StartGC(const VV &stable);
+
+    /** Stops the background GC, waits for its batch in progress. */
+    void StopGC();
+
+    /** The saved tip of the store's yarn, if cached (see Commit::Save).
+     * @return false on a miss; the db has it then */
+    bool FindTip(const Store &store, Word yarn, OpMeta &meta);
+
+    /** Caches the yarn tip, evicting the least recently used one. */
+    void SaveTip(const Store &store, const OpMeta &meta);
 
+    /** Forgets the store's yarn tips, all the tips for nullptr */
+    void DropTips(const Store *store);
+
+    /** The object's state, if cached (see Commit::FindState).
+     * @return false on a miss; the object log has it then */
+    bool FindState(const Store &store, Uuid id, Frame &state);
+
+    /** Caches the object state, evicting the least recently used one. */
+    void SaveState(const Store &store, Uuid id, const Frame &state);
+
+    /** Forgets the object's cached state, e.g. a stale one */
+    void DropState(const Store &store, Uuid id);
+
+    /** Forgets the store's object states, all the states for nullptr */
+    void DropStates(const Store *store);
+
+    /** No Commits may be open. */
     Status Close();
 
     ~Replica();
@@ -106,7 +324,10 @@ class Replica {
 
     inline mode_t mode() const { return mode_; }
 
-    inline bool open() const { return !stores_.empty(); }
+    /** Sets the storage mode, e.g. LAZY_STATE_MODE; before Open() */
+    inline void set_mode(replica_modes_t mode) { mode_ = mode; }
+
+    inline bool open() const { return !stores()->empty(); }
 
     const Frame &config() const { return config_; }
 
@@ -126,7 +347,12 @@ class Replica {
      * event but exist by convention, like the `test` branch.
      */
     Status CreateBranch(Word yarn_id, bool transcendent = false);
+    /** Snapshots the branch's current state, in O(1) if the store has
+     * layers (see RocksDBStore::Fork).
+     * @param point the snapshot id: the version, the branch's yarn */
     Status CreateSnapshotOffBranch(Uuid point);
+    /** Forks a branch, in O(1) if the store has layers, copying otherwise;
+     * both branches read through the layers till GC flattens them. */
     Status ForkBranch(Word new_yarn_id, Word orig_yarn_id);
 
     Status SplitBranch(Uuid mark);
@@ -138,8 +364,7 @@ class Replica {
     }
 
     inline bool HasStore(Uuid store) const {
-        auto i = stores_.find(store);
-        return i != stores_.end();
+        return FindSlot(store) != nullptr;
     }
 
     //  H I G H  L E V E L  A C C E S S O R S
@@ -149,21 +374,36 @@ class Replica {
     }
 
     inline bool HasBranch(Word yarn) {
-        return stores_.find(yarn2branch(yarn)) != stores_.end();
+        return FindSlot(yarn2branch(yarn)) != nullptr;
     }
 
-    inline Uuid active_store() const { return active_; }
+    inline Uuid active_store() const {
+        std::lock_guard<std::mutex> lock{active_mutex_};
+        return active_;
+    }
 
     inline Store &GetMetaStore() { return GetStore(Uuid::NIL); }
 
-    inline Store &GetActiveStore() { return stores_.find(active_)->second; }
+    inline Store &GetActiveStore() { return GetStore(active_); }
 
     Status SetActiveStore(Uuid store);
 
+    /** The store's slot, its tip loaded (see LoadTip); nullptr if none */
+    std::shared_ptr<StoreSlot> FindTippedSlot(Uuid store_id) {
+        if (!all_tipped_) {
+            LoadTip(store_id);  // a bad tip stays NIL; see LoadTip()
+        }
+        return FindSlot(store_id);
+    }
+
+    /** The store stays valid till dropped; a Commit pins it. */
     inline Store &GetStore(Uuid store_id) {
-        auto i = stores_.find(store_id);
-        assert(i != stores_.end());
-        return i->second;
+        auto slot = FindSlot(store_id);
+        assert(slot);
+        if (!all_tipped_) {
+            LoadTip(store_id);  // a bad tip stays NIL; see LoadTip()
+        }
+        return slot->store;
     }
 
     inline Store &GetBranch(Word yarn_id) {
@@ -174,13 +414,33 @@ class Replica {
 
     Status FillAllStates(Store &branch);
 
+   private:
+    /** A store and its locks, see Commit::Lock(): the writers' queue
+     * (tickets) and the readers' gate, closed while a writer saves. */
+    struct StoreSlot {
+        Store store;
+        std::mutex mutex;
+        std::condition_variable turn;
+        uint64_t queued{0};
+        uint64_t serving{0};
+        size_t readers{0};
+        bool saving{false};
+        /** no more Commits, see DropStore() */
+        bool dropped{false};
+
+        explicit StoreSlot(const Store &open) : store{open} {}
+    };
+
+   public:
     /** A Commit is an ongoing transaction in a branch; in case all ops in a
-     * Frame apply correctly, the Commit is saved. Otherwise, not. Commits are
-     * stack-allocated.
-     *  TODO ensure only 1 open commit per a branch
-     *  TODO read-onlies */
+     * Frame apply correctly, the Commit is saved. Otherwise, not. The save
+     * is all or nothing on one db; on a ShardedStore, only the tip is,
+     * see ShardedStore. Commits are stack-allocated. A Commit shared
+     * between threads must Lock() the store first. */
     class Commit {
         Replica &host_;
+        /** pins the store, see Lock(); nullptr if there is none */
+        std::shared_ptr<StoreSlot> slot_;
         MemStore mem_;
         Store &main_;
         CommitStore join_;
@@ -189,21 +449,74 @@ class Replica {
         Uuid max_;  // FIXME ensure the closing op is present
         Uuid tip_;
         String comment_;
+        /** the yarn tips this commit advanced, cached once saved */
+        tipmap_t tips_;
+        /** the object states this commit built or updated (in
+         * LAZY_STATE_MODE), cached once saved */
+        statemap_t states_;
+        /** the objects this commit changed, but had no state for; their
+         * cached states (if any) go stale once saved */
+        std::unordered_set<Uuid> stale_;
+
+        /** A chain, checked and hashed, ready to save, see HashChain() */
+        struct Chainlet {
+            /** the head op id */
+            Uuid id;
+            /** the head op's meta */
+            OpMeta head;
+            /** the last op's meta */
+            OpMeta meta;
+            /** the ops, as logged */
+            Frame ops;
+            /** the chain's meta records, see FindOpMeta */
+            Records index;
+        };
+
+        /** The chains of a frame on their way from the cutter through the
+         * hashing threads to the writer, see Ingest() */
+        struct Pipeline;
+        /** A hashing thread's view of the metas, see Ingest() */
+        struct Lane;
+
+        enum lock_t { UNLOCKED, READING, WRITING } lock_;
+
+        /** Closes the store's readers' gate for the writer to save. */
+        void BeginSave();
+        void EndSave();
+
+        /** binds the Commits on a missing store: Lock() fails */
+        static Store &no_store() {
+            static Store none{};
+            return none;
+        }
 
-       public:
-        using Iterator = typename CommitStore::Iterator;
-
-        Commit(Replica &host, Store &main_store)
+        Commit(Replica &host, const std::shared_ptr<StoreSlot> &slot,
+               Store &main_store)
             : host_{host},
+              slot_{slot},
               mem_{},
               main_{main_store},
               join_{main_store, mem_},
               base_{main_store.tip},
               tip_{base_},
-              comment_{} {}
+              comment_{},
+              tips_{},
+              states_{},
+              stale_{},
+              lock_{UNLOCKED} {}
+
+        Commit(Replica &host, const std::shared_ptr<StoreSlot> &slot)
+            : Commit{host, slot, slot ? slot->store : no_store()} {}
 
+       public:
+        using Iterator = typename CommitStore::Iterator;
+
+        Commit(Replica &host, Store &main_store)
+            : Commit{host, nullptr, main_store} {}
+
+        /** One lookup: the store stays pinned even if dropped meanwhile */
         Commit(Replica &host, Uuid store_id)
-            : Commit{host, host.GetStore(store_id)} {}
+            : Commit{host, host.FindTippedSlot(store_id)} {}
 
         explicit Commit(Replica &host) : Commit{host, host.active_store()} {}
 
@@ -212,6 +525,14 @@ class Replica {
         using Frame = Replica::Frame;
         using Records = Replica::Records;
 
+        /** Waits for the store: a writer waits for the writers queued
+         * before it, a reader for a writer that saves (if any). Holds the
+         * store till the Commit is gone.
+         * @param write the commit may write; otherwise, it only queries */
+        Status Lock(bool write);
+
+        void Unlock();
+
         inline Uuid base() const { return base_; }
 
         inline Uuid tip() const { return tip_; }
@@ -233,19 +554,67 @@ class Replica {
         //  O T H E R  A C C E S S O R S
 
         /** If we don't know the exact chain id, we have to scan the table to
-         *  find the chain. Then, we scan the chain to find the op.
+         *  find the chain. Then, we scan the chain to find the op: the
+         *  log segment of the op's span (at most REPLICA_SPAN_OPS ops),
+         *  or the object log past it, for data saved before spans or a
+         *  span continued in a later segment.
          *  @param{op_id} the op id or ~+yarn_id for the yarn tip
          */
         Status FindOpMeta(OpMeta &meta, Uuid op_id);
 
+        /** The object's state in LAZY_STATE_MODE: this commit's, the
+         *  cached one (see Replica::FindState) or built off the log. */
+        Status FindState(Frame &state, Uuid id);
+
+        /** Merges a saved chainlet into the object's state, if cached;
+         *  otherwise, the log has it. */
+        Status UpdateState(Uuid id, Uuid rdt, const Frame &chainlet);
+
         /** Fetches the op metadata for the chain head op.
          * @param meta - the op meta object with op id set to the chain id */
         Status FindChainHeadMeta(OpMeta &meta, Uuid op_id);
 
-        Status FindObjectLog(Frame &frame, Uuid id);
+        /** Looks the op up in the yarn tips, this commit's, then the
+         * saved ones, see Replica::FindTip; no db reads.
+         * @return false unless the op is a cached tip */
+        bool FindTipMeta(OpMeta &meta, Uuid op_id);
+
+        /** An object log is stored in segments, each keyed by its first
+         *  chain's head: {object, log} first, then {head, log}. Chains
+         *  are in head order, so a segment holds the chains from its head
+         *  till the next one's. The object's {object, tail} record (the
+         *  manifest) names the last segment, a segment's {head, tail}
+         *  names the previous one.
+         *  @param heads the segments' heads, in log order, from the one
+         *         holding the chain `since` on (all of them by default) */
+        Status FindLogSegments(Uuids &heads, Uuid id, Uuid since = Uuid::NIL);
+
+        /** Reads the log segments that have ops from the chain `since`
+         *  till `till`, see FindLogSegments. */
+        Status FindObjectLog(Frame &frame, Uuid id, Uuid since = Uuid::NIL,
+                             Uuid till = Uuid::NEVER);
+
+        /** Zero-copy for a single-segment log, see RocksDBStore::Pinned */
+        Status FindObjectLog(Pinned &log, Uuid id, Uuid since = Uuid::NIL);
+
+        /** Merges a chainlet into its log segment: the last one, or a new
+         *  one if the last is over REPLICA_LOG_SEGMENT_BYTES, or an
+         *  earlier one for a chain that arrived late.
+         *  @param at set to the head of the segment it went to */
+        Status AppendObjectLog(Uuid id, Uuid head, const Frame &chainlet,
+                               Uuid &at);
+
+        /** Seeks the log to the span head, then walks the chain to the
+         *  op, see FindOpMeta */
+        Status FindOpInLog(OpMeta &meta, Uuid op_id, Cursor cur);
 
         Status CheckEventSanity(const Cursor &op);
 
+        /** Batch-reads the records the frame's ops will need (object
+         * states for queries) ahead of applying it.
+         * @param frame a cursor copy, not moved */
+        Status Prefetch(Cursor frame);
+
         inline Status GetObject(Frame &frame, Uuid id, Uuid rdt) {
             return GetFrame(frame, id, rdt);
         }
@@ -254,14 +623,14 @@ class Replica {
 
         inline Status GetObjectVersion (Frame &into, Uuid id, Uuid version) {
             Frame log;
-            IFOK(FindObjectLog(log, id));
+            IFOK(FindObjectLog(log, id, Uuid::NIL, version));
             Cursors chains;
             IFOK(SplitLogIntoChains(chains, log, version));
             return MergeCursors(into, chains);
         }
 
         inline Status GetObjectLog(Frame &frame, Uuid id) {
-            return GetFrame(frame, id, LOG_FORM_UUID);
+            return FindObjectLog(frame, id);
         }
 
         Status FindObject(Frame &frame, Uuid key);
@@ -333,12 +702,30 @@ class Replica {
 
         //  W R I T E S
 
-        Status SaveChainlet(Builder &to, OpMeta &meta, Cursor &from);
+        Status SaveChainlet(Chainlet &into, OpMeta &meta, Cursor &from);
+
+        /** Checks a chain against its yarn's tip and its ref, hashes the
+         *  ops, makes the index records; writes nothing.
+         *  @param lookup the metas' source: FindYarnTipMeta(), FindOpMeta()
+         *  @param chain a cursor positioned on the head of the chain;
+         *               will be moved to the first non-chain op (or EOF) */
+        template <class Lookup>
+        Status HashChain(Chainlet &into, Cursor &chain, Lookup &lookup);
+
+        /** Writes a hashed chain: the index, the object log, the state. */
+        Status ApplyChain(Chainlet &chain);
 
         // feed a causally ordered log - checks causality, updates the chain
         // cache
         Status SaveChain(Builder &, Cursor &chain);
 
+        /** Saves a run of event chains in a pipeline: this thread parses
+         *  and cuts the chains, REPLICA_INGEST_THREADS threads check and
+         *  hash them (all of a yarn in one thread), one thread writes them
+         *  in the frame's order. Stops at the first op that does not start
+         *  such a chain; the commit's own yarn goes through SaveChain(). */
+        Status Ingest(Builder &, Cursor &c);
+
         Status WriteNewEvents(Builder &, Cursor &chain);
 
         /**
@@ -372,6 +759,9 @@ class Replica {
         /** as of now, a no-op */
         Status Abort() {
             base_ = tip_ = Uuid::NIL;
+            tips_.clear();
+            states_.clear();
+            stale_.clear();
             return Status::OK;
         }
 
@@ -381,7 +771,10 @@ class Replica {
 
         Status Close() { return tip_ == Uuid::NIL ? Status::OK : Abort(); }
 
-        ~Commit() { Close(); }
+        ~Commit() {
+            Close();
+            Unlock();
+        }
     };
 
     Status Receive(Builder &response, Cursor &c, Word branch = ZERO);
@@ -1,6 +1,19 @@
 #include "rocks_store.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <unordered_set>
+#include <rocksdb/cache.h>
+#include <rocksdb/compaction_filter.h>
 #include <rocksdb/db.h>
+#include <rocksdb/filter_policy.h>
 #include <rocksdb/merge_operator.h>
+#include <rocksdb/slice_transform.h>
+#include <rocksdb/table.h>
+#include <rocksdb/transaction_log.h>
 
 namespace ron {
 
@@ -15,6 +28,22 @@ using ColumnFamilyDescriptor = rocksdb::ColumnFamilyDescriptor;
 
 String ROCKSDB_STORE_DIR{".swarmdb"};
 
+String ROCKSDB_STORE_PROFILE{"default"};
+
+size_t ROCKSDB_READ_REPAIR{32};
+
+uint64_t ROCKSDB_WAL_TTL{UINT64_MAX};
+
+uint64_t ROCKSDB_WAL_LIMIT_MB{1UL << 20U};
+
+bool ROCKSDB_SYNC{false};
+
+size_t ROCKSDB_GROUP_COMMIT_WINDOW{0};
+
+size_t ROCKSDB_GROUP_COMMIT_BYTES{1UL << 20U};
+
+bool ROCKSDB_FORM_FAMILIES{false};
+
 //  C O N V E R S I O N S
 
 static inline rocksdb::Slice slice(ron::Slice slice) {
@@ -35,10 +64,103 @@ inline static Status status(const rocksdb::Status& orig) {
     return orig.ok() ? Status::OK : Status::DB_FAIL.comment(orig.ToString());
 }
 
-inline rocksdb::WriteOptions wo() { return rocksdb::WriteOptions{}; }
+// The hot path takes raw pointers: get() is a plain load, while a
+// static_pointer_cast copies the shared_ptr (atomic refcount traffic).
+static inline rocksdb::DB* db_of(const shared_ptr<void>& db) {
+    return static_cast<rocksdb::DB*>(db.get());
+}
+
+static inline ColumnFamilyHandle* cf_of(const shared_ptr<void>& cf) {
+    return static_cast<ColumnFamilyHandle*>(cf.get());
+}
+
+static inline rocksdb::Iterator* it_of(const shared_ptr<void>& i) {
+    return static_cast<rocksdb::Iterator*>(i.get());
+}
+
+inline rocksdb::WriteOptions wo() {
+    rocksdb::WriteOptions ret{};
+    ret.sync = ROCKSDB_SYNC;
+    return ret;
+}
 
 inline rocksdb::ReadOptions ro() { return rocksdb::ReadOptions{}; }
 
+/** Iterators default to total order: scans cross yarn prefixes. */
+inline rocksdb::ReadOptions iro(bool same_prefix) {
+    rocksdb::ReadOptions ret{};
+    ret.total_order_seek = !same_prefix;
+    ret.prefix_same_as_start = same_prefix;
+    return ret;
+}
+
+/** A range scan's bounds; its iterators' ReadOptions point in here. */
+struct ScanBounds {
+    Range range;
+    uint64pair from, till;
+    rocksdb::Slice lower, upper;
+
+    explicit ScanBounds(const Range& r)
+        : range{r},
+          from{r.from.be()},
+          till{r.till.be()},
+          lower{key2slice(from)},
+          upper{key2slice(till)} {}
+
+    ScanBounds(const ScanBounds&) = delete;
+
+    rocksdb::ReadOptions options() const {
+        rocksdb::ReadOptions ret = iro(false);
+        ret.iterate_lower_bound = &lower;
+        if (range.till != Key::END) {
+            ret.iterate_upper_bound = &upper;
+        }
+        ret.readahead_size = range.readahead;
+        ret.fill_cache = range.fill_cache;
+        return ret;
+    }
+};
+
+static inline const ScanBounds& bounds_of(const shared_ptr<void>& bounds) {
+    return *static_cast<const ScanBounds*>(bounds.get());
+}
+
+//  R E A D  R E P A I R
+
+/** Operands merged by the last full merge on this thread; Get() runs the
+ * merge operator on the calling thread. */
+static thread_local size_t merge_operands{0};
+
+constexpr size_t MERGE_HISTOGRAM_SIZE = 17;
+
+static std::atomic<uint64_t> MERGE_HISTOGRAM[MERGE_HISTOGRAM_SIZE];
+
+static void count_merge(size_t operands) {
+    size_t bucket = 0;
+    while (operands && bucket + 1 < MERGE_HISTOGRAM_SIZE) {
+        operands >>= 1U;
+        ++bucket;
+    }
+    MERGE_HISTOGRAM[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+/** Writers bump their key's stripe epoch under the lock; a repair only
+ * puts its value if no write hit the stripe since its read, so it never
+ * overwrites an operand it did not merge. */
+struct RepairStripe {
+    std::mutex lock;
+    std::atomic<uint64_t> epoch;
+};
+
+constexpr size_t REPAIR_STRIPES = 64;
+
+static RepairStripe STRIPES[REPAIR_STRIPES];
+
+static inline size_t stripe_of(const Key& key) {
+    uint64_t h = (key.bits.first ^ key.bits.second) * 0x9E3779B97F4A7C15UL;
+    return h >> 58U;
+}
+
 //  M E R G E  O P E R A T O R
 
 template <typename Frame>
@@ -69,6 +191,7 @@ class RDTMerge : public rocksdb::MergeOperator {
         for (auto s : merge_in.operand_list) {
             inputs.push_back(Cursor{slice(s)});
         }
+        merge_operands = merge_in.operand_list.size();
 
         Status ok = reducer_.Merge(out, key.form(), inputs);
 
@@ -99,14 +222,254 @@ class RDTMerge : public rocksdb::MergeOperator {
     const char* Name() const override { return "rdt"; }
 };
 
+//  C O M P A C T I O N  F I L T E R
+
+struct CompactionGC {
+    uint64_t forms;
+    VV stable;
+};
+
+/** Collects garbage in object states as compaction rewrites them, so
+ * space is reclaimed off the read path. Merge operands are left as is. */
+template <typename Frame>
+class RDTCompactionFilter : public rocksdb::CompactionFilter {
+    MasterRDT<Frame> reducer_;
+    shared_ptr<const CompactionGC> gc_;
+
+   public:
+    using Builder = typename Frame::Builder;
+
+    explicit RDTCompactionFilter(shared_ptr<const CompactionGC> gc)
+        : reducer_{}, gc_{std::move(gc)} {}
+
+    bool Filter(int level, const rocksdb::Slice& dbkey,
+                const rocksdb::Slice& existing_value, std::string* new_value,
+                bool* value_changed) const override {
+        Key key = slice2key(dbkey);
+        if (!(gc_->forms & (1UL << key.form()))) {
+            return false;
+        }
+        Builder out;
+        Status ok = reducer_.GC(out, key.form(),
+                                Frame{slice(existing_value)}, gc_->stable);
+        if (!ok || out.data().size() == existing_value.size()) {
+            return false;
+        }
+        LOG('g', key, out.data());
+        swap(out, *new_value);
+        *value_changed = true;
+        return false;
+    }
+
+    const char* Name() const override { return "rdt-gc"; }
+};
+
+/** One per db, shared by its column families: the db's GC config, see
+ * SetCompactionGC. Off till set: a *log query is served off the state,
+ * see Commit::QueryObjectLog, so GC-ed ops are gone for it. Each
+ * compaction gets a filter with the config of the time. */
+template <typename Frame>
+class RDTCompactionFilterFactory : public rocksdb::CompactionFilterFactory {
+    /** swapped atomically: compactions run in background threads */
+    shared_ptr<const CompactionGC> gc_;
+
+   public:
+    RDTCompactionFilterFactory() : gc_{new CompactionGC{0, VV{}}} {}
+
+    void Set(uint64_t forms, const VV& stable) {
+        shared_ptr<const CompactionGC> gc{new CompactionGC{forms, stable}};
+        std::atomic_store(&gc_, gc);
+    }
+
+    std::unique_ptr<rocksdb::CompactionFilter> CreateCompactionFilter(
+        const rocksdb::CompactionFilter::Context& context) override {
+        shared_ptr<const CompactionGC> gc = std::atomic_load(&gc_);
+        if (!gc->forms) return nullptr;
+        return std::unique_ptr<rocksdb::CompactionFilter>{
+            new RDTCompactionFilter<Frame>{gc}};
+    }
+
+    const char* Name() const override { return "rdt-gc"; }
+};
+
+template <typename Frame>
+Status RocksDBStore<Frame>::SetCompactionGC(uint64_t forms,
+                                            const VV& stable) {
+    if (!db_) return Status::BAD_STATE.comment("closed");
+    auto factory = std::static_pointer_cast<RDTCompactionFilterFactory<Frame>>(
+        db_of(db_)->GetOptions().compaction_filter_factory);
+    if (!factory) return Status::BAD_STATE.comment("no GC on the db");
+    factory->Set(forms, stable);
+    return Status::OK;
+}
+
+//  P R O F I L E S
+
+/** The first 8 bytes of a big-endian Key: the form and the origin (sans
+ * its lowest 4 bits), so a prefix is a yarn (of one form). */
+constexpr size_t KEY_PREFIX_SIZE = sizeof(uint64_t);
+
+struct TuningProfile {
+    const char* name;
+    size_t block_cache_size;
+    size_t block_size;
+    /** bloom filter bits per key, 0 for no filters */
+    int bloom_bits;
+    /** filter whole keys (Get) in addition to prefixes (SeekForPrev) */
+    bool whole_key_filtering;
+    double memtable_prefix_bloom_ratio;
+};
+
+static const TuningProfile PROFILES[] = {
+    {"default", 64UL << 20U, 4UL << 10U, 10, true, 0.02},
+    {"point", 512UL << 20U, 4UL << 10U, 12, true, 0.1},
+    {"scan", 256UL << 20U, 32UL << 10U, 10, false, 0.02},
+    {"plain", 8UL << 20U, 4UL << 10U, 0, false, 0},
+};
+
+static const TuningProfile* find_profile(const String& name) {
+    for (auto& p : PROFILES) {
+        if (name == p.name) return &p;
+    }
+    return nullptr;
+}
+
+static rocksdb::BlockBasedTableOptions table_options(
+    const TuningProfile& profile) {
+    // one cache for all the column families (branches), sized by the
+    // profile the process opens its first store with
+    static shared_ptr<rocksdb::Cache> cache{
+        rocksdb::NewLRUCache(profile.block_cache_size)};
+    rocksdb::BlockBasedTableOptions table{};
+    table.block_cache = cache;
+    table.block_size = profile.block_size;
+    table.cache_index_and_filter_blocks = true;
+    table.pin_l0_filter_and_index_blocks_in_cache = true;
+    if (profile.bloom_bits) {
+        table.filter_policy.reset(
+            rocksdb::NewBloomFilterPolicy(profile.bloom_bits, false));
+        table.whole_key_filtering = profile.whole_key_filtering;
+    }
+    return table;
+}
+
 template <class Frame>
-void init_options(rocksdb::Options& options) {
+Status init_options(rocksdb::Options& options) {
+    const TuningProfile* profile = find_profile(ROCKSDB_STORE_PROFILE);
+    if (!profile) {
+        return Status::BADARGS.comment("no such store profile: " +
+                                       ROCKSDB_STORE_PROFILE);
+    }
     options.create_if_missing = false;
     options.error_if_exists = false;
     options.max_total_wal_size = UINT64_MAX;
-    options.WAL_size_limit_MB = 1UL << 30U;
-    options.WAL_ttl_seconds = UINT64_MAX;
+    options.WAL_size_limit_MB = ROCKSDB_WAL_LIMIT_MB;
+    options.WAL_ttl_seconds = ROCKSDB_WAL_TTL;
     options.merge_operator = make_shared<RDTMerge<Frame>>();
+    options.compaction_filter_factory =
+        make_shared<RDTCompactionFilterFactory<Frame>>();
+
+    if (profile->bloom_bits) {
+        options.prefix_extractor.reset(
+            rocksdb::NewFixedPrefixTransform(KEY_PREFIX_SIZE));
+        options.memtable_prefix_bloom_size_ratio =
+            profile->memtable_prefix_bloom_ratio;
+    }
+    options.table_factory.reset(
+        rocksdb::NewBlockBasedTableFactory(table_options(*profile)));
+    return Status::OK;
+}
+
+/** New column families of an open db share its GC config */
+static inline void share_gc(rocksdb::DB* db, Options& options) {
+    options.compaction_filter_factory =
+        db->GetOptions().compaction_filter_factory;
+}
+
+//  F A M I L I E S
+
+/** The column families a split store's records go to, by form, see
+ * ROCKSDB_FORM_FAMILIES. The store's own column family is its
+ * STATE_FAMILY, so plain stores have that one only. */
+enum family_t : uint8_t {
+    STATE_FAMILY = 0,
+    LOG_FAMILY = 1,
+    META_FAMILY = 2,
+    FAMILY_COUNT = 3
+};
+
+/** appended to the store's column family name */
+static const char* FAMILY_SUFFIXES[FAMILY_COUNT] = {"", "#log", "#meta"};
+
+static inline family_t family_of(FORM form) {
+    if (form >= YARN_RAW_FORM && form <= GRAPH_RAW_FORM) {
+        return LOG_FAMILY;
+    }
+    if (form >= META_META_FORM && form <= VV_META_FORM) {
+        return META_FAMILY;
+    }
+    return STATE_FAMILY;  // the tip record, RDT states, maps
+}
+
+static family_t family_of(const String& cf_name) {
+    for (int f = LOG_FAMILY; f < FAMILY_COUNT; ++f) {
+        String suffix{FAMILY_SUFFIXES[f]};
+        if (cf_name.size() > suffix.size() &&
+            cf_name.compare(cf_name.size() - suffix.size(), suffix.size(),
+                            suffix) == 0) {
+            return family_t(f);
+        }
+    }
+    return STATE_FAMILY;
+}
+
+/** @param forms the store's families (a Layers vector), nullptr if the
+ * store is not split
+ * @return the column family the key goes to */
+static inline ColumnFamilyHandle* cf_for(const shared_ptr<void>& cf,
+                                         const shared_ptr<void>& forms,
+                                         const Key& key) {
+    if (!forms) return cf_of(cf);
+    auto& families = *static_cast<const vector<shared_ptr<void>>*>(
+        forms.get());
+    return cf_of(families[family_of(key.form())]);
+}
+
+/** Tunes a split store's column family to its forms' access pattern:
+ * object logs and chains are append-mostly, cold and scanned; meta
+ * records are hot point lookups; states are overwritten (Put, read
+ * repair) and GC-ed on compaction.
+ * @param options the db's, see init_options() */
+template <class Frame>
+Status family_options(const Options& options, ColumnFamilyOptions& cfo,
+                      family_t family) {
+    cfo = ColumnFamilyOptions{options};
+    rocksdb::BlockBasedTableOptions table =
+        table_options(*find_profile(ROCKSDB_STORE_PROFILE));
+    switch (family) {
+        case LOG_FAMILY:
+            cfo.compaction_style = rocksdb::kCompactionStyleUniversal;
+            cfo.compression = rocksdb::kZSTD;
+            cfo.compaction_filter_factory = nullptr;  // no states to GC
+            table.block_size = std::max(table.block_size, size_t(32UL << 10U));
+            table.whole_key_filtering = false;
+            break;
+        case META_FAMILY:
+            cfo.compression = rocksdb::kLZ4Compression;
+            cfo.compaction_filter_factory = nullptr;
+            if (!table.filter_policy) {
+                table.filter_policy.reset(
+                    rocksdb::NewBloomFilterPolicy(10, false));
+            }
+            table.whole_key_filtering = true;
+            break;
+        default:
+            cfo.compression = rocksdb::kLZ4Compression;
+            cfo.bottommost_compression = rocksdb::kZSTD;
+            cfo.level_compaction_dynamic_level_bytes = true;
+    }
+    cfo.table_factory.reset(rocksdb::NewBlockBasedTableFactory(table));
+    return Status::OK;
 }
 
 #define IFROK(x)                   \
@@ -117,29 +480,548 @@ void init_options(rocksdb::Options& options) {
         }                          \
     }
 
+/** Called right after a Get(); writes back the value if its merge was
+ * long, unless a write raced the read. Failures are not fatal, the read
+ * went fine. */
+static void read_repair(DB* db, ColumnFamilyHandle* cf, const Key& key,
+                        const rocksdb::Slice& merged, uint64_t epoch) {
+    size_t operands = merge_operands;
+    count_merge(operands);
+    if (!ROCKSDB_READ_REPAIR || operands <= ROCKSDB_READ_REPAIR) {
+        return;
+    }
+    RepairStripe& stripe = STRIPES[stripe_of(key)];
+    std::lock_guard<std::mutex> lock{stripe.lock};
+    if (stripe.epoch != epoch) {
+        return;  // a later read will do
+    }
+    auto be = key.be();
+    LOG('p', key, merged.ToString());
+    db->Put(wo(), cf, key2slice(be), merged);
+}
+
+/** Applies a batch under its keys' stripe locks (see read_repair). */
+static Status write_locked(DB* db, rocksdb::WriteBatch& batch,
+                           vector<size_t>& stripes) {
+    std::sort(stripes.begin(), stripes.end());
+    stripes.erase(std::unique(stripes.begin(), stripes.end()), stripes.end());
+    vector<std::unique_lock<std::mutex>> locks;
+    for (size_t i : stripes) locks.emplace_back(STRIPES[i].lock);
+    IFROK(db->Write(wo(), &batch));
+    for (size_t i : stripes) ++STRIPES[i].epoch;
+    return Status::OK;
+}
+
+//  G R O U P  C O M M I T
+
+/** A batch waiting in the group commit queue. */
+struct GroupWriter {
+    DB* db;
+    ColumnFamilyHandle* cf;
+    /** the store's families, see cf_for() */
+    const shared_ptr<void>* forms;
+    const ArenaBatch* batch;
+    size_t bytes;
+    Status status;
+    bool done;
+};
+
+/** The queue head is the leader: it writes a group of the batches
+ * queued after it, in one db write, while the others wait. One queue
+ * per db, so the dbs (e.g. shards, see ShardedStore) write in parallel. */
+static std::mutex GROUP_LOCK;
+static std::condition_variable GROUP_CV;
+static std::unordered_map<DB*, std::deque<GroupWriter*>> GROUP_QUEUES;
+
+static void add_batch(rocksdb::WriteBatch& into, const GroupWriter& w,
+                      vector<size_t>& stripes) {
+    for (auto& rec : w.batch->records) {
+        uint64pair k = rec.first.be();
+        auto cf = *w.forms ? cf_for(nullptr, *w.forms, rec.first) : w.cf;
+        into.Merge(cf, key2slice(k), slice(rec.second));
+        stripes.push_back(stripe_of(rec.first));
+        LOG('m', rec.first, String{(const char*)rec.second.data(),
+                                   rec.second.size()});
+    }
+}
+
+static Status write_group(GroupWriter& w) {
+    std::unique_lock<std::mutex> lock{GROUP_LOCK};
+    // a node's reference stays valid till it is erased, i.e. emptied
+    std::deque<GroupWriter*>& queue = GROUP_QUEUES[w.db];
+    queue.push_back(&w);
+    GROUP_CV.notify_all();
+    GROUP_CV.wait(lock, [&w, &queue] { return w.done || queue.front() == &w; });
+    if (w.done) {
+        return w.status;
+    }
+
+    auto queued = [&queue] {
+        size_t bytes = 0;
+        for (auto* q : queue) bytes += q->bytes;
+        return bytes;
+    };
+    if (ROCKSDB_GROUP_COMMIT_WINDOW) {
+        auto till = std::chrono::steady_clock::now() +
+                    std::chrono::microseconds(ROCKSDB_GROUP_COMMIT_WINDOW);
+        GROUP_CV.wait_until(lock, till, [&queued] {
+            return queued() >= ROCKSDB_GROUP_COMMIT_BYTES;
+        });
+    }
+    vector<GroupWriter*> group;
+    size_t bytes = 0;
+    for (auto* q : queue) {
+        if (!group.empty() && bytes + q->bytes > ROCKSDB_GROUP_COMMIT_BYTES) {
+            break;
+        }
+        group.push_back(q);
+        bytes += q->bytes;
+    }
+    lock.unlock();
+
+    rocksdb::WriteBatch b;
+    vector<size_t> stripes;
+    for (auto* q : group) add_batch(b, *q, stripes);
+    Status ok = write_locked(w.db, b, stripes);
+    if (!ok && group.size() > 1) {
+        // one bad batch must not fail the others: retry one by one
+        for (auto* q : group) {
+            rocksdb::WriteBatch one;
+            vector<size_t> own;
+            add_batch(one, *q, own);
+            q->status = write_locked(w.db, one, own);
+        }
+    } else {
+        for (auto* q : group) q->status = ok;
+    }
+
+    lock.lock();
+    for (auto* q : group) {
+        q->done = true;
+        queue.pop_front();
+    }
+    if (queue.empty()) {
+        GROUP_QUEUES.erase(w.db);
+    }
+    GROUP_CV.notify_all();
+    return w.status;
+}
+
+template <typename Frame>
+void RocksDBStore<Frame>::ReadMergeHistogram(std::vector<uint64_t>& counts) {
+    counts.resize(MERGE_HISTOGRAM_SIZE);
+    for (size_t i = 0; i < MERGE_HISTOGRAM_SIZE; ++i) {
+        counts[i] = MERGE_HISTOGRAM[i].load(std::memory_order_relaxed);
+    }
+}
+
+//  L A Y E R S
+
+/** Every forked column family has a layer record: `@store_id :0 'base'`,
+ * the store it belongs to and the name of the frozen column family under
+ * it (empty once flat, see DropBases). A frozen one's record also counts
+ * the column families right on it: `@store_id :0 'base' 2`. Plain column
+ * families that never froze have none, their name is the store id. */
+static const Key LAYER_KEY{Uuid{"0000layer+0"}, ZERO_RAW_FORM};
+
+/** Forked column families are named layer/id/time; one that has no
+ * layer record is the leftover of an interrupted Fork(). */
+static const String LAYER_PREFIX{"layer/"};
+
+using Layers = vector<shared_ptr<void>>;
+
+static inline const Layers& layers_of(const shared_ptr<void>& base) {
+    return *static_cast<const Layers*>(base.get());
+}
+
+/** A layered store's base_, see RocksDBStore::base_ */
+struct Bases {
+    Layers layers;
+    /** the next key for Flatten() to copy, Key::END once done */
+    Key flat;
+};
+
+static inline Bases& bases_of(const shared_ptr<void>& base) {
+    return *static_cast<Bases*>(base.get());
+}
+
+struct LayerRecord {
+    Uuid store;
+    /** the name of the frozen column family under, empty if none */
+    String base;
+    /** the column families on this one, 0 unless frozen */
+    int64_t refs;
+};
+
+/** @return NOT_FOUND for the leftovers of an interrupted Fork() */
+template <typename Frame>
+static Status read_layer_record(DB* db, ColumnFamilyHandle* cf,
+                                LayerRecord& rec) {
+    rec.base.clear();
+    rec.refs = 0;
+    const String& name = cf->GetName();
+    bool forked = name.compare(0, LAYER_PREFIX.size(), LAYER_PREFIX) == 0;
+    if (!forked) {
+        rec.store = name == rocksdb::kDefaultColumnFamilyName ? Uuid::NIL
+                                                              : Uuid{name};
+    }
+    auto k = LAYER_KEY.be();
+    String value;
+    auto ok = db->Get(ro(), cf, key2slice(k), &value);
+    if (ok.IsNotFound()) {
+        return forked ? Status::NOT_FOUND.comment("an unfinished fork: " +
+                                                  name)
+                      : Status::OK;
+    }
+    IFROK(ok);
+    typename Frame::Cursor c{value};
+    if (!c.valid() || !c.has(2, STRING)) {
+        return Status::BADFRAME.comment("bad layer record in " + name);
+    }
+    rec.store = c.id();
+    rec.base = c.string(2);
+    if (c.has(3, INT)) {
+        rec.refs = c.integer(3);
+    }
+    return Status::OK;
+}
+
+template <typename Frame>
+static Frame layer_record(const LayerRecord& rec) {
+    return rec.refs ? OneOp<Frame>(rec.store, Uuid::NIL, rec.base, rec.refs)
+                    : OneOp<Frame>(rec.store, Uuid::NIL, rec.base);
+}
+
+template <typename Frame>
+static Status write_layer_record(DB* db, ColumnFamilyHandle* cf,
+                                 const LayerRecord& rec) {
+    Frame frame = layer_record<Frame>(rec);
+    auto k = LAYER_KEY.be();
+    IFROK(db->Put(wo(), cf, key2slice(k), slice(Slice{frame.data()})));
+    return Status::OK;
+}
+
+/** serializes the counting in frozen layer records */
+static std::mutex LAYERS_LOCK;
+
+/** Takes a column family off its layers: the nearest one counts one
+ * less on it; at zero it is dropped, so the next one counts one less...
+ * A count of 0 is a record OpenAll has not recounted yet: kept. */
+template <typename Frame>
+static Status release_layers(DB* db, const Layers& bases) {
+    std::lock_guard<std::mutex> lock{LAYERS_LOCK};
+    for (auto& layer : bases) {
+        auto cf = cf_of(layer);
+        LayerRecord rec;
+        IFOK(read_layer_record<Frame>(db, cf, rec));
+        if (rec.refs != 1) {
+            if (rec.refs > 1) {
+                --rec.refs;
+                IFOK(write_layer_record<Frame>(db, cf, rec));
+            }
+            return Status::OK;
+        }
+        IFROK(db->DropColumnFamily(cf));
+    }
+    return Status::OK;
+}
+
+/** Reads the key off every layer, merging the deepest first, the order
+ * of the writes. */
+template <typename Frame>
+static Status read_layers(DB* db, ColumnFamilyHandle* top,
+                          const Layers& bases, const Key& key,
+                          Frame& result) {
+    result.Clear();
+    auto k = key.be();
+    vector<String> values;
+    values.reserve(bases.size() + 1);
+    auto get = [&](ColumnFamilyHandle* cf) -> Status {
+        values.emplace_back();
+        auto ok = db->Get(ro(), cf, key2slice(k), &values.back());
+        if (ok.IsNotFound()) {
+            values.pop_back();
+            return Status::OK;
+        }
+        IFROK(ok);
+        return Status::OK;
+    };
+    for (auto i = bases.rbegin(); i != bases.rend(); ++i) {
+        IFOK(get(cf_of(*i)));
+    }
+    IFOK(get(top));
+    if (values.size() == 1) {
+        result = Frame{std::move(values.front())};
+    } else if (values.size() > 1) {
+        typename Frame::Cursors inputs;
+        for (auto& v : values) inputs.push_back(typename Frame::Cursor{v});
+        IFOK(MergeCursors(result, key.form(), inputs));
+    }
+    LOG('r', key, result.data());
+    return Status::OK;
+}
+
+/** Walks the layers' iterators in step, merging the values of a key. */
+template <typename Frame>
+class LayerIterator {
+    using Cursor = typename Frame::Cursor;
+    /** the deepest first, as in read_layers() */
+    vector<unique_ptr<rocksdb::Iterator>> its_;
+    Frame merged_;
+    bool is_merged_;
+
+    /** Seeks every layer to the key, skipping to the next one */
+    Status seek(const Key& key) {
+        auto be = key.be();
+        for (auto& i : its_) {
+            i->Seek(key2slice(be));
+            IFROK(i->status());
+        }
+        return Status::OK;
+    }
+
+   public:
+    LayerIterator(DB* db, ColumnFamilyHandle* top, const Layers& bases,
+                  const rocksdb::ReadOptions& options)
+        : its_{}, merged_{}, is_merged_{false} {
+        for (auto i = bases.rbegin(); i != bases.rend(); ++i) {
+            its_.emplace_back(db->NewIterator(options, cf_of(*i)));
+        }
+        its_.emplace_back(db->NewIterator(options, top));
+    }
+
+    Key key() const {
+        Key ret = Key::END;
+        for (auto& i : its_) {
+            if (!i->Valid()) continue;
+            Key at = slice2key(i->key());
+            if (at < ret) ret = at;
+        }
+        return ret;
+    }
+
+    Cursor value() {
+        Key at = key();
+        if (at == Key::END) {
+            return Cursor{""};
+        }
+        typename Frame::Cursors inputs;
+        for (auto& i : its_) {
+            if (i->Valid() && slice2key(i->key()) == at) {
+                inputs.push_back(Cursor{slice(i->value())});
+            }
+        }
+        if (inputs.size() == 1) {
+            return inputs.front();
+        }
+        if (!is_merged_) {
+            if (!MergeCursors(merged_, at.form(), inputs)) {
+                return Cursor{""};
+            }
+            is_merged_ = true;
+        }
+        return Cursor{merged_.data()};
+    }
+
+    Status Next() {
+        Key at = key();
+        if (at == Key::END) {
+            return Status::ENDOFINPUT;
+        }
+        is_merged_ = false;
+        for (auto& i : its_) {
+            if (i->Valid() && slice2key(i->key()) == at) {
+                i->Next();
+                IFROK(i->status());
+            }
+        }
+        return key() == Key::END ? Status::ENDOFINPUT : Status::OK;
+    }
+
+    Status SeekTo(Key key, bool prev) {
+        is_merged_ = false;
+        if (!prev) {
+            return seek(key);
+        }
+        // the greatest key not above, then all the layers to it, so
+        // Next() steps forward in every layer
+        auto be = key.be();
+        Key last = Key::END;
+        bool found = false;
+        for (auto& i : its_) {
+            i->SeekForPrev(key2slice(be));
+            IFROK(i->status());
+            if (!i->Valid()) continue;
+            Key at = slice2key(i->key());
+            if (!found || last < at) last = at;
+            found = true;
+        }
+        return seek(last);
+    }
+};
+
+template <typename Frame>
+Status RocksDBStore<Frame>::Fork(Uuid fork_id, RocksDBStore& fork) {
+    if (!db_) return Status::BAD_STATE.comment("closed");
+    if (forms_) {
+        return Status::NOT_IMPLEMENTED.comment("split stores don't layer");
+    }
+    auto db = db_of(db_);
+    Options options;
+    IFOK(init_options<Frame>(options));
+    share_gc(db, options);
+    LayerRecord frozen;
+    IFOK(read_layer_record<Frame>(db, cf_of(cf_), frozen));
+    String name = cf_of(cf_)->GetName();
+    Uuid id = frozen.store;
+
+    auto bases = make_shared<Bases>();
+    bases->layers.push_back(cf_);
+    if (base_) {
+        const Layers& more = bases_of(base_).layers;
+        bases->layers.insert(bases->layers.end(), more.begin(), more.end());
+    }
+
+    // both column families first, then the layer records in one batch:
+    // a family with no record is ignored (see OpenAll), so a crash
+    // leaves no fork on top of this store's live family
+    auto k = LAYER_KEY.be();
+    auto z = Key::ZERO.be();
+    String time = Uuid::Now().str();
+    ColumnFamilyHandle* cfh;
+    IFROK(db->CreateColumnFamily(
+        options, LAYER_PREFIX + fork_id.str() + '/' + time, &cfh));
+    SharedPtr theirs{cfh};
+    rocksdb::Status ok = db->CreateColumnFamily(
+        options, LAYER_PREFIX + id.str() + '/' + time, &cfh);
+    if (!ok.ok()) {
+        db->DropColumnFamily(cf_of(theirs));
+        return status(ok);
+    }
+    SharedPtr mine{cfh};
+    frozen.refs = 2;
+    Frame frozen_rec = layer_record<Frame>(frozen);
+    Frame their_rec = layer_record<Frame>({fork_id, name, 0});
+    Frame my_rec = layer_record<Frame>({id, name, 0});
+    Frame zero = OneOp<Frame>(Uuid::NIL, ZERO_FORM_UUID);
+    rocksdb::WriteBatch records;
+    records.Put(cf_of(cf_), key2slice(k), slice(Slice{frozen_rec.data()}));
+    records.Put(cf_of(theirs), key2slice(k), slice(Slice{their_rec.data()}));
+    records.Put(cf_of(theirs), key2slice(z), slice(Slice{zero.data()}));
+    records.Put(cf_of(mine), key2slice(k), slice(Slice{my_rec.data()}));
+    ok = db->Write(wo(), &records);
+    if (!ok.ok()) {
+        db->DropColumnFamily(cf_of(theirs));
+        db->DropColumnFamily(cf_of(mine));
+        return status(ok);
+    }
+    // each flattens on its own, see Flatten()
+    fork = RocksDBStore{db_, theirs, make_shared<Bases>(*bases)};
+    fork.tip = Uuid::NIL;
+    cf_ = mine;
+    base_ = bases;
+    return Status::OK;
+}
+
+template <typename Frame>
+Status RocksDBStore<Frame>::Flatten(size_t limit) {
+    if (!db_) return Status::BAD_STATE.comment("closed");
+    if (!base_) return Status::ENDOFINPUT;
+    auto db = db_of(db_);
+    auto top = cf_of(cf_);
+    Bases& bases = bases_of(base_);
+    if (bases.flat == Key::END) return Status::ENDOFINPUT;
+    // the keys of the bases: the nearest one plays the top
+    const Layers& layers = bases.layers;
+    LayerIterator<Frame> i{db, cf_of(layers.front()),
+                           Layers{layers.begin() + 1, layers.end()},
+                           iro(false)};
+    IFOK(i.SeekTo(bases.flat, false));
+    Frame merged;
+    for (size_t n = 0; i.key() != Key::END; ++n) {
+        if (limit && n == limit) {
+            bases.flat = i.key();
+            return Status::OK;
+        }
+        Key key = i.key();
+        if (key != LAYER_KEY) {  // the top has its own
+            auto be = key.be();
+            RepairStripe& stripe = STRIPES[stripe_of(key)];
+            std::lock_guard<std::mutex> lock{stripe.lock};
+            IFOK(read_layers(db, top, layers, key, merged));
+            IFROK(db->Put(wo(), top, key2slice(be),
+                          slice(Slice{merged.data()})));
+            ++stripe.epoch;
+        }
+        Status ok = i.Next();
+        if (!ok && ok != Status::ENDOFINPUT) return ok;
+    }
+    bases.flat = Key::END;
+    return Status::ENDOFINPUT;
+}
+
+template <typename Frame>
+Status RocksDBStore<Frame>::DropBases() {
+    if (!db_) return Status::BAD_STATE.comment("closed");
+    if (!base_) return Status::OK;
+    if (bases_of(base_).flat != Key::END) {
+        return Status::BAD_STATE.comment("not flat yet");
+    }
+    auto db = db_of(db_);
+    LayerRecord rec;
+    IFOK(read_layer_record<Frame>(db, cf_of(cf_), rec));
+    rec.base.clear();
+    IFOK(write_layer_record<Frame>(db, cf_of(cf_), rec));
+    SharedPtr base = std::move(base_);
+    base_.reset();
+    return release_layers<Frame>(db, bases_of(base).layers);
+}
+
 //  S T O R E
 
 template <typename Frame>
 Status RocksDBStore<Frame>::Create(Uuid id) {
+    return Create(id, ROCKSDB_STORE_DIR);
+}
+
+template <typename Frame>
+Status RocksDBStore<Frame>::Create(Uuid id, const String& dir) {
     Options options{};
-    init_options<Frame>(options);
+    IFOK(init_options<Frame>(options));
     options.create_if_missing = true;
     options.error_if_exists = false;
 
     if (!db_) {
         rocksdb::DB* db;
-        IFROK(DB::Open(options, ROCKSDB_STORE_DIR, &db));
+        IFROK(DB::Open(options, dir, &db));
         db_ = SharedPtr{db};
+    } else {
+        share_gc(db_of(db_), options);
     }
 
     ColumnFamilyHandle* cfh;
-    auto db = static_pointer_cast<rocksdb::DB>(db_);
+    auto db = db_of(db_);
+    ColumnFamilyOptions cfo{options};
+    if (ROCKSDB_FORM_FAMILIES) {
+        IFOK(family_options<Frame>(options, cfo, STATE_FAMILY));
+    }
     if (id != Uuid::NIL) {
-        IFROK(db->CreateColumnFamily(options, id.str(), &cfh));
+        IFROK(db->CreateColumnFamily(cfo, id.str(), &cfh));
         cf_.reset(cfh);
     } else {
         cf_ = SharedPtr{db->DefaultColumnFamily(), [](void*) {}};
     }
+    if (ROCKSDB_FORM_FAMILIES) {
+        auto forms = make_shared<Layers>(FAMILY_COUNT);
+        (*forms)[STATE_FAMILY] = cf_;
+        for (int f = LOG_FAMILY; f < FAMILY_COUNT; ++f) {
+            IFOK(family_options<Frame>(options, cfo, family_t(f)));
+            IFROK(db->CreateColumnFamily(
+                cfo, cf_of(cf_)->GetName() + FAMILY_SUFFIXES[f], &cfh));
+            (*forms)[f] = SharedPtr{cfh};
+        }
+        forms_ = forms;
+    }
 
     tip = Uuid::NIL;
     Frame now = OneOp<Frame>(tip, ZERO_FORM_UUID);
@@ -153,7 +1035,7 @@ Status RocksDBStore<Frame>::Open(Uuid id) {
     if (db_) return Status::BAD_STATE.comment("db open already");
 
     Options options;
-    init_options<Frame>(options);
+    IFOK(init_options<Frame>(options));
 
     rocksdb::DB* db;
     IFROK(DB::Open(options, ROCKSDB_STORE_DIR, &db));
@@ -166,17 +1048,61 @@ Status RocksDBStore<Frame>::Open(Uuid id) {
     return Status::OK;
 }
 
+template <typename Frame>
+Status RocksDBStore<Frame>::Compact() {
+    rocksdb::CompactRangeOptions cro{};
+    IFROK(db_of(db_)->CompactRange(cro, cf_of(cf_), nullptr, nullptr));
+    if (forms_) {
+        const Layers& forms = layers_of(forms_);
+        for (int f = LOG_FAMILY; f < FAMILY_COUNT; ++f) {
+            IFROK(db_of(db_)->CompactRange(cro, cf_of(forms[f]), nullptr,
+                                           nullptr));
+        }
+    }
+    return Status::OK;
+}
+
+template <typename Frame>
+Status RocksDBStore<Frame>::Stats(String& report) {
+    if (!db_) return Status::BAD_STATE.comment("closed");
+    report.clear();
+    vector<ColumnFamilyHandle*> cfs{cf_of(cf_)};
+    if (forms_) {
+        const Layers& forms = layers_of(forms_);
+        for (int f = LOG_FAMILY; f < FAMILY_COUNT; ++f) {
+            cfs.push_back(cf_of(forms[f]));
+        }
+    }
+    for (auto cf : cfs) {
+        String stats;
+        db_of(db_)->GetProperty(cf, "rocksdb.cfstats", &stats);
+        report += cf->GetName() + '\n' + stats;
+    }
+    return Status::OK;
+}
+
 template <typename Frame>
 Status RocksDBStore<Frame>::Drop() {
-    auto db = static_pointer_cast<rocksdb::DB>(db_);
-    auto cf = static_pointer_cast<rocksdb::ColumnFamilyHandle>(cf_);
-    IFROK(db->DropColumnFamily(cf.get()));
+    auto db = db_of(db_);
+    auto cf = cf_of(cf_);
+    IFROK(db->DropColumnFamily(cf));
+    if (forms_) {
+        const Layers& forms = layers_of(forms_);
+        for (int f = LOG_FAMILY; f < FAMILY_COUNT; ++f) {
+            IFROK(db->DropColumnFamily(cf_of(forms[f])));
+        }
+    }
+    if (base_) {
+        IFOK(release_layers<Frame>(db, bases_of(base_).layers));
+    }
     return Close();
 }
 
 template <typename Frame>
 Status RocksDBStore<Frame>::Close() {
     if (!db_.use_count()) return Status::BAD_STATE.comment("already closed");
+    base_.reset();
+    forms_.reset();
     cf_.reset();
     db_.reset();
     return Status::OK;
@@ -189,11 +1115,14 @@ Status RocksDBStore<Frame>::Write(Key key, const Frame& change) {
         return Status::BADARGS.comment("can't write to Key::END");
     }
     auto be = key.be();
-    auto db = static_pointer_cast<rocksdb::DB>(db_);
-    auto cf = static_pointer_cast<rocksdb::ColumnFamilyHandle>(cf_);
+    auto db = db_of(db_);
+    auto cf = cf_for(cf_, forms_, key);
     Slice data{change.data()};
     LOG('w', key, change.data());
-    IFROK(db->Merge(wo(), cf.get(), key2slice(be), slice(data)));
+    RepairStripe& stripe = STRIPES[stripe_of(key)];
+    std::lock_guard<std::mutex> lock{stripe.lock};
+    IFROK(db->Merge(wo(), cf, key2slice(be), slice(data)));
+    ++stripe.epoch;
     return Status::OK;
 }
 
@@ -204,11 +1133,17 @@ Status RocksDBStore<Frame>::Read(Key key, Frame& result) {
     if (key == Key::END) {
         return Status::OK;
     }
+    if (base_) {
+        return read_layers(db_of(db_), cf_of(cf_), bases_of(base_).layers,
+                           key, result);
+    }
     uint64pair k = key.be();
     String ret;
-    auto db = static_pointer_cast<rocksdb::DB>(db_);
-    auto cf = static_pointer_cast<rocksdb::ColumnFamilyHandle>(cf_);
-    auto ok = db->Get(ro(), cf.get(), key2slice(k), &ret);
+    auto db = db_of(db_);
+    auto cf = cf_for(cf_, forms_, key);
+    uint64_t epoch = STRIPES[stripe_of(key)].epoch;
+    merge_operands = 0;
+    auto ok = db->Get(ro(), cf, key2slice(k), &ret);
     if (ok.IsNotFound()) {
         LOG('r', key, "");
         result.Clear();
@@ -219,36 +1154,186 @@ Status RocksDBStore<Frame>::Read(Key key, Frame& result) {
         return status(ok);
     }
     LOG('r', key, ret);
+    read_repair(db, cf, key, ret, epoch);
     result.swap(ret);
     return Status::OK;
 }
 
+template <typename Frame>
+Status RocksDBStore<Frame>::Read(Key key, Pinned& result) {
+    result.Release();
+    if (!db_) return Status::BAD_STATE.comment("closed");
+    if (key == Key::END) {
+        return Status::OK;
+    }
+    if (base_) {
+        auto merged = make_shared<Frame>();
+        IFOK(read_layers(db_of(db_), cf_of(cf_), bases_of(base_).layers,
+                         key, *merged));
+        if (!merged->empty()) result.Own(merged);
+        return Status::OK;
+    }
+    uint64pair k = key.be();
+    auto pinned = make_shared<rocksdb::PinnableSlice>();
+    auto db = db_of(db_);
+    auto cf = cf_for(cf_, forms_, key);
+    uint64_t epoch = STRIPES[stripe_of(key)].epoch;
+    merge_operands = 0;
+    auto ok = db->Get(ro(), cf, key2slice(k), pinned.get());
+    if (ok.IsNotFound()) {
+        LOG('r', key, "");
+        return Status::OK;
+    }
+    if (!ok.ok()) {
+        LOG('r', key, status(ok).str());
+        return status(ok);
+    }
+    read_repair(db, cf, key, *pinned, epoch);
+    result.data_ = slice(*pinned);
+    result.pin_ = pinned;
+    return Status::OK;
+}
+
+template <typename Frame>
+Status RocksDBStore<Frame>::MultiRead(const Keys& keys, Frames& results) {
+    if (base_) {
+        results.resize(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            IFOK(Read(keys[i], results[i]));
+        }
+        return Status::OK;
+    }
+    // sorted lookups walk the table blocks in order
+    vector<size_t> order(keys.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(),
+              [&keys](size_t a, size_t b) { return keys[a] < keys[b]; });
+    vector<uint64pair> bes;
+    bes.reserve(keys.size());
+    vector<rocksdb::Slice> slices;
+    slices.reserve(keys.size());
+    vector<ColumnFamilyHandle*> cfs;
+    cfs.reserve(keys.size());
+    for (size_t i : order) {
+        bes.push_back(keys[i].be());
+        slices.push_back(key2slice(bes.back()));
+        cfs.push_back(cf_for(cf_, forms_, keys[i]));
+    }
+    vector<std::string> values;
+    auto oks = db_of(db_)->MultiGet(ro(), cfs, slices, &values);
+    results.clear();
+    results.resize(keys.size());
+    for (size_t j = 0; j < order.size(); ++j) {
+        const Key& key = keys[order[j]];
+        if (oks[j].IsNotFound()) {
+            LOG('r', key, "");
+            continue;
+        }
+        if (!oks[j].ok()) {
+            LOG('r', key, status(oks[j]).str());
+            return status(oks[j]);
+        }
+        LOG('r', key, values[j]);
+        results[order[j]] = Frame{std::move(values[j])};
+    }
+    return Status::OK;
+}
+
 template <typename Frame>
 Status RocksDBStore<Frame>::Write(const Records& batch) {
     rocksdb::WriteBatch b;
-    auto cf = static_pointer_cast<rocksdb::ColumnFamilyHandle>(cf_);
     for (auto i = batch.begin(); i != batch.end(); ++i) {
         uint64pair k = i->first.be();
         const String& data = i->second.data();
         rocksdb::Slice slice{data};
-        b.Merge(cf.get(), key2slice(k), slice);
+        b.Merge(cf_for(cf_, forms_, i->first), key2slice(k), slice);
         LOG('m', i->first, data);
     }
-    auto db = static_pointer_cast<rocksdb::DB>(db_);
-    IFROK(db->Write(wo(), &b));
+    vector<size_t> stripes;
+    for (auto& rec : batch) stripes.push_back(stripe_of(rec.first));
+    return write_locked(db_of(db_), b, stripes);
+}
+
+template <typename Frame>
+Status RocksDBStore<Frame>::Write(const ArenaBatch& batch) {
+    if (!db_) return Status::BAD_STATE.comment("closed");
+    size_t bytes = 0;
+    for (auto& rec : batch.records) {
+        if (rec.first == Key::END) {
+            return Status::BADARGS.comment("can't write to Key::END");
+        }
+        bytes += Key::SIZE + rec.second.size();
+    }
+    GroupWriter w{db_of(db_), cf_of(cf_), &forms_, &batch,
+                  bytes,      Status::OK, false};
+    return write_group(w);
+}
+
+template <typename Frame>
+Status RocksDBStore<Frame>::Put(Key key, const Frame& state) {
+    if (!db_) return Status::BAD_STATE.comment("closed");
+    if (key == Key::END) {
+        return Status::BADARGS.comment("can't write to Key::END");
+    }
+    if (base_) {  // reads would merge the bases back in
+        return Status::NOT_IMPLEMENTED.comment("a Put can't hide the bases");
+    }
+    auto be = key.be();
+    auto db = db_of(db_);
+    auto cf = cf_for(cf_, forms_, key);
+    Slice data{state.data()};
+    LOG('p', key, state.data());
+    RepairStripe& stripe = STRIPES[stripe_of(key)];
+    std::lock_guard<std::mutex> lock{stripe.lock};
+    IFROK(db->Put(wo(), cf, key2slice(be), slice(data)));
+    ++stripe.epoch;
     return Status::OK;
 }
 
 //  I T E R A T O R
 
 template <typename Frame>
-RocksDBStore<Frame>::Iterator::Iterator(RocksDBStore& host) {
-    auto db = static_pointer_cast<rocksdb::DB>(host.db_);
-    auto cf = static_pointer_cast<rocksdb::ColumnFamilyHandle>(host.cf_);
-    auto i = db->NewIterator(ro(), cf.get());
+RocksDBStore<Frame>::Iterator::Iterator(RocksDBStore& host,
+                                        bool same_prefix) {
+    auto db = db_of(host.db_);
+    auto cf = cf_of(host.cf_);
+    if (host.base_) {
+        layers_ = make_shared<LayerIterator<Frame>>(
+            db, cf, bases_of(host.base_).layers, iro(same_prefix));
+        return;
+    }
+    if (host.forms_) {  // disjoint keys, so nothing to merge
+        const Layers& forms = layers_of(host.forms_);
+        layers_ = make_shared<LayerIterator<Frame>>(
+            db, cf, Layers{forms.begin() + 1, forms.end()},
+            iro(same_prefix));
+        return;
+    }
+    auto i = db->NewIterator(iro(same_prefix), cf);
     i_ = shared_ptr<rocksdb::Iterator>(i);
 }
 
+template <typename Frame>
+RocksDBStore<Frame>::Iterator::Iterator(RocksDBStore& host,
+                                        const Range& range)
+    : bounds_{make_shared<ScanBounds>(range)} {
+    auto db = db_of(host.db_);
+    auto cf = cf_of(host.cf_);
+    auto options = bounds_of(bounds_).options();
+    if (host.base_) {
+        layers_ = make_shared<LayerIterator<Frame>>(
+            db, cf, bases_of(host.base_).layers, options);
+        return;
+    }
+    if (host.forms_) {
+        const Layers& forms = layers_of(host.forms_);
+        layers_ = make_shared<LayerIterator<Frame>>(
+            db, cf, Layers{forms.begin() + 1, forms.end()}, options);
+        return;
+    }
+    i_ = shared_ptr<rocksdb::Iterator>(db->NewIterator(options, cf));
+}
+
 /*template <typename Frame>
 Status RocksDBStore<Frame>::Iterator::status() {
     rocksdb::Status ok = IT_->status();
@@ -258,7 +1343,10 @@ Status RocksDBStore<Frame>::Iterator::status() {
 
 template <typename Frame>
 Key RocksDBStore<Frame>::Iterator::key() const {
-    auto i = static_pointer_cast<const rocksdb::Iterator>(i_);
+    if (layers_) {
+        return static_cast<LayerIterator<Frame>*>(layers_.get())->key();
+    }
+    const rocksdb::Iterator* i = it_of(i_);
     if (!i || !i->Valid()) {
         return Key::END;
     }
@@ -267,7 +1355,10 @@ Key RocksDBStore<Frame>::Iterator::key() const {
 
 template <typename Frame>
 typename Frame::Cursor RocksDBStore<Frame>::Iterator::value() {
-    auto i = static_pointer_cast<const rocksdb::Iterator>(i_);
+    if (layers_) {
+        return static_cast<LayerIterator<Frame>*>(layers_.get())->value();
+    }
+    const rocksdb::Iterator* i = it_of(i_);
     if (!i || !i->Valid()) {
         return typename Frame::Cursor{""};
     }
@@ -276,10 +1367,13 @@ typename Frame::Cursor RocksDBStore<Frame>::Iterator::value() {
 
 template <typename Frame>
 Status RocksDBStore<Frame>::Iterator::Next() {
+    if (layers_) {
+        return static_cast<LayerIterator<Frame>*>(layers_.get())->Next();
+    }
     if (!i_) {
         return Status::BAD_STATE.comment("closed");
     }
-    auto i = static_pointer_cast<rocksdb::Iterator>(i_);
+    auto i = it_of(i_);
     i->Next();
     IFROK(i->status());
     if (!i->Valid()) {
@@ -290,10 +1384,25 @@ Status RocksDBStore<Frame>::Iterator::Next() {
 
 template <typename Frame>
 Status RocksDBStore<Frame>::Iterator::SeekTo(Key key, bool prev) {
+    if (bounds_) {
+        const Range& range = bounds_of(bounds_).range;
+        if (prev && !(key < range.till)) {
+            key = range.last();
+        } else if (key < range.from && prev) {
+            key = range.till;  // nothing there, see Range
+            prev = false;
+        } else if (key < range.from) {
+            key = range.from;
+        }
+    }
+    if (layers_) {
+        return static_cast<LayerIterator<Frame>*>(layers_.get())
+            ->SeekTo(key, prev);
+    }
     if (!i_) {
         return Status::BAD_STATE.comment("closed");
     }
-    auto i = static_pointer_cast<rocksdb::Iterator>(i_);
+    auto i = it_of(i_);
     auto be = key.be();
     auto k = key2slice(be);
     prev ? i->SeekForPrev(k) : i->Seek(k);
@@ -304,41 +1413,263 @@ Status RocksDBStore<Frame>::Iterator::SeekTo(Key key, bool prev) {
 template <typename Frame>
 Status RocksDBStore<Frame>::Iterator::Close() {
     i_.reset();
+    layers_.reset();
+    bounds_.reset();  // after the iterators
     return Status::OK;
 }
 
+//  C H A N G E S
+
+/** Picks the store's records out of a logged batch; follows the store
+ * to its new top column family as it forks, see Fork(). */
+template <typename Frame>
+struct ChangeCollector : public rocksdb::WriteBatch::Handler {
+    vector<uint32_t>& cfs;
+    Uuid store;
+    vector<std::pair<Key, String>> records;
+
+    ChangeCollector(vector<uint32_t>& ids, Uuid store_id)
+        : cfs{ids}, store{store_id}, records{} {}
+
+    void collect(uint32_t cf, const rocksdb::Slice& key,
+                 const rocksdb::Slice& value) {
+        if (key.size() != Key::SIZE) {
+            return;
+        }
+        Key k = slice2key(key);
+        if (k == LAYER_KEY) {  // bookkeeping: a fork's new top?
+            String rec = value.ToString();
+            typename Frame::Cursor c{rec};
+            if (c.valid() && c.id() == store &&
+                std::find(cfs.begin(), cfs.end(), cf) == cfs.end()) {
+                cfs.push_back(cf);
+            }
+            return;
+        }
+        if (std::find(cfs.begin(), cfs.end(), cf) == cfs.end()) {
+            return;
+        }
+        records.emplace_back(k, value.ToString());
+    }
+
+    rocksdb::Status PutCF(uint32_t cf, const rocksdb::Slice& key,
+                          const rocksdb::Slice& value) override {
+        collect(cf, key, value);
+        return rocksdb::Status::OK();
+    }
+
+    rocksdb::Status MergeCF(uint32_t cf, const rocksdb::Slice& key,
+                            const rocksdb::Slice& value) override {
+        collect(cf, key, value);
+        return rocksdb::Status::OK();
+    }
+};
+
+static inline rocksdb::TransactionLogIterator* log_of(
+    const shared_ptr<void>& log) {
+    return static_cast<rocksdb::TransactionLogIterator*>(log.get());
+}
+
+template <typename Frame>
+RocksDBStore<Frame>::Changes::Changes(RocksDBStore& host, uint64_t since)
+    : db_{host.db_},
+      log_{nullptr},
+      cfs_{},
+      store_{Uuid::FATAL},
+      seq_{since} {
+    LayerRecord rec;
+    if (read_layer_record<Frame>(db_of(db_), cf_of(host.cf_), rec)) {
+        store_ = rec.store;
+    }
+    cfs_.push_back(cf_of(host.cf_)->GetID());
+    if (host.base_) {  // written to before the forks
+        for (auto& layer : bases_of(host.base_).layers) {
+            cfs_.push_back(cf_of(layer)->GetID());
+        }
+    }
+    if (host.forms_) {
+        const Layers& forms = layers_of(host.forms_);
+        for (int f = LOG_FAMILY; f < FAMILY_COUNT; ++f) {
+            cfs_.push_back(cf_of(forms[f])->GetID());
+        }
+    }
+}
+
+template <typename Frame>
+Status RocksDBStore<Frame>::Changes::Next(Records& batch) {
+    batch.clear();
+    if (!db_) return Status::BAD_STATE.comment("closed");
+    auto db = db_of(db_);
+    while (batch.empty()) {
+        // a log iterator stops at the log's end as of its creation
+        if (!log_ || !log_of(log_)->Valid()) {
+            log_.reset();
+            if (seq_ > db->GetLatestSequenceNumber()) {
+                return Status::ENDOFINPUT;
+            }
+            unique_ptr<rocksdb::TransactionLogIterator> log;
+            auto ok = db->GetUpdatesSince(std::max(seq_, uint64_t(1)), &log);
+            if (!ok.ok()) {
+                return Status::NOT_FOUND.comment("no log past " +
+                                                 std::to_string(seq_) + ": " +
+                                                 ok.ToString());
+            }
+            log_ = shared_ptr<rocksdb::TransactionLogIterator>(log.release());
+            if (!log_of(log_)->Valid()) {
+                IFROK(log_of(log_)->status());
+                return Status::ENDOFINPUT;
+            }
+        }
+        auto log = log_of(log_);
+        rocksdb::BatchResult next = log->GetBatch();
+        log->Next();
+        uint64_t count = next.writeBatchPtr->Count();
+        if (next.sequence + count <= seq_) {
+            continue;  // read already
+        }
+        if (seq_ && next.sequence > seq_) {
+            return Status::NOT_FOUND.comment("the log has a gap at " +
+                                             std::to_string(seq_));
+        }
+        ChangeCollector<Frame> collector{cfs_, store_};
+        IFROK(next.writeBatchPtr->Iterate(&collector));
+        seq_ = next.sequence + count;
+        for (auto& rec : collector.records) {
+            batch.emplace_back(rec.first, Frame{std::move(rec.second)});
+        }
+    }
+    return Status::OK;
+}
+
+template <class Frame>
+Status RocksDBStore<Frame>::OpenAll(Branches& branches, bool read_only) {
+    return OpenAll(branches, read_only, ROCKSDB_STORE_DIR);
+}
+
 template <class Frame>
-Status RocksDBStore<Frame>::OpenAll(Branches& branches) {
+Status RocksDBStore<Frame>::OpenAll(Branches& branches, bool read_only,
+                                    const String& dir) {
     Options options;
     using CFD = ColumnFamilyDescriptor;
     vector<ColumnFamilyDescriptor> families;
     vector<ColumnFamilyHandle*> handles;
-    ColumnFamilyOptions cfo{};
-    cfo.merge_operator = make_shared<RDTMerge<Frame>>();
 
-    init_options<Frame>(options);
+    IFOK(init_options<Frame>(options));
+    ColumnFamilyOptions cfo{options};
 
     vector<std::string> cfnames;
-    IFROK(
-        rocksdb::DB::ListColumnFamilies(options, ROCKSDB_STORE_DIR, &cfnames));
+    IFROK(rocksdb::DB::ListColumnFamilies(options, dir, &cfnames));
+    std::unordered_set<String> listed{cfnames.begin(), cfnames.end()};
     for (auto& name : cfnames) {
-        families.push_back(CFD{name, cfo});
+        family_t family = family_of(name);
+        if (family == STATE_FAMILY &&
+            !listed.count(name + FAMILY_SUFFIXES[LOG_FAMILY])) {
+            families.push_back(CFD{name, cfo});
+            continue;
+        }
+        ColumnFamilyOptions tuned;
+        IFOK(family_options<Frame>(options, tuned, family));
+        families.push_back(CFD{name, tuned});
     }
 
     rocksdb::DB* db;
-    IFROK(DB::Open(options, ROCKSDB_STORE_DIR, families, &handles, &db));
+    if (read_only) {
+        IFROK(DB::OpenForReadOnly(options, dir, families, &handles, &db));
+    } else {
+        IFROK(DB::Open(options, dir, families, &handles, &db));
+    }
 
     branches.clear();
     branches.reserve(families.size());
 
     SharedPtr dbsh{db};
+    struct Layer {
+        SharedPtr cf;
+        LayerRecord rec;
+    };
+    std::unordered_map<String, Layer> layers;
+    std::unordered_map<String, SharedPtr> split;  // the stores' families
     for (auto* cf : handles) {
-        SharedPtr cfsh{cf};
-        auto name = cf->GetName();
-        Uuid id =
-            name == rocksdb::kDefaultColumnFamilyName ? Uuid::NIL : Uuid{name};
-        RocksDBStore<Frame> next{dbsh, cfsh};
-        branches.emplace(id, next);
+        if (family_of(cf->GetName()) != STATE_FAMILY) {
+            split.emplace(cf->GetName(), SharedPtr{cf});
+            continue;
+        }
+        Layer next{SharedPtr{cf}, LayerRecord{}};
+        Status ok = read_layer_record<Frame>(db, cf, next.rec);
+        if (ok == Status::NOT_FOUND) {
+            continue;
+        } else if (!ok) {
+            return ok;
+        }
+        layers.emplace(cf->GetName(), next);
+    }
+
+    // a column family is its store's top unless frozen (see Fork): the
+    // base of others, or counted as one; the counts are redone here, as a
+    // crash may leave them off (see release_layers)
+    std::unordered_map<String, int64_t> on;
+    for (auto& p : layers) {
+        if (!p.second.rec.base.empty()) ++on[p.second.rec.base];
+    }
+    std::unordered_set<String> frozen;
+    for (auto& p : layers) {
+        if (p.second.rec.refs > 0 || on.count(p.first)) {
+            frozen.insert(p.first);
+        }
+    }
+    // unused frozen ones go, and maybe the ones under them
+    for (bool dropped = true; dropped;) {
+        dropped = false;
+        for (auto& name : frozen) {
+            auto& layer = layers[name];
+            if (on[name] > 0 || !layer.cf) continue;
+            if (!layer.rec.base.empty()) --on[layer.rec.base];
+            if (!read_only) {
+                IFROK(db->DropColumnFamily(cf_of(layer.cf)));
+            }
+            layer.cf.reset();
+            dropped = true;
+        }
+    }
+    for (auto& name : frozen) {
+        auto& layer = layers[name];
+        if (!layer.cf || layer.rec.refs == on[name] || read_only) continue;
+        layer.rec.refs = on[name];
+        IFOK(write_layer_record<Frame>(db, cf_of(layer.cf), layer.rec));
+    }
+    for (auto& p : layers) {
+        if (frozen.count(p.first)) {
+            continue;
+        }
+        SharedPtr base{};
+        if (!p.second.rec.base.empty()) {
+            auto bases = make_shared<Bases>();
+            for (String at = p.second.rec.base; !at.empty();) {
+                auto below = layers.find(at);
+                if (below == layers.end()) {
+                    return Status::BADFRAME.comment("no layer " + at);
+                }
+                bases->layers.push_back(below->second.cf);
+                at = below->second.rec.base;
+            }
+            base = bases;
+        }
+        SharedPtr forms{};
+        if (split.count(p.first + FAMILY_SUFFIXES[LOG_FAMILY])) {
+            auto families = make_shared<Layers>(FAMILY_COUNT);
+            (*families)[STATE_FAMILY] = p.second.cf;
+            for (int f = LOG_FAMILY; f < FAMILY_COUNT; ++f) {
+                auto i = split.find(p.first + FAMILY_SUFFIXES[f]);
+                if (i == split.end()) {
+                    return Status::BADFRAME.comment("no family " + p.first +
+                                                    FAMILY_SUFFIXES[f]);
+                }
+                (*families)[f] = i->second;
+            }
+            forms = families;
+        }
+        RocksDBStore<Frame> next{dbsh, p.second.cf, base, forms};
+        branches.emplace(p.second.rec.store, next);
     }
 
     return Status::OK;
@@ -347,12 +1678,11 @@ Status RocksDBStore<Frame>::OpenAll(Branches& branches) {
 template <class Frame>
 Status RocksDBStore<Frame>::Repair() {
     Options options;
-    init_options<Frame>(options);
+    IFOK(init_options<Frame>(options));
 
     using CFD = ColumnFamilyDescriptor;
     vector<ColumnFamilyDescriptor> families;
-    ColumnFamilyOptions cfo{};
-    cfo.merge_operator = make_shared<RDTMerge<Frame>>();
+    ColumnFamilyOptions cfo{options};
     vector<std::string> cfnames;
     IFROK(
         rocksdb::DB::ListColumnFamilies(options, ROCKSDB_STORE_DIR, &cfnames));
@@ -6,6 +6,7 @@
 #include <vector>
 #include "../rdt/rdt.hpp"
 #include "../ron/ron.hpp"
+#include "arena.hpp"
 #include "key.hpp"
 
 namespace ron {
@@ -18,6 +19,8 @@ class RocksDBStore {
     using Builder = typename Frame::Builder;
     using Record = std::pair<Key, Frame>;
     using Records = std::vector<Record>;
+    using Keys = std::vector<Key>;
+    using Frames = std::vector<Frame>;
     using Branches = std::unordered_map<Uuid, RocksDBStore<Frame>>;
     using SharedPtr = std::shared_ptr<void>;
 
@@ -30,24 +33,74 @@ class RocksDBStore {
      * shared_ptr<void> works, thanks to type erasure.  */
     SharedPtr cf_;
 
-    RocksDBStore(SharedPtr db, SharedPtr cf)
-        : db_{std::move(db)}, cf_{std::move(cf)} {}
+    /** The frozen layers under cf_, see Fork(): the column families'
+     * SharedPtrs, the nearest first, and how far Flatten() got copying
+     * them up. nullptr if none. */
+    SharedPtr base_;
+
+    /** A split store's column families by record form (log, meta...),
+     * see ROCKSDB_FORM_FAMILIES; nullptr if all go to cf_. */
+    SharedPtr forms_;
+
+    RocksDBStore(SharedPtr db, SharedPtr cf, SharedPtr base = nullptr,
+                 SharedPtr forms = nullptr)
+        : db_{std::move(db)},
+          cf_{std::move(cf)},
+          base_{std::move(base)},
+          forms_{std::move(forms)} {}
 
    public:
     /** used by Commit and others to cache the last written event id */
     Uuid tip;
 
-    RocksDBStore() : db_{nullptr}, cf_{nullptr}, tip{} {}
+    RocksDBStore()
+        : db_{nullptr}, cf_{nullptr}, base_{nullptr}, forms_{nullptr}, tip{} {}
 
-    explicit RocksDBStore(SharedPtr db) : db_{std::move(db)}, cf_{nullptr} {}
+    explicit RocksDBStore(SharedPtr db)
+        : db_{std::move(db)}, cf_{nullptr}, base_{nullptr}, forms_{nullptr} {}
 
     inline SharedPtr db() const { return db_; }
 
+    /** A zero-copy read: the cursor runs over the db's own memory (block
+     * cache, memtable) that stays pinned while the object lives. May own
+     * a frame instead, e.g. a merged one. */
+    class Pinned {
+        std::shared_ptr<const void> pin_;
+        Slice data_;
+        friend class RocksDBStore;
+
+       public:
+        Pinned() : pin_{nullptr}, data_{} {}
+        inline Slice data() const { return data_; }
+        inline Cursor cursor() const { return Cursor{data_}; }
+        inline bool empty() const { return data_.empty(); }
+        void Own(const Frame& frame) { Own(std::make_shared<Frame>(frame)); }
+        /** Shares a frame, no copies */
+        void Own(std::shared_ptr<const Frame> frame) {
+            data_ = Slice{frame->data()};
+            pin_ = std::move(frame);
+        }
+        void Release() {
+            pin_.reset();
+            data_ = Slice{};
+        }
+    };
+
     class Iterator {
+        /** the range scan's bounds, the db iterators point into it */
+        SharedPtr bounds_;
         SharedPtr i_;
+        /** merges the layers' iterators, if the store has any */
+        SharedPtr layers_;
 
        public:
-        explicit Iterator(RocksDBStore& host);
+        /** @param same_prefix the iterator only needs keys of the seek
+         * key's yarn (see ROCKSDB_STORE_PROFILE); lets the db skip files
+         * by their prefix bloom filters. Full scans need the default. */
+        explicit Iterator(RocksDBStore& host, bool same_prefix = false);
+        /** A range scan: stops at range.till, reads ahead and fills
+         * the block cache as the range says. */
+        Iterator(RocksDBStore& host, const Range& range);
         Key key() const;
         Cursor value();
         Status Next();
@@ -57,6 +110,35 @@ class RocksDBStore {
     };
     friend class Iterator;
 
+    /** A change feed: the records committed to the store, batch by batch,
+     * in commit order, read off the db's write-ahead log (kept for
+     * ROCKSDB_WAL_TTL). Merges come as written, Puts (GC, read repair)
+     * as full states; either way, merging them in downstream is right.
+     * Follows the store through its forks: the new top's layer record is
+     * logged, see Fork(). Resumable: seq() after a batch is where to
+     * restart from. */
+    class Changes {
+        SharedPtr db_;
+        SharedPtr log_;
+        /** the column families the store writes or wrote to */
+        std::vector<uint32_t> cfs_;
+        /** the store's id, to tell its new top from the fork's */
+        Uuid store_;
+        uint64_t seq_;
+
+       public:
+        /** @param since a seq() of an earlier feed, 0 for the entire
+         * log kept */
+        explicit Changes(RocksDBStore& host, uint64_t since = 0);
+        /** the next sequence number to read */
+        inline uint64_t seq() const { return seq_; }
+        /** Reads the next committed batch having the store's records.
+         * @return ENDOFINPUT if caught up (call again later),
+         * NOT_FOUND if the log past seq() is gone already (resync) */
+        Status Next(Records& batch);
+    };
+    friend class Changes;
+
     inline bool open() const { return db_ != nullptr; }
 
     /**
@@ -67,18 +149,93 @@ class RocksDBStore {
      */
     Status Create(Uuid id);
 
+    /** Creates the store in the db at the dir, e.g. a shard's (see
+     * ShardedStore); ROCKSDB_STORE_DIR otherwise. */
+    Status Create(Uuid id, const String& dir);
+
     Status Open(Uuid id);
 
     static Status Repair();
 
-    static Status OpenAll(Branches& branches);
+    /**
+     * Forks the store in O(1) time and space, e.g. a branch or a snapshot.
+     * The current column family is frozen as a base layer shared by two
+     * new ones: this store's new top and the fork's. Reads fall through
+     * the layers (merging), writes go to the top; a Put could not hide
+     * the base layers' records, so a forked store refuses it till it is
+     * flat again, see Flatten(). A frozen layer is dropped once no store
+     * is on it. Split stores (ROCKSDB_FORM_FAMILIES) don't fork yet:
+     * NOT_IMPLEMENTED, copy them.
+     * @param fork a closed store on the same db, gets opened
+     */
+    Status Fork(Uuid fork_id, RocksDBStore& fork);
+
+    /** Whether reads fall through frozen layers, see Fork() */
+    inline bool layered() const { return base_ != nullptr; }
+
+    /** Copies the merged records of the frozen layers up into the top, in
+     * passes of `limit` keys (0: all), resuming where the last pass
+     * stopped; a Fork() starts over. Reads and writes may go on.
+     * @return ENDOFINPUT once all are copied, see DropBases() */
+    Status Flatten(size_t limit = 0);
+
+    /** Takes a Flatten()-ed store off its layers: reads hit one column
+     * family again, Put works. Swaps the layers under the readers, like
+     * Fork(). BAD_STATE if not flat yet. */
+    Status DropBases();
+
+    /** Opens all the stores (column families) of the db.
+     * @param read_only opens the db as of now, side by side with the
+     * process that writes it; writes fail, reopen to catch up */
+    static Status OpenAll(Branches& branches, bool read_only = false);
+
+    /** Opens all the stores of the db at the dir, see Create(id, dir) */
+    static Status OpenAll(Branches& branches, bool read_only,
+                          const String& dir);
 
     Status Write(Key key, const Frame& change);
 
     Status Read(Key key, Frame& result);
 
+    Status Read(Key key, Pinned& result);
+
+    /** Reads many keys in one db round trip (MultiGet, in key order).
+     * @param results same size as keys; empty frames for missing keys */
+    Status MultiRead(const Keys& keys, Frames& results);
+
     Status Write(const Records& batch);
 
+    /** Writes a batch straight off its arena, see InMemoryStore::Release.
+     * Concurrent callers are group-committed: one db write (and one WAL
+     * sync, see ROCKSDB_SYNC) per group, see ROCKSDB_GROUP_COMMIT_WINDOW.
+     * Each caller gets its own batch's status. */
+    Status Write(const ArenaBatch& batch);
+
+    /** Overwrites the record (Write merges into it), e.g. with a GC-ed
+     * state; NOT_IMPLEMENTED on a layered store, see Fork(). */
+    Status Put(Key key, const Frame& state);
+
+    /** Compacts the store, running the compaction-time GC. */
+    Status Compact();
+
+    /** The db's compaction stats (write amplification, sizes per level)
+     * for each of the store's column families, e.g. to compare split and
+     * plain stores. */
+    Status Stats(String& report);
+
+    /** Configures the compaction-time GC of object states (see
+     * MasterRDT::GC) for the stores of this store's db; off by default.
+     * Takes effect with the next compaction; safe to call while
+     * compactions run. GC-ed ops are gone for *log queries too.
+     * @param forms a mask of 1<<FORM bits, forms to collect
+     * @param stable the causal stability cutoff, ops every peer has */
+    Status SetCompactionGC(uint64_t forms, const VV& stable);
+
+    /** Merge operand counts seen by reads, a log2 histogram: counts[0]
+     * is reads that merged nothing, counts[i] is reads that merged
+     * [2^(i-1), 2^i) operands. Helps tune ROCKSDB_READ_REPAIR. */
+    static void ReadMergeHistogram(std::vector<uint64_t>& counts);
+
     Status Drop();
 
     Status Close();
@@ -88,6 +245,42 @@ class RocksDBStore {
 
 extern String ROCKSDB_STORE_DIR;
 
+/** The name of the db tuning profile to open the store with: "default",
+ * "point" (Get-heavy loads), "scan" (log/yarn scans) or "plain" (no
+ * filters, the pre-profile setup). All but "plain" key their prefix
+ * filters on the form+origin bytes of a Key, i.e. on yarns. */
+extern String ROCKSDB_STORE_PROFILE;
+
+/** Read repair: a read that had to merge more operands than that writes
+ * the merged value back (Put), so hot keys stay cheap to read till the
+ * next compaction. 0 to disable. */
+extern size_t ROCKSDB_READ_REPAIR;
+
+/** How long (seconds) the write-ahead log is kept for change feeds, see
+ * RocksDBStore::Changes; 0 to delete it once flushed. */
+extern uint64_t ROCKSDB_WAL_TTL;
+
+/** The cap (megabytes) on the write-ahead log kept, 0 for none. */
+extern uint64_t ROCKSDB_WAL_LIMIT_MB;
+
+/** Sync the WAL on every write (group). Off by default, like rocksdb. */
+extern bool ROCKSDB_SYNC;
+
+/** Group commit: how long (microseconds) the first batch of a group
+ * waits for others to join. 0 groups only the batches that queued while
+ * the previous group was written, adding no latency. */
+extern size_t ROCKSDB_GROUP_COMMIT_WINDOW;
+
+/** Group commit: the group size (bytes) to stop waiting, and to cap
+ * the group at. */
+extern size_t ROCKSDB_GROUP_COMMIT_BYTES;
+
+/** New stores get their records split over column families by form:
+ * object logs and chains (universal compaction, zstd), op meta (whole
+ * key bloom filters, lz4), the rest, i.e. states and the tip (leveled,
+ * lz4). Off by default; existing stores stay as they were created. */
+extern bool ROCKSDB_FORM_FAMILIES;
+
 }  // namespace ron
 
 #endif
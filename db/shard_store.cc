@@ -0,0 +1,301 @@
+#include "shard_store.hpp"
+
+namespace ron {
+
+std::vector<String> SHARD_STORE_DIRS{".swarmdb"};
+
+template <typename Frame>
+ShardedStore<Frame>::ShardedStore(SharedPtr db) : shards_{}, tip{} {
+    if (!db) return;
+    for (auto& one : *std::static_pointer_cast<std::vector<SharedPtr>>(db)) {
+        shards_.emplace_back(one);
+    }
+}
+
+template <typename Frame>
+typename ShardedStore<Frame>::SharedPtr ShardedStore<Frame>::db() const {
+    if (shards_.empty()) return nullptr;
+    auto dbs = std::make_shared<std::vector<SharedPtr>>();
+    for (auto& shard : shards_) dbs->push_back(shard.db());
+    return dbs;
+}
+
+template <typename Frame>
+size_t ShardedStore<Frame>::shard_of(const Key& key, size_t shards) {
+    // origins are left-aligned base64, so mix all the bits (splitmix64)
+    uint64_t h = key.id().origin()._64;
+    h = (h ^ (h >> 30U)) * 0xBF58476D1CE4E5B9UL;
+    h = (h ^ (h >> 27U)) * 0x94D049BB133111EBUL;
+    return (h ^ (h >> 31U)) % shards;
+}
+
+//  S T O R E
+
+template <typename Frame>
+Status ShardedStore<Frame>::Create(Uuid id) {
+    if (shards_.empty()) {
+        if (SHARD_STORE_DIRS.empty()) {
+            return Status::BADARGS.comment("no shard dirs");
+        }
+        std::vector<Shard> shards(SHARD_STORE_DIRS.size());
+        for (size_t i = 0; i < shards.size(); ++i) {
+            IFOK(shards[i].Create(id, SHARD_STORE_DIRS[i]));
+        }
+        shards_ = std::move(shards);
+    } else {
+        for (auto& shard : shards_) {
+            IFOK(shard.Create(id));
+        }
+    }
+    tip = Uuid::NIL;
+    return Status::OK;
+}
+
+template <typename Frame>
+Status ShardedStore<Frame>::OpenAll(Branches& branches, bool read_only) {
+    if (SHARD_STORE_DIRS.empty()) {
+        return Status::BADARGS.comment("no shard dirs");
+    }
+    std::vector<typename Shard::Branches> opened(SHARD_STORE_DIRS.size());
+    for (size_t i = 0; i < opened.size(); ++i) {
+        IFOK(Shard::OpenAll(opened[i], read_only, SHARD_STORE_DIRS[i]));
+    }
+    branches.clear();
+    for (auto& p : opened.front()) {
+        std::vector<Shard> shards{p.second};
+        for (size_t i = 1; i < opened.size(); ++i) {
+            auto in = opened[i].find(p.first);
+            if (in == opened[i].end()) break;
+            shards.push_back(in->second);
+        }
+        if (shards.size() == opened.size()) {
+            branches.emplace(p.first, ShardedStore{std::move(shards)});
+        }
+    }
+    return Status::OK;
+}
+
+template <typename Frame>
+Status ShardedStore<Frame>::Fork(Uuid fork_id, ShardedStore& fork) {
+    if (shards_.empty()) return Status::BAD_STATE.comment("closed");
+    if (fork.shards_.size() != shards_.size()) {
+        return Status::BADARGS.comment("not on the same shards");
+    }
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        IFOK(shards_[i].Fork(fork_id, fork.shards_[i]));
+    }
+    fork.tip = Uuid::NIL;
+    return Status::OK;
+}
+
+template <typename Frame>
+Status ShardedStore<Frame>::Flatten(size_t limit) {
+    if (shards_.empty()) return Status::BAD_STATE.comment("closed");
+    for (auto& shard : shards_) {
+        Status ok = shard.Flatten(limit);
+        if (ok != Status::ENDOFINPUT) return ok;
+    }
+    return Status::ENDOFINPUT;
+}
+
+template <typename Frame>
+Status ShardedStore<Frame>::MultiRead(const Keys& keys, Frames& results) {
+    if (shards_.empty()) return Status::BAD_STATE.comment("closed");
+    results.clear();
+    results.resize(keys.size());
+    std::vector<Keys> split(shards_.size());
+    std::vector<std::vector<size_t>> at(shards_.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        size_t s = shard_of(keys[i], shards_.size());
+        split[s].push_back(keys[i]);
+        at[s].push_back(i);
+    }
+    Frames read;
+    for (size_t s = 0; s < shards_.size(); ++s) {
+        if (split[s].empty()) continue;
+        IFOK(shards_[s].MultiRead(split[s], read));
+        for (size_t j = 0; j < at[s].size(); ++j) {
+            std::swap(results[at[s][j]], read[j]);
+        }
+    }
+    return Status::OK;
+}
+
+template <typename Frame>
+Status ShardedStore<Frame>::Write(const Records& batch) {
+    if (shards_.empty()) return Status::BAD_STATE.comment("closed");
+    if (batch.empty()) return Status::OK;
+    size_t first = shard_of(batch.front().first, shards_.size());
+    bool one = true;
+    for (auto& rec : batch) {
+        if (shard_of(rec.first, shards_.size()) != first) {
+            one = false;
+            break;
+        }
+    }
+    if (one) {  // no copies
+        return shards_[first].Write(batch);
+    }
+    std::vector<Records> split(shards_.size());
+    for (auto& rec : batch) {
+        split[shard_of(rec.first, shards_.size())].push_back(rec);
+    }
+    // the tip record's shard goes last: a batch cut short by an error
+    // or a crash never advances the tip past ops that did not land
+    size_t last = shard_of(Key::ZERO, shards_.size());
+    for (size_t s = 0; s < shards_.size(); ++s) {
+        if (s == last || split[s].empty()) continue;
+        IFOK(shards_[s].Write(split[s]));
+    }
+    return split[last].empty() ? Status::OK : shards_[last].Write(split[last]);
+}
+
+template <typename Frame>
+Status ShardedStore<Frame>::Write(const ArenaBatch& batch) {
+    if (shards_.empty()) return Status::BAD_STATE.comment("closed");
+    // the parts reference the batch's arena, which outlives them
+    std::vector<ArenaBatch> split(shards_.size());
+    for (auto& rec : batch.records) {
+        split[shard_of(rec.first, shards_.size())].records.push_back(rec);
+    }
+    size_t last = shard_of(Key::ZERO, shards_.size());  // see above
+    for (size_t s = 0; s < shards_.size(); ++s) {
+        if (s == last || split[s].records.empty()) continue;
+        IFOK(shards_[s].Write(split[s]));
+    }
+    return split[last].records.empty() ? Status::OK
+                                       : shards_[last].Write(split[last]);
+}
+
+template <typename Frame>
+Status ShardedStore<Frame>::Compact() {
+    for (auto& shard : shards_) {
+        IFOK(shard.Compact());
+    }
+    return Status::OK;
+}
+
+template <typename Frame>
+Status ShardedStore<Frame>::Stats(String& report) {
+    if (shards_.empty()) return Status::BAD_STATE.comment("closed");
+    report.clear();
+    String one;
+    for (size_t s = 0; s < shards_.size(); ++s) {
+        IFOK(shards_[s].Stats(one));
+        report += "shard " + std::to_string(s) + '\n' + one;
+    }
+    return Status::OK;
+}
+
+template <typename Frame>
+Status ShardedStore<Frame>::Drop() {
+    for (auto& shard : shards_) {
+        IFOK(shard.Drop());
+    }
+    shards_.clear();
+    return Status::OK;
+}
+
+template <typename Frame>
+Status ShardedStore<Frame>::Close() {
+    if (shards_.empty()) return Status::BAD_STATE.comment("already closed");
+    for (auto& shard : shards_) shard.Close();
+    shards_.clear();
+    return Status::OK;
+}
+
+//  I T E R A T O R
+
+template <typename Frame>
+ShardedStore<Frame>::Iterator::Iterator(ShardedStore& host, bool same_prefix)
+    : its_{}, at_{Key::END} {
+    its_.reserve(host.shards_.size());
+    for (auto& shard : host.shards_) {
+        its_.emplace_back(shard, same_prefix);
+    }
+}
+
+template <typename Frame>
+ShardedStore<Frame>::Iterator::Iterator(ShardedStore& host,
+                                        const Range& range)
+    : its_{}, at_{Key::END} {
+    its_.reserve(host.shards_.size());
+    for (auto& shard : host.shards_) {
+        its_.emplace_back(shard, range);
+    }
+}
+
+template <typename Frame>
+void ShardedStore<Frame>::Iterator::pick() {
+    at_ = Key::END;
+    for (auto& i : its_) {
+        if (i.key() < at_) at_ = i.key();
+    }
+}
+
+template <typename Frame>
+typename Frame::Cursor ShardedStore<Frame>::Iterator::value() {
+    if (at_ == Key::END) {
+        return Cursor{""};
+    }
+    // the owner's record, e.g. of the tip (Key::ZERO)
+    auto& owner = its_[shard_of(at_, its_.size())];
+    if (owner.key() == at_) {
+        return owner.value();
+    }
+    for (auto& i : its_) {
+        if (i.key() == at_) return i.value();
+    }
+    return Cursor{""};
+}
+
+template <typename Frame>
+Status ShardedStore<Frame>::Iterator::Next() {
+    if (at_ == Key::END) {
+        return Status::ENDOFINPUT;
+    }
+    // shards end one by one
+    for (auto& i : its_) {
+        if (i.key() != at_) continue;
+        Status ok = i.Next();
+        if (!ok && ok != Status::ENDOFINPUT) return ok;
+    }
+    pick();
+    return at_ == Key::END ? Status::ENDOFINPUT : Status::OK;
+}
+
+template <typename Frame>
+Status ShardedStore<Frame>::Iterator::SeekTo(Key key, bool prev) {
+    for (auto& i : its_) {
+        IFOK(i.SeekTo(key, prev));
+    }
+    if (prev) {
+        // the greatest key not above, then every shard to it, so Next()
+        // steps forward in all of them
+        Key last = Key::END;
+        bool found = false;
+        for (auto& i : its_) {
+            if (i.key() == Key::END) continue;
+            if (!found || last < i.key()) last = i.key();
+            found = true;
+        }
+        if (found) {
+            for (auto& i : its_) {
+                IFOK(i.SeekTo(last));
+            }
+        }
+    }
+    pick();
+    return Status::OK;
+}
+
+template <typename Frame>
+Status ShardedStore<Frame>::Iterator::Close() {
+    for (auto& i : its_) i.Close();
+    at_ = Key::END;
+    return Status::OK;
+}
+
+template class ShardedStore<TextFrame>;
+
+}  // namespace ron
@@ -0,0 +1,177 @@
+#ifndef RON_SHARD_STORE_HPP
+#define RON_SHARD_STORE_HPP
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../rdt/rdt.hpp"
+#include "../ron/ron.hpp"
+#include "arena.hpp"
+#include "key.hpp"
+#include "rocks_store.hpp"
+
+namespace ron {
+
+/**
+ * A store partitioned over several RocksDB instances, one per dir in
+ * SHARD_STORE_DIRS, e.g. one per disk, so ingest scales with the device
+ * count: each db has its own write path and compaction threads.
+ * A record goes to the shard picked by the hash of its key's origin, so
+ * a yarn (chains, op meta of one origin) stays in one shard. Every store
+ * (branch) is a column family in every shard.
+ * Batches are split per shard: atomic within a shard, not across them.
+ * The part with the tip record (Key::ZERO) is written last, so a batch
+ * cut short leaves the tip behind; the ops that did land are not rolled
+ * back, they merge again once the commit is redone.
+ * The shard count is fixed once the replica is created.
+ */
+template <class FrameP>
+class ShardedStore {
+   public:
+    using Frame = FrameP;
+    using Shard = RocksDBStore<Frame>;
+    using Cursor = typename Frame::Cursor;
+    using Builder = typename Frame::Builder;
+    using Record = std::pair<Key, Frame>;
+    using Records = std::vector<Record>;
+    using Keys = std::vector<Key>;
+    using Frames = std::vector<Frame>;
+    using Branches = std::unordered_map<Uuid, ShardedStore<Frame>>;
+    using SharedPtr = std::shared_ptr<void>;
+    using Pinned = typename Shard::Pinned;
+
+   private:
+    /** the store's column family in each shard, in SHARD_STORE_DIRS
+     * order */
+    std::vector<Shard> shards_;
+
+    explicit ShardedStore(std::vector<Shard> shards)
+        : shards_{std::move(shards)}, tip{} {}
+
+    inline Shard& shard(const Key& key) {
+        return shards_[shard_of(key, shards_.size())];
+    }
+
+   public:
+    /** used by Commit and others to cache the last written event id */
+    Uuid tip;
+
+    ShardedStore() : shards_{}, tip{} {}
+
+    /** @param db the shards' dbs, see db() */
+    explicit ShardedStore(SharedPtr db);
+
+    /** the shards' dbs, a vector of RocksDBStore::db() */
+    SharedPtr db() const;
+
+    /** @return the shard the key's record goes to: a hash of the key's
+     * origin, so all the keys of a yarn land in one shard */
+    static size_t shard_of(const Key& key, size_t shards);
+
+    /** Merges the shards' iterators (k-way, by key). A key is in one
+     * shard, except for Key::ZERO (every shard has one, see Create). */
+    class Iterator {
+        std::vector<typename Shard::Iterator> its_;
+        Key at_;
+
+        void pick();
+
+       public:
+        explicit Iterator(ShardedStore& host, bool same_prefix = false);
+        /** A range scan of every shard, see Range */
+        Iterator(ShardedStore& host, const Range& range);
+        Key key() const { return at_; }
+        Cursor value();
+        Status Next();
+        Status SeekTo(Key key, bool prev = false);
+        Status Close();
+    };
+    friend class Iterator;
+
+    inline bool open() const { return !shards_.empty(); }
+
+    /** Creates the store in every shard, creating the dbs in
+     * SHARD_STORE_DIRS if not open. */
+    Status Create(Uuid id);
+
+    Status Open(Uuid id) {
+        return Status::NOT_IMPLEMENTED.comment("use OpenAll for now");
+    }
+
+    /** Opens all the stores of all the shards; a store missing in some
+     * shard (an interrupted Create) is skipped. */
+    static Status OpenAll(Branches& branches, bool read_only = false);
+
+    /** Forks the store in every shard, see RocksDBStore::Fork
+     * @param fork a closed store on the same dbs, gets opened */
+    Status Fork(Uuid fork_id, ShardedStore& fork);
+
+    inline bool layered() const {
+        for (auto& shard : shards_) {
+            if (shard.layered()) return true;
+        }
+        return false;
+    }
+
+    /** Flattens the shards in turn, see RocksDBStore::Flatten */
+    Status Flatten(size_t limit = 0);
+
+    Status DropBases() {
+        for (auto& shard : shards_) {
+            IFOK(shard.DropBases());
+        }
+        return Status::OK;
+    }
+
+    Status Write(Key key, const Frame& change) {
+        return shard(key).Write(key, change);
+    }
+
+    Status Read(Key key, Frame& result) { return shard(key).Read(key, result); }
+
+    Status Read(Key key, Pinned& result) {
+        return shard(key).Read(key, result);
+    }
+
+    /** One MultiRead per shard, see RocksDBStore::MultiRead */
+    Status MultiRead(const Keys& keys, Frames& results);
+
+    Status Write(const Records& batch);
+
+    /** Every shard's part of the batch is group-committed in that shard,
+     * see RocksDBStore::Write(const ArenaBatch&) */
+    Status Write(const ArenaBatch& batch);
+
+    Status Put(Key key, const Frame& state) {
+        return shard(key).Put(key, state);
+    }
+
+    Status Compact();
+
+    /** The shards' reports, see RocksDBStore::Stats */
+    Status Stats(String& report);
+
+    /** Sets every shard's, see RocksDBStore::SetCompactionGC */
+    Status SetCompactionGC(uint64_t forms, const VV& stable) {
+        for (auto& shard : shards_) {
+            IFOK(shard.SetCompactionGC(forms, stable));
+        }
+        return Status::OK;
+    }
+
+    static void ReadMergeHistogram(std::vector<uint64_t>& counts) {
+        Shard::ReadMergeHistogram(counts);
+    }
+
+    Status Drop();
+
+    Status Close();
+};
+
+/** The shards' db dirs, one per RocksDB instance (put them on separate
+ * disks). One dir by default, i.e. a plain RocksDBStore layout. */
+extern std::vector<String> SHARD_STORE_DIRS;
+
+}  // namespace ron
+
+#endif
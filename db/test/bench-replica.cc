@@ -0,0 +1,141 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include "../fs.hpp"
+#include "../replica.hpp"
+
+using namespace ron;
+using namespace std;
+
+using Frame = TextFrame;
+using Builder = Frame::Builder;
+using Cursor = Frame::Cursor;
+using BenchReplica = Replica<RocksDBStore<Frame>>;
+
+/** Read/write scaling of a shared Replica, 1 to 32 threads. Every
+ * thread works on one of BRANCHES branches (thread % BRANCHES), so up
+ * to BRANCHES writers do not queue behind each other. Runs:
+ *   read   all the threads query an object
+ *   write  all the threads write an object, a commit per op
+ *   mixed  even threads write, odd ones read
+ * Usage: bench01-replica [ms per run, 1000 by default] */
+
+constexpr int BRANCHES = 8;
+constexpr int OBJECTS = 64;
+
+struct Bench {
+    BenchReplica replica;
+    vector<Word> yarns;
+    vector<vector<Uuid>> objects;
+};
+
+/** see Stamp() in replica.cc */
+Uuid Stamp(BenchReplica& replica, Word yarn) {
+    replica.Now(yarn);
+    return replica.Now(yarn);
+}
+
+Status Setup(Bench& bench) {
+    IFOK(BenchReplica::CreateReplica());
+    IFOK(bench.replica.Open());
+    for (int b = 0; b < BRANCHES; ++b) {
+        Word yarn{String{"bench"} + char('A' + b)};
+        IFOK(bench.replica.CreateBranch(yarn, true));
+        Builder create;
+        vector<Uuid> objects;
+        for (int o = 0; o < OBJECTS; ++o) {
+            objects.push_back(Stamp(bench.replica, yarn));
+            create.AppendNewOp(objects.back(), LWW_FORM_UUID);
+            create.EndChunk();
+        }
+        Builder resp;
+        IFOK(bench.replica.ReceiveFrame(resp, create.Release(), yarn));
+        bench.yarns.push_back(yarn);
+        bench.objects.push_back(objects);
+    }
+    return Status::OK;
+}
+
+Status Read(Bench& bench, int branch, Uuid object) {
+    Builder query;
+    query.AppendNewOp(object, LWW_FORM_UUID);
+    query.EndChunk(QUERY);
+    Builder resp;
+    return bench.replica.ReceiveFrame(resp, query.Release(),
+                                      bench.yarns[branch]);
+}
+
+Status Write(Bench& bench, int branch, Uuid object, int64_t value) {
+    Word yarn = bench.yarns[branch];
+    Status ok;
+    do {  // stamped out of the queue order? restamp
+        Builder write;
+        write.AppendNewOp(Stamp(bench.replica, yarn), object, String{"x"},
+                          value);
+        Builder resp;
+        ok = bench.replica.ReceiveFrame(resp, write.Release(), yarn);
+    } while (ok == Status::CAUSEBREAK);
+    return ok;
+}
+
+enum workload_t { READ, WRITE, MIXED };
+
+/** @return the reads and the writes done, per second */
+pair<double, double> Run(Bench& bench, int threads, workload_t mode,
+                         chrono::milliseconds length) {
+    atomic<bool> running{true};
+    atomic<uint64_t> reads{0}, writes{0};
+    atomic<size_t> failed{0};
+    vector<thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            bool writer = mode == WRITE || (mode == MIXED && t % 2 == 0);
+            int branch = t % BRANCHES;
+            const auto& objects = bench.objects[branch];
+            uint64_t n = 0;
+            while (running) {
+                Uuid object = objects[(n * 7 + t) % objects.size()];
+                Status ok = writer ? Write(bench, branch, object, int64_t(n))
+                                   : Read(bench, branch, object);
+                if (!ok) ++failed;
+                ++n;
+            }
+            (writer ? writes : reads) += n;
+        });
+    }
+    auto start = chrono::steady_clock::now();
+    this_thread::sleep_for(length);
+    running = false;
+    for (auto& w : workers) w.join();
+    double secs = chrono::duration<double>(chrono::steady_clock::now() -
+                                           start).count();
+    if (failed) {
+        fprintf(stderr, "%zu ops failed\n", size_t{failed});
+    }
+    return make_pair(reads / secs, writes / secs);
+}
+
+int main(int argc, char** argv) {
+    chrono::milliseconds length{argc > 1 ? atol(argv[1]) : 1000};
+    TmpDir tmp;
+    tmp.cd("BenchReplica");
+    Bench bench;
+    Status ok = Setup(bench);
+    if (!ok) {
+        fprintf(stderr, "setup: %s\n", ok.str().c_str());
+        return 1;
+    }
+    printf("%8s %12s %12s %12s %12s\n", "threads", "read/s", "write/s",
+           "mixed r/s", "mixed w/s");
+    for (int threads = 1; threads <= 32; threads *= 2) {
+        auto read = Run(bench, threads, READ, length);
+        auto write = Run(bench, threads, WRITE, length);
+        auto mixed = Run(bench, threads, MIXED, length);
+        printf("%8d %12.0f %12.0f %12.0f %12.0f\n", threads, read.first,
+               write.second, mixed.first, mixed.second);
+    }
+    bench.replica.Close();
+    return 0;
+}
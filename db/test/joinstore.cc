@@ -73,6 +73,54 @@ TEST(JoinStore, Merge) {
     assert(CompareFrames(m, _m));
 }
 
+TEST(JoinStore, MultiRead) {
+    MemStore storeA, storeB;
+    TwoMemStore storeAB{storeA, storeB};
+    Frame a{"@1+A :lww 'int' 1;"}, b{"@2+A :1+A 'string' 'str';"},
+        c{"@1+B :lww 'x' 2;"};
+    Frame m{"@1+A :lww 'int' 1, @2+A 'string' 'str';"};
+    Key key{Uuid{"1+A"}, LWW_FORM_UUID}, key2{Uuid{"1+B"}, LWW_FORM_UUID},
+        none{Uuid{"1+C"}, LWW_FORM_UUID};
+    ASSERT_TRUE(IsOK(storeA.Write(key, a)));
+    ASSERT_TRUE(IsOK(storeB.Write(key, b)));
+    ASSERT_TRUE(IsOK(storeA.Write(key2, c)));
+    ASSERT_TRUE(IsOK(storeAB.Prefetch({key2, none})));
+    TwoMemStore::Frames frames;
+    ASSERT_TRUE(IsOK(storeAB.MultiRead({none, key2, key}, frames)));
+    ASSERT_EQ(frames.size(), 3);
+    ASSERT_TRUE(frames[0].empty());
+    ASSERT_TRUE(IsOK(CompareFrames(c, frames[1])));
+    ASSERT_TRUE(IsOK(CompareFrames(m, frames[2])));
+    // prefetched records are served from the cache
+    ASSERT_TRUE(IsOK(storeA.Write(key2, a)));
+    Frame _c;
+    ASSERT_TRUE(IsOK(storeAB.Read(key2, _c)));
+    ASSERT_TRUE(IsOK(CompareFrames(c, _c)));
+}
+
+TEST(JoinStore, MergeCache) {
+    MemStore storeA, storeB;
+    TwoMemStore storeAB{storeA, storeB};
+    Frame a{"@1+A :lww 'int' 1;"}, b{"@2+A :1+A 'string' 'str';"},
+        c{"@3+A :2+A 'more' 3;"};
+    Frame m{"@1+A :lww 'int' 1, @2+A 'string' 'str';"};
+    Frame m2{"@1+A :lww 'int' 1, @2+A 'string' 'str', @3+A 'more' 3;"};
+    Key key{Uuid{"1+A"}, LWW_FORM_UUID};
+    ASSERT_TRUE(IsOK(storeA.Write(key, a)));
+    ASSERT_TRUE(IsOK(storeAB.Write(key, b)));
+    Frame _m;
+    ASSERT_TRUE(IsOK(storeAB.Read(key, _m)));
+    ASSERT_TRUE(IsOK(CompareFrames(m, _m)));
+    // the merge is cached...
+    ASSERT_TRUE(IsOK(storeA.Write(key, c)));
+    ASSERT_TRUE(IsOK(storeAB.Read(key, _m)));
+    ASSERT_TRUE(IsOK(CompareFrames(m, _m)));
+    // ...till a write to the key
+    ASSERT_TRUE(IsOK(storeAB.Write(key, c)));
+    ASSERT_TRUE(IsOK(storeAB.Read(key, _m)));
+    ASSERT_TRUE(IsOK(CompareFrames(m2, _m)));
+}
+
 TEST (JoinStore, Iterator) {
     String A{"@1+A :lww 'int' 1;"};
     String B{"@2+A :1+A 'string' 'str';"};
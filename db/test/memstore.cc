@@ -111,6 +111,26 @@ TEST (MemStore, Iterator) {
     //assert(CompareFrames(m, (*j).second));
 }
 
+TEST (MemStore, Release) {
+    MemStore store;
+    Frame a{"@1+A :lww 'int' 1;"}, b{"@2+A :1+A 'string' 'str';"};
+    for (int i = 0; i < 1000; ++i) {
+        Key key{Uuid::Time(Word{uint64_t(i + 1)}, Word{"A"}), LWW_FORM_UUID};
+        ASSERT_TRUE(IsOK(store.Write(key, a)));
+    }
+    Key key{Uuid{"1+A"}, LWW_FORM_UUID};
+    ASSERT_TRUE(IsOK(store.Write(key, b)));
+    ArenaBatch batch;
+    ASSERT_TRUE(store.Release(batch));
+    ASSERT_EQ(batch.records.size(), 1001);
+    ASSERT_LT(batch.arena.slabs(), 4);  // a few allocations, not 1001
+    ASSERT_TRUE(batch.records.front().second == Slice{a.data()});
+    Frame read;
+    ASSERT_TRUE(IsOK(store.Read(key, read)));
+    ASSERT_TRUE(read.empty());
+    ASSERT_FALSE(store.Release(batch));
+}
+
 int main (int argc, char** args) {
     ::testing::InitGoogleTest(&argc, args);
     return RUN_ALL_TESTS();
@@ -0,0 +1,219 @@
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
+#include "../mmap_store.hpp"
+#include "testutil.hpp"
+
+using namespace ron;
+using namespace std;
+
+using Frame = TextFrame;
+using Store = MmapStore<TextFrame>;
+using Iterator = typename Store::Iterator;
+
+TEST(MmapStore, Ends) {
+    TmpDir tmp;
+    tmp.cd("MmapEnds");
+    Store store;
+    ASSERT_TRUE(IsOK(store.Create(Uuid::NIL)));
+    Frame frame;
+    ASSERT_TRUE(IsOK(store.Read(Key{}, frame)));
+    ASSERT_FALSE(frame.empty());
+    ASSERT_TRUE(IsOK(store.Read(Key::END, frame)));
+    ASSERT_TRUE(frame.empty());
+    ASSERT_FALSE(IsOK(store.Write(Key::END, frame)));
+
+    Iterator i{store};
+    ASSERT_EQ(i.key(), Key::END);
+    ASSERT_FALSE(i.value().valid());
+    ASSERT_TRUE(IsOK(i.SeekTo(Key::END, true)));
+    ASSERT_EQ(i.key(), Key{});
+    ASSERT_TRUE(i.value().valid());
+    ASSERT_TRUE(i.Next() == Status::ENDOFINPUT);
+    ASSERT_EQ(i.key(), Key::END);
+}
+
+TEST(MmapStore, MergePut) {
+    TmpDir tmp;
+    tmp.cd("MmapMergePut");
+    Store store;
+    ASSERT_TRUE(IsOK(store.Create(Uuid::NIL)));
+    Frame a{"@1+A :lww 'int' 1;"}, b{"@2+A :1+A 'string' 'str';"};
+    Frame merged{"@1+A :lww 'int' 1, @2+A 'string' 'str';"};
+    Frame c{"@3+A :lww 'int' 3;"};
+    Key key{Uuid{"1+A"}, LWW_FORM_UUID};
+    ASSERT_TRUE(IsOK(store.Write(key, a)));
+    ASSERT_TRUE(IsOK(store.Write(key, b)));
+    Frame read;
+    ASSERT_TRUE(IsOK(store.Read(key, read)));
+    ASSERT_TRUE(IsOK(CompareFrames(merged, read)));
+    ASSERT_TRUE(IsOK(store.Put(key, c)));
+    ASSERT_TRUE(IsOK(store.Read(key, read)));
+    ASSERT_TRUE(IsOK(CompareFrames(c, read)));
+}
+
+TEST(MmapStore, CompactReopen) {
+    TmpDir tmp;
+    tmp.cd("MmapCompactReopen");
+    Uuid id{"1+A"};
+    Frame a{"@1+A :lww 'int' 1;"}, b{"@2+A :1+A 'string' 'str';"};
+    Frame d{"@3+A :2+A 'more' 3;"};
+    Frame merged{"@1+A :lww 'int' 1, @2+A 'string' 'str';"};
+    Frame more{"@1+A :lww 'int' 1, @2+A 'string' 'str', @3+A 'more' 3;"};
+    Key key{Uuid{"1+A"}, LWW_FORM_UUID};
+    Key other{Uuid{"1+B"}, LWW_FORM_UUID};
+    Store::Pinned pinned;
+    {
+        Store store;
+        ASSERT_TRUE(IsOK(store.Create(Uuid::NIL)));
+        Store branch{store.db()};
+        ASSERT_TRUE(IsOK(branch.Create(id)));
+        ASSERT_FALSE(IsOK(Store{store.db()}.Create(id)));
+        ASSERT_TRUE(IsOK(branch.Write(key, a)));
+        ASSERT_TRUE(IsOK(branch.Write(key, b)));
+        ASSERT_TRUE(IsOK(branch.Compact()));
+        // compacted => zero-copy, survives the next compaction
+        ASSERT_TRUE(IsOK(branch.Read(key, pinned)));
+        ASSERT_TRUE(IsOK(branch.Write(other, a)));
+        ASSERT_TRUE(IsOK(branch.Write(key, d)));
+        ASSERT_TRUE(IsOK(branch.Compact()));
+        ASSERT_TRUE(IsOK(CompareWithCursors(merged.cursor(), pinned.cursor())));
+        ASSERT_TRUE(IsOK(branch.Put(other, b)));  // the tail
+    }
+    Store::Branches branches;
+    ASSERT_TRUE(IsOK(Store::OpenAll(branches)));
+    ASSERT_EQ(branches.size(), 2);
+    ASSERT_TRUE(branches.find(Uuid::NIL) != branches.end());
+    Store& branch = branches[id];
+    Frame read;
+    ASSERT_TRUE(IsOK(branch.Read(key, read)));
+    ASSERT_TRUE(IsOK(CompareFrames(more, read)));
+    ASSERT_TRUE(IsOK(branch.Read(other, read)));
+    ASSERT_TRUE(IsOK(CompareFrames(b, read)));
+
+    Iterator i{branch};
+    ASSERT_TRUE(IsOK(i.SeekTo(Key{})));
+    ASSERT_EQ(i.key(), Key{});
+    ASSERT_TRUE(IsOK(i.Next()));
+    ASSERT_EQ(i.key(), key);
+    ASSERT_TRUE(IsOK(CompareWithCursors(more.cursor(), i.value())));
+    ASSERT_TRUE(IsOK(i.Next()));
+    ASSERT_EQ(i.key(), other);
+    ASSERT_TRUE(IsOK(CompareWithCursors(b.cursor(), i.value())));
+    ASSERT_TRUE(i.Next() == Status::ENDOFINPUT);
+    ASSERT_TRUE(IsOK(i.SeekTo(other, true)));
+    ASSERT_EQ(i.key(), other);
+    ASSERT_TRUE(IsOK(i.SeekTo(Key{Uuid{"1+AA"}, LWW_FORM_UUID}, true)));
+    ASSERT_EQ(i.key(), key);
+
+    ASSERT_TRUE(IsOK(branch.Drop()));
+    ASSERT_TRUE(IsOK(Store::OpenAll(branches)));
+    ASSERT_EQ(branches.size(), 1);
+}
+
+TEST(MmapStore, LazyOpen) {
+    TmpDir tmp;
+    tmp.cd("MmapLazyOpen");
+    Tunable<size_t> limit{MMAP_STORE_OPEN_LIMIT, 1};
+    Uuid ids[] = {Uuid{"1+A"}, Uuid{"1+B"}, Uuid{"1+C"}};
+    Frame a{"@1+A :lww 'int' 1;"}, b{"@2+A :1+A 'string' 'str';"};
+    Frame merged{"@1+A :lww 'int' 1, @2+A 'string' 'str';"};
+    Key key{Uuid{"1+A"}, LWW_FORM_UUID};
+    {
+        Store meta;
+        ASSERT_TRUE(IsOK(meta.Create(Uuid::NIL)));
+        for (auto id : ids) {
+            Store branch{meta.db()};
+            ASSERT_TRUE(IsOK(branch.Create(id)));
+            ASSERT_TRUE(IsOK(branch.Write(key, a)));
+        }
+    }
+    Store::Branches branches;
+    ASSERT_TRUE(IsOK(Store::OpenAll(branches)));
+    ASSERT_EQ(branches.size(), 4);
+    // every write evicts the previous store; the tail survives that
+    for (auto id : ids) {
+        ASSERT_TRUE(IsOK(branches[id].Write(key, b)));
+    }
+    Iterator i{branches[ids[0]]};
+    ASSERT_TRUE(IsOK(i.SeekTo(Key{})));
+    Frame read;
+    for (auto id : ids) {
+        ASSERT_TRUE(IsOK(branches[id].Read(key, read)));
+        ASSERT_TRUE(IsOK(CompareFrames(merged, read)));
+    }
+    ASSERT_TRUE(IsOK(i.Next()));
+    ASSERT_EQ(i.key(), key);
+    ASSERT_TRUE(IsOK(CompareWithCursors(merged.cursor(), i.value())));
+}
+
+TEST(MmapStore, ReadOnly) {
+    TmpDir tmp;
+    tmp.cd("MmapReadOnly");
+    Frame a{"@1+A :lww 'int' 1;"}, b{"@2+A :1+A 'string' 'str';"};
+    Key key{Uuid{"1+A"}, LWW_FORM_UUID};
+    Store writer;
+    ASSERT_TRUE(IsOK(writer.Create(Uuid::NIL)));
+    ASSERT_TRUE(IsOK(writer.Write(key, a)));
+    Store::Branches readers;
+    ASSERT_TRUE(IsOK(Store::OpenAll(readers, true)));
+    Frame read;
+    ASSERT_TRUE(IsOK(readers[Uuid::NIL].Read(key, read)));
+    ASSERT_TRUE(IsOK(CompareFrames(a, read)));
+    ASSERT_FALSE(IsOK(readers[Uuid::NIL].Write(key, b)));
+    ASSERT_FALSE(IsOK(readers[Uuid::NIL].Compact()));
+    // the writer is not disturbed
+    ASSERT_TRUE(IsOK(writer.Write(key, b)));
+}
+
+TEST(MmapStore, TornLog) {
+    TmpDir tmp;
+    tmp.cd("MmapTornLog");
+    Frame a{"@1+A :lww 'int' 1;"}, b{"@2+A :1+A 'string' 'str';"};
+    Frame merged{"@1+A :lww 'int' 1, @2+A 'string' 'str';"};
+    Key ka{Uuid{"1+A"}, LWW_FORM_UUID}, kb{Uuid{"1+B"}, LWW_FORM_UUID};
+    String log = MMAP_STORE_DIR + '/' + Uuid::NIL.str() + ".log";
+    struct stat st {};
+    {
+        Store store;
+        ASSERT_TRUE(IsOK(store.Create(Uuid::NIL)));
+        ASSERT_TRUE(IsOK(store.Write(Store::Records{{ka, a}, {kb, a}})));
+        ASSERT_EQ(stat(log.c_str(), &st), 0);
+        ASSERT_TRUE(IsOK(store.Write(Store::Records{{ka, b}, {kb, b}})));
+    }
+    // a crash mid-append: the first record of the batch is whole, the
+    // batch is not, so none of it is replayed
+    off_t whole = st.st_size;
+    ASSERT_EQ(stat(log.c_str(), &st), 0);
+    ASSERT_EQ(truncate(log.c_str(), st.st_size - 3), 0);
+    Frame read;
+    for (int round = 0; round < 2; ++round) {
+        Store::Branches branches;
+        ASSERT_TRUE(IsOK(Store::OpenAll(branches)));
+        Store& store = branches[Uuid::NIL];
+        ASSERT_TRUE(IsOK(store.Read(ka, read)));
+        ASSERT_TRUE(IsOK(CompareFrames(a, read)));
+        ASSERT_TRUE(IsOK(store.Read(kb, read)));
+        ASSERT_TRUE(IsOK(CompareFrames(a, read)));
+        ASSERT_EQ(stat(log.c_str(), &st), 0);
+        ASSERT_EQ(st.st_size, whole);  // the torn batch is cut off
+        // garbage that looks like a batch header is not replayed either
+        std::ofstream garbage{log, std::ios::app | std::ios::binary};
+        garbage << String(64, '\x01');
+    }
+    // the next batch lands after the cut
+    {
+        Store::Branches branches;
+        ASSERT_TRUE(IsOK(Store::OpenAll(branches)));
+        ASSERT_TRUE(IsOK(branches[Uuid::NIL].Write(ka, b)));
+    }
+    Store::Branches branches;
+    ASSERT_TRUE(IsOK(Store::OpenAll(branches)));
+    ASSERT_TRUE(IsOK(branches[Uuid::NIL].Read(ka, read)));
+    ASSERT_TRUE(IsOK(CompareFrames(merged, read)));
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,874 @@
+#include <atomic>
+#include <thread>
+#include "../replica.hpp"
+#include "testutil.hpp"
+
+using namespace ron;
+using namespace std;
+
+using Frame = TextFrame;
+using Builder = Frame::Builder;
+using Cursor = Frame::Cursor;
+using TestReplica = Replica<RocksDBStore<Frame>>;
+
+/** the last 'x' value of every object in the response, in order */
+vector<int64_t> Values(const Frame& response) {
+    vector<int64_t> values;
+    Uuid last;
+    Cursor c{response};
+    while (c.valid()) {
+        if (c.ref() == LWW_FORM_UUID) {
+            values.push_back(0);
+            last = Uuid::NIL;
+        } else if (!values.empty() && c.size() == 4 && c.has(2, STRING) &&
+                   c.string(2) == "x" && last < c.id()) {
+            values.back() = c.integer(3);
+            last = c.id();
+        }
+        c.Next();
+    }
+    return values;
+}
+
+/** A fresh id, not the previous one + 1: the parser needs the ids of
+ * chunk heads spelled out, the builder abbreviates sequential ones. */
+template <class AnyReplica>
+Uuid Stamp(AnyReplica& replica, Word yarn) {
+    replica.Now(yarn);
+    return replica.Now(yarn);
+}
+
+/** Writers and readers on a few branches at once */
+template <class Store>
+void RunThreads(const String& dir) {
+    using ThreadsReplica = Replica<Store>;
+    TmpDir tmp;
+    tmp.cd(dir);
+    constexpr int BRANCHES = 2, WRITERS = 3, READERS = 3, COMMITS = 32;
+    ASSERT_TRUE(IsOK(ThreadsReplica::CreateReplica()));
+    ThreadsReplica replica;
+    ASSERT_TRUE(IsOK(replica.Open()));
+
+    // every branch has two objects, every commit sets both
+    vector<Word> yarns;
+    vector<pair<Uuid, Uuid>> objects;
+    for (int b = 0; b < BRANCHES; ++b) {
+        Word yarn{String{"branch"} + char('A' + b)};
+        ASSERT_TRUE(IsOK(replica.CreateBranch(yarn, true)));
+        Builder create;
+        Uuid a = Stamp(replica, yarn), b_ = Stamp(replica, yarn);
+        create.AppendNewOp(a, LWW_FORM_UUID);
+        create.EndChunk();
+        create.AppendNewOp(b_, LWW_FORM_UUID);
+        create.EndChunk();
+        Builder resp;
+        ASSERT_TRUE(IsOK(replica.ReceiveFrame(resp, create.Release(), yarn)));
+        yarns.push_back(yarn);
+        objects.emplace_back(a, b_);
+    }
+
+    atomic<int64_t> next{1};
+    atomic<int> writing{BRANCHES * WRITERS};
+    atomic<size_t> saved{0}, torn{0}, read{0};
+    vector<thread> threads;
+    for (int b = 0; b < BRANCHES; ++b) {
+        Word yarn = yarns[b];
+        Uuid a = objects[b].first, b_ = objects[b].second;
+        for (int w = 0; w < WRITERS; ++w) {
+            threads.emplace_back([&, yarn, a, b_] {
+                for (int n = 0; n < COMMITS; ++n) {
+                    int64_t value = next++;
+                    Status ok;
+                    do {  // stamped out of the queue order? restamp
+                        Builder write;
+                        write.AppendNewOp(Stamp(replica, yarn), a, String{"x"},
+                                          value);
+                        write.EndChunk();
+                        write.AppendNewOp(Stamp(replica, yarn), b_,
+                                          String{"x"}, value);
+                        write.EndChunk();
+                        Builder resp;
+                        ok = replica.ReceiveFrame(resp, write.Release(), yarn);
+                    } while (ok == Status::CAUSEBREAK);
+                    if (ok) ++saved;
+                }
+                --writing;
+            });
+        }
+        for (int r = 0; r < READERS; ++r) {
+            threads.emplace_back([&, yarn, a, b_] {
+                do {
+                    Builder query;
+                    query.AppendNewOp(a, LWW_FORM_UUID);
+                    query.EndChunk(QUERY);
+                    query.AppendNewOp(b_, LWW_FORM_UUID);
+                    query.EndChunk(QUERY);
+                    Builder resp;
+                    if (!replica.ReceiveFrame(resp, query.Release(), yarn)) {
+                        continue;
+                    }
+                    auto values = Values(resp.Release());
+                    if (values.size() != 2 || values[0] != values[1]) ++torn;
+                    ++read;
+                } while (writing > 0);
+            });
+        }
+    }
+    for (auto& t : threads) t.join();
+
+    ASSERT_EQ(saved, BRANCHES * WRITERS * COMMITS);
+    ASSERT_EQ(torn, 0);
+    ASSERT_GT(read, 0);
+    for (int b = 0; b < BRANCHES; ++b) {
+        Builder query;
+        query.AppendNewOp(objects[b].first, LWW_FORM_UUID);
+        query.EndChunk(QUERY);
+        query.AppendNewOp(objects[b].second, LWW_FORM_UUID);
+        query.EndChunk(QUERY);
+        Builder resp;
+        ASSERT_TRUE(IsOK(replica.ReceiveFrame(resp, query.Release(),
+                                              yarns[b])));
+        auto values = Values(resp.Release());
+        ASSERT_EQ(values.size(), 2);
+        ASSERT_GT(values[0], 0);
+        ASSERT_EQ(values[0], values[1]);
+    }
+    ASSERT_TRUE(IsOK(replica.Close()));
+}
+
+TEST(Replica, Threads) { RunThreads<RocksDBStore<Frame>>("ReplicaThreads"); }
+
+TEST(Replica, MmapThreads) {
+    // every load of a store unloads another one, maybe in use
+    Tunable<size_t> limit{MMAP_STORE_OPEN_LIMIT, 1};
+    RunThreads<MmapStore<Frame>>("ReplicaMmapThreads");
+}
+
+TEST(Replica, Stores) {
+    TmpDir tmp;
+    tmp.cd("ReplicaStores");
+    ASSERT_TRUE(IsOK(TestReplica::CreateReplica()));
+    TestReplica replica;
+    ASSERT_TRUE(IsOK(replica.Open()));
+    Word yarn{"main"}, gone{"gone"};
+    Uuid main_id = TestReplica::yarn2branch(yarn);
+
+    // no such store, or dropped while the Commit waited
+    TestReplica::Commit none{replica, TestReplica::yarn2branch(gone)};
+    ASSERT_EQ(none.Lock(false), Status::NOT_FOUND);
+    ASSERT_TRUE(IsOK(replica.CreateBranch(gone, true)));
+    TestReplica::Commit late{replica, TestReplica::yarn2branch(gone)};
+    ASSERT_TRUE(IsOK(replica.DropBranch(gone)));
+    ASSERT_EQ(late.Lock(true), Status::NOT_FOUND);
+
+    // forks and snapshots while the readers read
+    ASSERT_TRUE(IsOK(replica.CreateBranch(yarn, true)));
+    Uuid obj = Stamp(replica, yarn);
+    Builder create;
+    create.AppendNewOp(obj, LWW_FORM_UUID, String{"x"}, int64_t{1});
+    Builder resp;
+    ASSERT_TRUE(IsOK(replica.ReceiveFrame(resp, create.Release(), yarn)));
+    auto query_obj = [&](Builder& got) {
+        Builder query;
+        query.AppendNewOp(obj, LWW_FORM_UUID);
+        query.EndChunk(QUERY);
+        return replica.ReceiveFrame(got, query.Release(), yarn);
+    };
+    Builder first;
+    ASSERT_TRUE(IsOK(query_obj(first)));
+    String before = first.Release().data();
+    atomic<bool> forking{true};
+    atomic<size_t> bad{0};
+    vector<thread> readers;
+    for (int r = 0; r < 3; ++r) {
+        readers.emplace_back([&] {
+            while (forking) {
+                Builder got;
+                if (!query_obj(got) || got.Release().data() != before) {
+                    ++bad;
+                }
+            }
+        });
+    }
+    for (int f = 0; f < 4; ++f) {
+        Word fork{String{"fork"} + char('A' + f)};
+        ASSERT_TRUE(IsOK(replica.ForkBranch(fork, yarn)));
+        Uuid point = Stamp(replica, yarn);
+        ASSERT_TRUE(IsOK(replica.CreateSnapshotOffBranch(point)));
+        ASSERT_TRUE(replica.HasStore(point));
+    }
+    forking = false;
+    for (auto& t : readers) t.join();
+    ASSERT_EQ(bad, 0);
+    ASSERT_TRUE(replica.HasStore(main_id));
+    ASSERT_TRUE(IsOK(replica.Close()));
+}
+
+/** Chains of several yarns, new objects and edits of the others'
+ * objects, some over a span long; the chains' ids apart, see Stamp() */
+Frame BulkFrame(vector<Uuid>& ops) {
+    Builder bulk;
+    vector<Word> yarns{Word{"A"}, Word{"B"}, Word{"C"}, Word{"D"}, Word{"E"}};
+    uint64_t t = 1;
+    for (auto& yarn : yarns) {
+        bulk.AppendNewOp(Uuid::Time(Word{t}, yarn), YARN_FORM_UUID);
+        bulk.EndChunk();
+        t += 2;
+    }
+    for (int r = 0; r < 24; ++r) {
+        for (size_t y = 0; y < yarns.size(); ++y) {
+            Uuid ref = LWW_FORM_UUID;
+            if (r % 4 && !ops.empty()) {
+                ref = ops[(r * 7 + y * 13) % ops.size()];
+            }
+            size_t length = 1 + (r + y) % 5;
+            for (size_t i = 0; i < length; ++i) {
+                Uuid id = Uuid::Time(Word{t++}, yarns[y]);
+                bulk.AppendNewOp(id, ref, String{"x"}, int64_t(t));
+                ops.push_back(id);
+                ref = id;
+            }
+            bulk.EndChunk();
+            ++t;
+        }
+    }
+    return bulk.Release();
+}
+
+TEST(Replica, Ingest) {
+    TmpDir tmp;
+    tmp.cd("ReplicaIngest");
+    Tunable<size_t> span_ops{REPLICA_SPAN_OPS, 2},
+        threads{REPLICA_INGEST_THREADS, REPLICA_INGEST_THREADS},
+        bytes{REPLICA_INGEST_BYTES, REPLICA_INGEST_BYTES},
+        chains{REPLICA_INGEST_CHAINS, 4};
+    ASSERT_TRUE(IsOK(TestReplica::CreateReplica()));
+    TestReplica replica;
+    ASSERT_TRUE(IsOK(replica.Open()));
+    vector<Uuid> ops;
+    Frame bulk = BulkFrame(ops);
+
+    // the same chains, in a pipeline and not
+    Word piped{"brP"}, serial{"brS"};
+    for (auto yarn : {piped, serial}) {
+        ASSERT_TRUE(IsOK(replica.CreateBranch(yarn, true)));
+        REPLICA_INGEST_THREADS = yarn == piped ? 3 : 0;
+        REPLICA_INGEST_BYTES = 0;
+        Builder tail;  // the branch's own yarn, saved the usual way
+        tail.AppendNewOp(Stamp(replica, yarn), LWW_FORM_UUID, String{"x"},
+                         int64_t{1});
+        Frame frame{bulk.data() + tail.Release().data()};
+        Builder resp;
+        ASSERT_TRUE(IsOK(replica.ReceiveFrame(resp, frame, yarn)));
+    }
+
+    // same metas, hashes included, same objects
+    vector<String> metas[2], states[2];
+    for (int b = 0; b < 2; ++b) {
+        Word yarn = b ? serial : piped;
+        TestReplica::Commit commit{replica, TestReplica::yarn2branch(yarn)};
+        for (auto id : ops) {
+            OpMeta meta;
+            ASSERT_TRUE(IsOK(commit.FindOpMeta(meta, id)));
+            metas[b].push_back(meta.object.str() + meta.hash.base64());
+            if (meta.object == id) {
+                Frame state;
+                ASSERT_TRUE(IsOK(commit.GetObject(state, id, LWW_FORM_UUID)));
+                states[b].push_back(state.data());
+            }
+        }
+    }
+    ASSERT_EQ(metas[0], metas[1]);
+    ASSERT_EQ(states[0], states[1]);
+    ASSERT_GT(states[0].size(), 0);
+
+    // a query cuts the run, the next chain goes on a yarn seen before it
+    Word yarnF{"F"};
+    Uuid objF = Uuid::Time(Word{3UL}, yarnF),
+         editF = Uuid::Time(Word{5UL}, yarnF);
+    for (auto yarn : {piped, serial}) {
+        REPLICA_INGEST_THREADS = yarn == piped ? 3 : 0;
+        Builder mixed;
+        mixed.AppendNewOp(Uuid::Time(Word{1UL}, yarnF), YARN_FORM_UUID);
+        mixed.EndChunk();
+        mixed.AppendNewOp(objF, LWW_FORM_UUID, String{"x"}, int64_t{1});
+        mixed.EndChunk();
+        mixed.AppendNewOp(objF, LWW_FORM_UUID);
+        mixed.EndChunk(QUERY);
+        mixed.AppendNewOp(editF, objF, String{"x"}, int64_t{2});
+        mixed.EndChunk();
+        mixed.AppendNewOp(Stamp(replica, yarn), LWW_FORM_UUID, String{"x"},
+                          int64_t{1});
+        Builder resp;
+        ASSERT_TRUE(IsOK(replica.ReceiveFrame(resp, mixed.Release(), yarn)));
+        TestReplica::Commit commit{replica, TestReplica::yarn2branch(yarn)};
+        OpMeta meta;
+        ASSERT_TRUE(IsOK(commit.FindOpMeta(meta, editF)));
+        ASSERT_EQ(meta.object, objF);
+        Frame state;
+        ASSERT_TRUE(IsOK(commit.GetObject(state, objF, LWW_FORM_UUID)));
+        Builder query;
+        query.AppendNewOp(objF, LWW_FORM_UUID);
+        query.EndChunk(QUERY);
+        Builder got;
+        ASSERT_TRUE(IsOK(replica.ReceiveFrame(got, query.Release(), yarn)));
+        ASSERT_EQ(Values(got.Release()), vector<int64_t>{2});
+    }
+
+    // a chain fails either way, the rest is not saved
+    Builder bad;
+    Uuid next = Uuid::Time(Word{1UL << 20U}, Word{"A"});
+    bad.AppendNewOp(next, ops.back(), String{"x"}, int64_t{2});
+    bad.EndChunk();
+    bad.AppendNewOp(next.inc(2), Uuid::Time(Word{1UL}, Word{"Z"}), String{"x"},
+                    int64_t{3});
+    Frame bad_frame = bad.Release();
+    Status fails[2];
+    for (int b = 0; b < 2; ++b) {
+        Word yarn = b ? serial : piped;
+        REPLICA_INGEST_THREADS = b ? 0 : 3;
+        Builder resp;
+        fails[b] = replica.ReceiveFrame(resp, bad_frame, yarn);
+        ASSERT_FALSE(fails[b]);
+        TestReplica::Commit commit{replica, TestReplica::yarn2branch(yarn)};
+        OpMeta meta;
+        ASSERT_FALSE(commit.FindOpMeta(meta, next));
+    }
+    ASSERT_EQ(fails[0], fails[1]);
+
+    ASSERT_TRUE(IsOK(replica.Close()));
+}
+
+/** @return whether the RGA object has any rm ops left */
+bool HasRemovals(TestReplica& replica, Word yarn, Uuid id) {
+    TestReplica::Commit commit{replica, TestReplica::yarn2branch(yarn)};
+    Frame state;
+    EXPECT_TRUE(IsOK(commit.GetObject(state, id, RGA_FORM_UUID)));
+    Cursor c{state};
+    bool rm = false;
+    do {
+        rm = rm || (c.size() == 3 && c.has(2, UUID) && c.uuid(2) == RM_UUID);
+    } while (c.Next());
+    return rm;
+}
+
+TEST(Replica, GC) {
+    TmpDir tmp;
+    tmp.cd("ReplicaGC");
+    Tunable<uint64_t> gc_ms{REPLICA_GC_MS, REPLICA_GC_MS};
+    Tunable<size_t> gc_batch{REPLICA_GC_BATCH, 1};
+    ASSERT_TRUE(IsOK(TestReplica::CreateReplica()));
+    TestReplica replica;
+    ASSERT_TRUE(IsOK(replica.Open()));
+    Word yarn{"gc"};
+    ASSERT_TRUE(IsOK(replica.CreateBranch(yarn, true)));
+    // no RGA objects: the scan ends before it starts
+    ASSERT_TRUE(IsOK(replica.GCBranch(yarn, EMPTY_VV)));
+    ASSERT_FALSE(replica.GCBranch(Word{"none"}, EMPTY_VV));
+
+    // RGA objects, an entry removed in each: a batch per object
+    vector<Uuid> objects;
+    VV stable;
+    for (int n = 0; n < 3; ++n) {
+        Builder write;
+        Uuid id = Stamp(replica, yarn), entry = Stamp(replica, yarn),
+             rm = Stamp(replica, yarn);
+        write.AppendNewOp(id, RGA_FORM_UUID);
+        write.EndChunk();
+        write.AppendNewOp(entry, id, String{"a"});
+        write.EndChunk();
+        write.AppendNewOp(rm, entry, RM_UUID);
+        write.EndChunk();
+        Builder resp;
+        ASSERT_TRUE(IsOK(replica.ReceiveFrame(resp, write.Release(), yarn)));
+        objects.push_back(id);
+        stable.add(rm);
+    }
+    ASSERT_TRUE(HasRemovals(replica, yarn, objects[0]));
+    ASSERT_TRUE(IsOK(replica.GCBranch(yarn, stable)));
+    ASSERT_FALSE(HasRemovals(replica, yarn, objects[0]));
+    ASSERT_FALSE(HasRemovals(replica, yarn, objects[2]));
+
+    // in the background, off the next writes
+    REPLICA_GC_MS = 1;
+    Builder write;
+    Uuid id = Stamp(replica, yarn), entry = Stamp(replica, yarn),
+         rm = Stamp(replica, yarn);
+    write.AppendNewOp(id, RGA_FORM_UUID);
+    write.EndChunk();
+    write.AppendNewOp(entry, id, String{"b"});
+    write.EndChunk();
+    write.AppendNewOp(rm, entry, RM_UUID);
+    write.EndChunk();
+    Builder resp;
+    ASSERT_TRUE(IsOK(replica.ReceiveFrame(resp, write.Release(), yarn)));
+    ASSERT_TRUE(HasRemovals(replica, yarn, id));
+    stable.add(rm);
+    ASSERT_TRUE(IsOK(replica.StartGC(stable)));
+    for (int wait = 0; wait < 1000 && HasRemovals(replica, yarn, id); ++wait) {
+        this_thread::sleep_for(chrono::milliseconds(5));
+    }
+    replica.StopGC();
+    ASSERT_FALSE(HasRemovals(replica, yarn, id));
+
+    // forked stores get flattened first, then collected
+    Word forked{"gcF"};
+    ASSERT_TRUE(IsOK(replica.ForkBranch(forked, yarn)));
+    Builder fwrite;
+    Uuid fid = Stamp(replica, forked), fentry = Stamp(replica, forked),
+         frm = Stamp(replica, forked);
+    fwrite.AppendNewOp(fid, RGA_FORM_UUID);
+    fwrite.EndChunk();
+    fwrite.AppendNewOp(fentry, fid, String{"c"});
+    fwrite.EndChunk();
+    fwrite.AppendNewOp(frm, fentry, RM_UUID);
+    fwrite.EndChunk();
+    Builder fresp;
+    ASSERT_TRUE(IsOK(replica.ReceiveFrame(fresp, fwrite.Release(), forked)));
+    stable.add(frm);
+    ASSERT_TRUE(IsOK(replica.GCBranch(forked, stable)));
+    ASSERT_FALSE(HasRemovals(replica, forked, fid));
+    ASSERT_TRUE(IsOK(replica.GCBranch(yarn, stable)));
+    ASSERT_FALSE(HasRemovals(replica, yarn, id));
+
+    ASSERT_TRUE(IsOK(replica.Close()));
+}
+
+/** the chain of `length` edits of the object, the ops `t` apart */
+void AppendEdits(Builder& frame, Uuid object, Word yarn, uint64_t t,
+                 size_t length, vector<Uuid>& ops) {
+    Uuid ref = object;
+    for (size_t i = 0; i < length; ++i) {
+        Uuid id = Uuid::Time(Word{t + i}, yarn);
+        frame.AppendNewOp(id, ref, String{"x"}, int64_t(t + i));
+        ops.push_back(id);
+        ref = id;
+    }
+    frame.EndChunk();
+}
+
+TEST(Replica, LogSegments) {
+    TmpDir tmp;
+    tmp.cd("ReplicaLogSegments");
+    Tunable<size_t> segment_bytes{REPLICA_LOG_SEGMENT_BYTES,
+                                  REPLICA_LOG_SEGMENT_BYTES};
+    ASSERT_TRUE(IsOK(TestReplica::CreateReplica()));
+    TestReplica replica;
+    ASSERT_TRUE(IsOK(replica.Open()));
+    Word A{"A"}, B{"B"}, C{"C"};
+    Uuid obj = Uuid::Time(Word{7UL}, A);
+    Uuid late = Uuid::Time(Word{55UL}, C);
+    vector<Uuid> ops{obj};
+    Builder early, more;
+    early.AppendNewOp(Uuid::Time(Word{1UL}, A), YARN_FORM_UUID);
+    early.EndChunk();
+    early.AppendNewOp(Uuid::Time(Word{3UL}, B), YARN_FORM_UUID);
+    early.EndChunk();
+    early.AppendNewOp(Uuid::Time(Word{5UL}, C), YARN_FORM_UUID);
+    early.EndChunk();
+    early.AppendNewOp(obj, LWW_FORM_UUID, String{"x"}, int64_t{0});
+    early.EndChunk();
+    for (uint64_t t = 10; t < 90; t += 10) {
+        AppendEdits(early, obj, B, t, 3, ops);
+    }
+    // a chain older than the last segment, then newer ones
+    AppendEdits(more, obj, C, 55, 2, ops);
+    for (uint64_t t = 90; t < 130; t += 10) {
+        AppendEdits(more, obj, B, t, 3, ops);
+    }
+    Frame frames[] = {early.Release(), more.Release()};
+
+    // the same chains, segmented and not
+    Word segmented{"brSeg"}, flat{"brFlat"};
+    for (auto yarn : {segmented, flat}) {
+        REPLICA_LOG_SEGMENT_BYTES = yarn == segmented ? 100 : 0;
+        ASSERT_TRUE(IsOK(replica.CreateBranch(yarn, true)));
+        for (auto& frame : frames) {
+            Builder own;  // the branch's own yarn, saved the usual way
+            own.AppendNewOp(Stamp(replica, yarn), LWW_FORM_UUID, String{"x"},
+                            int64_t{1});
+            Builder resp;
+            ASSERT_TRUE(IsOK(replica.ReceiveFrame(
+                resp, Frame{frame.data() + own.Release().data()}, yarn)));
+        }
+    }
+
+    Uuids heads[2];
+    Frame logs[2];
+    for (int b = 0; b < 2; ++b) {
+        Word yarn = b ? flat : segmented;
+        TestReplica::Commit commit{replica, TestReplica::yarn2branch(yarn)};
+        ASSERT_TRUE(IsOK(commit.FindLogSegments(heads[b], obj)));
+        ASSERT_TRUE(IsOK(commit.GetObjectLog(logs[b], obj)));
+    }
+    // rolled over, the late chain merged in head order either way
+    ASSERT_GT(heads[0].size(), 2);
+    ASSERT_EQ(heads[1], Uuids{obj});
+    ASSERT_TRUE(IsOK(CompareFrames(logs[0], logs[1])));
+    ASSERT_NE(logs[0].data().find(late.str()), String::npos);
+    {
+        TestReplica::Commit commit{replica,
+                                   TestReplica::yarn2branch(segmented)};
+        Uuids since;
+        ASSERT_TRUE(IsOK(commit.FindLogSegments(since, obj, late)));
+        ASSERT_LT(since.size(), heads[0].size());
+        ASSERT_TRUE(since.front() <= late);
+        ASSERT_TRUE(heads[0].back() > late);
+        Frame segment;
+        ASSERT_TRUE(IsOK(commit.FindObjectLog(segment, obj, late, late)));
+        ASSERT_NE(String{segment.data()}.find(late.str()), String::npos);
+    }
+
+    // the tail past every op, and the object, are the same
+    for (auto id : ops) {
+        Frame tails[2];
+        for (int b = 0; b < 2; ++b) {
+            Builder query;
+            query.AppendNewOp(id, TAIL_FORM_UUID);
+            query.EndChunk(QUERY);
+            Builder got;
+            ASSERT_TRUE(IsOK(replica.ReceiveFrame(got, query.Release(),
+                                                  b ? flat : segmented)));
+            tails[b] = got.Release();
+        }
+        ASSERT_TRUE(IsOK(CompareFrames(tails[0], tails[1]))) << id.str();
+    }
+    Frame states[2];
+    for (int b = 0; b < 2; ++b) {
+        Builder query;
+        query.AppendNewOp(obj, LWW_FORM_UUID);
+        query.EndChunk(QUERY);
+        Builder got;
+        ASSERT_TRUE(IsOK(
+            replica.ReceiveFrame(got, query.Release(), b ? flat : segmented)));
+        states[b] = got.Release();
+    }
+    ASSERT_TRUE(IsOK(CompareFrames(states[0], states[1])));
+    ASSERT_EQ(Values(states[0]), vector<int64_t>{122});
+    ASSERT_TRUE(IsOK(replica.Close()));
+}
+
+/** @return the objects' values, queried in one frame */
+vector<int64_t> QueryValues(TestReplica& replica, Word yarn,
+                            const vector<Uuid>& objects) {
+    Builder query;
+    for (auto id : objects) {
+        query.AppendNewOp(id, LWW_FORM_UUID);
+        query.EndChunk(QUERY);
+    }
+    Builder got;
+    EXPECT_TRUE(IsOK(replica.ReceiveFrame(got, query.Release(), yarn)));
+    return Values(got.Release());
+}
+
+TEST(Replica, LazyStates) {
+    Tunable<size_t> cache_size{REPLICA_STATE_CACHE_SIZE, 2};
+    vector<int64_t> seen[2];
+    for (int lazy = 0; lazy < 2; ++lazy) {
+        TmpDir tmp;
+        tmp.cd(lazy ? "ReplicaLazy" : "ReplicaConsistent");
+        ASSERT_TRUE(IsOK(TestReplica::CreateReplica()));
+        TestReplica replica;
+        replica.set_mode(lazy ? LAZY_STATE_MODE : CONSISTENT_MODE);
+        ASSERT_TRUE(IsOK(replica.Open()));
+        Word yarn{"lazy"};
+        Uuid branch = TestReplica::yarn2branch(yarn);
+        ASSERT_TRUE(IsOK(replica.CreateBranch(yarn, true)));
+        vector<Uuid> objects;
+        Builder create;
+        for (int o = 0; o < 4; ++o) {
+            objects.push_back(Stamp(replica, yarn));
+            create.AppendNewOp(objects.back(), LWW_FORM_UUID, String{"x"},
+                               int64_t(o));
+            create.EndChunk();
+        }
+        Builder resp;
+        ASSERT_TRUE(IsOK(replica.ReceiveFrame(resp, create.Release(), yarn)));
+
+        // twice the objects the cache holds: edits of evicted ones too
+        vector<Uuid> edited;
+        for (int round = 1; round <= 3; ++round) {
+            Builder edits;
+            for (int o = 0; o < 4; ++o) {
+                edited.push_back(Stamp(replica, yarn));
+                edits.AppendNewOp(edited.back(), objects[o], String{"x"},
+                                  int64_t(round * 10 + o));
+                edits.EndChunk();
+            }
+            ASSERT_TRUE(
+                IsOK(replica.ReceiveFrame(resp, edits.Release(), yarn)));
+            for (auto v : QueryValues(replica, yarn, objects)) {
+                seen[lazy].push_back(v);
+            }
+            // a hit, then the rest
+            for (auto o : {3, 3, 0, 1}) {
+                for (auto v : QueryValues(replica, yarn, {objects[o]})) {
+                    seen[lazy].push_back(v);
+                }
+            }
+        }
+
+        // the object's log is its state; the op's, the ops till it
+        for (auto id : {objects[1], edited[1], edited[5]}) {
+            Builder query;
+            query.AppendNewOp(id, LOG_FORM_UUID);
+            query.EndChunk(QUERY);
+            Builder got;
+            ASSERT_TRUE(IsOK(replica.ReceiveFrame(got, query.Release(), yarn)));
+            Frame log = got.Release();
+            vector<int64_t> ops;
+            for (Cursor c{log}; c.valid(); c.Next()) {
+                ASSERT_TRUE(c.size() == 4 && c.has(3, INT));
+                ops.push_back(c.integer(3));
+            }
+            ASSERT_FALSE(ops.empty());
+            seen[lazy].insert(seen[lazy].end(), ops.begin(), ops.end());
+        }
+
+        // a reader caches the evicted object's old state while a writer
+        // edits it: the writer's save drops the stale state
+        Uuid obj = objects[2];
+        {
+            TestReplica::Commit writer{replica, branch};
+            ASSERT_TRUE(IsOK(writer.Lock(true)));
+            Builder edit;
+            edit.AppendNewOp(Stamp(replica, yarn), obj, String{"x"},
+                             int64_t{100});
+            Frame edit_frame = edit.Release();
+            Cursor ec{edit_frame};
+            ASSERT_TRUE(IsOK(writer.SaveChain(resp, ec)));
+            {
+                TestReplica::Commit reader{replica, branch};
+                ASSERT_TRUE(IsOK(reader.Lock(false)));
+                Builder query;
+                query.AppendNewOp(obj, LWW_FORM_UUID);
+                query.EndChunk(QUERY);
+                Frame query_frame = query.Release();
+                Cursor qc{query_frame};
+                Builder got;
+                ASSERT_TRUE(IsOK(reader.ReceiveQuery(got, qc)));
+                ASSERT_TRUE(IsOK(reader.Save()));
+                ASSERT_EQ(Values(got.Release()), vector<int64_t>{32});
+            }
+            ASSERT_TRUE(IsOK(writer.Save()));
+        }
+        ASSERT_EQ(QueryValues(replica, yarn, {obj}), vector<int64_t>{100});
+        ASSERT_TRUE(IsOK(replica.Close()));
+    }
+    ASSERT_EQ(seen[0], seen[1]);
+    ASSERT_EQ(seen[1].size(), 3 * 8 + 4 + 2 + 3);
+}
+
+TEST(Replica, TipCache) {
+    TmpDir tmp;
+    tmp.cd("ReplicaTipCache");
+    Tunable<size_t> cache_size{REPLICA_TIP_CACHE_SIZE, 2};
+    ASSERT_TRUE(IsOK(TestReplica::CreateReplica()));
+    TestReplica replica;
+    ASSERT_TRUE(IsOK(replica.Open()));
+    Word yarn{"tips"}, A{"A"}, B{"B"};
+    Uuid branch = TestReplica::yarn2branch(yarn);
+    ASSERT_TRUE(IsOK(replica.CreateBranch(yarn, true)));
+    Uuid obj = Stamp(replica, yarn);
+    Builder create;
+    create.AppendNewOp(obj, LWW_FORM_UUID, String{"x"}, int64_t{0});
+    Builder resp;
+    ASSERT_TRUE(IsOK(replica.ReceiveFrame(resp, create.Release(), yarn)));
+
+    // a commit per foreign yarn, each caching its tip and the branch's
+    Uuid tips[2];
+    for (auto foreign : {A, B}) {
+        Builder write;
+        write.AppendNewOp(Stamp(replica, foreign), YARN_FORM_UUID);
+        write.EndChunk();
+        tips[foreign == B] = Stamp(replica, foreign);
+        write.AppendNewOp(tips[foreign == B], obj, String{"x"}, int64_t{1});
+        write.EndChunk();
+        write.AppendNewOp(Stamp(replica, yarn), obj, String{"x"}, int64_t{2});
+        ASSERT_TRUE(IsOK(replica.ReceiveFrame(resp, write.Release(), yarn)));
+    }
+    {
+        TestReplica::Commit commit{replica, branch};
+        ASSERT_TRUE(IsOK(commit.Lock(false)));
+        OpMeta meta;
+        ASSERT_TRUE(commit.FindTipMeta(meta, tips[1]));
+        ASSERT_EQ(meta.id, tips[1]);
+        ASSERT_EQ(meta.object, obj);
+        // evicted by the two tips cached after it; the db still has it
+        ASSERT_FALSE(commit.FindTipMeta(meta, tips[0]));
+        ASSERT_TRUE(IsOK(commit.FindOpMeta(meta, tips[0])));
+        ASSERT_EQ(meta.id, tips[0]);
+        ASSERT_TRUE(IsOK(commit.FindYarnTipMeta(meta, tips[0].origin())));
+        ASSERT_EQ(meta.id, tips[0]);
+    }
+
+    // an aborted commit's tips never reach the cache
+    Uuid aborted = Stamp(replica, B);
+    {
+        TestReplica::Commit commit{replica, branch};
+        ASSERT_TRUE(IsOK(commit.Lock(true)));
+        Builder write;
+        write.AppendNewOp(aborted, tips[1], String{"x"}, int64_t{3});
+        Frame frame = write.Release();
+        Cursor c{frame};
+        ASSERT_TRUE(IsOK(commit.SaveChain(resp, c)));
+        OpMeta meta;
+        ASSERT_TRUE(commit.FindTipMeta(meta, aborted));
+        ASSERT_TRUE(IsOK(commit.Abort()));
+        ASSERT_FALSE(commit.FindTipMeta(meta, aborted));
+    }
+    TestReplica::Commit commit{replica, branch};
+    ASSERT_TRUE(IsOK(commit.Lock(false)));
+    OpMeta meta;
+    ASSERT_FALSE(commit.FindTipMeta(meta, aborted));
+    ASSERT_TRUE(commit.FindTipMeta(meta, Uuid{NEVER, tips[1].origin()}));
+    ASSERT_EQ(meta.id, tips[1]);
+    ASSERT_FALSE(commit.FindOpMeta(meta, aborted));
+    commit.Unlock();
+
+    ASSERT_TRUE(IsOK(replica.Close()));
+}
+
+TEST(Replica, Spans) {
+    TmpDir tmp;
+    tmp.cd("ReplicaSpans");
+    Tunable<size_t> span_ops{REPLICA_SPAN_OPS, REPLICA_SPAN_OPS},
+        segment_bytes{REPLICA_LOG_SEGMENT_BYTES, REPLICA_LOG_SEGMENT_BYTES};
+    ASSERT_TRUE(IsOK(TestReplica::CreateReplica()));
+    Word A{"A"};
+    vector<Uuid> ops;
+    Builder first, next;
+    first.AppendNewOp(Uuid::Time(Word{1UL}, A), YARN_FORM_UUID);
+    first.EndChunk();
+    // one chain, an object and its edits, continued by the next frame
+    Uuid ref = LWW_FORM_UUID;
+    for (uint64_t t = 3; t < 18; ++t) {
+        Builder& frame = t < 13 ? first : next;
+        ops.push_back(Uuid::Time(Word{t}, A));
+        frame.AppendNewOp(ops.back(), ref, String{"x"}, int64_t(t));
+        ref = ops.back();
+    }
+    first.EndChunk();
+    next.EndChunk();
+    Frame frames[] = {first.Release(), next.Release()};
+
+    // spans of 3 ops, unbounded spans, no spans (saved before them),
+    // a chain going on in the next log segment
+    Word spanned{"brSpan"}, whole{"brWhole"}, old{"brOld"}, split{"brSplit"};
+    {
+        TestReplica replica;
+        ASSERT_TRUE(IsOK(replica.Open()));
+        for (auto yarn : {spanned, whole, old, split}) {
+            REPLICA_SPAN_OPS = yarn == whole ? 0 : 3;
+            REPLICA_LOG_SEGMENT_BYTES = yarn == split ? 50 : 0;
+            ASSERT_TRUE(IsOK(replica.CreateBranch(yarn, true)));
+            for (auto& frame : frames) {
+                Builder own;
+                own.AppendNewOp(Stamp(replica, yarn), LWW_FORM_UUID,
+                                String{"x"}, int64_t{1});
+                Builder resp;
+                ASSERT_TRUE(IsOK(replica.ReceiveFrame(
+                    resp, Frame{frame.data() + own.Release().data()}, yarn)));
+            }
+        }
+        ASSERT_TRUE(IsOK(replica.Close()));
+    }
+    {
+        RocksDBStore<Frame>::Branches stores;
+        ASSERT_TRUE(IsOK(RocksDBStore<Frame>::OpenAll(stores)));
+        auto& store = stores[TestReplica::yarn2branch(old)];
+        for (auto id : ops) {
+            ASSERT_TRUE(IsOK(store.Put(Key{id, SPAN_FORM_UUID}, Frame{})));
+        }
+    }
+
+    // cold caches: every op but the span heads is found in its span's
+    // log segment or, if none, in the object log
+    TestReplica replica;
+    ASSERT_TRUE(IsOK(replica.Open()));
+    vector<String> metas[4];
+    size_t spans[4] = {0, 0, 0, 0};
+    Word yarns[] = {spanned, whole, old, split};
+    for (int b = 0; b < 4; ++b) {
+        TestReplica::Commit commit{replica,
+                                   TestReplica::yarn2branch(yarns[b])};
+        ASSERT_TRUE(IsOK(commit.Lock(false)));
+        for (auto id : ops) {
+            OpMeta meta;
+            ASSERT_TRUE(IsOK(commit.FindOpMeta(meta, id))) << id.str();
+            ASSERT_EQ(meta.id, id);
+            ASSERT_EQ(meta.object, ops.front());
+            metas[b].push_back(meta.object.str() + meta.hash.base64());
+            Frame span;
+            ASSERT_TRUE(IsOK(commit.Read(Key{id, SPAN_FORM_UUID}, span)));
+            if (span.empty()) continue;
+            ++spans[b];
+            // one op naming the segment that has the span head
+            Cursor rec{span};
+            ASSERT_EQ(rec.id(), id);
+            Uuid head = rec.ref();
+            ASSERT_FALSE(rec.Next());
+            Frame segment;
+            ASSERT_TRUE(IsOK(commit.Read(Key{head, LOG_FORM_UUID}, segment)));
+            Cursor c{segment};
+            while (c.valid() && c.id() != id) c.Next();
+            ASSERT_TRUE(c.valid()) << id.str();
+        }
+    }
+    ASSERT_EQ(metas[0], metas[1]);
+    ASSERT_EQ(metas[0], metas[2]);
+    ASSERT_EQ(metas[0], metas[3]);
+    ASSERT_GE(spans[0], (ops.size() + 2) / 3);
+    ASSERT_EQ(spans[1], 2);  // a span per chainlet
+    ASSERT_EQ(spans[2], 0);
+    ASSERT_EQ(spans[3], spans[0]);
+    ASSERT_TRUE(IsOK(replica.Close()));
+}
+
+TEST(Replica, CatchUp) {
+    TmpDir tmp;
+    tmp.cd("ReplicaCatchUp");
+    Tunable<uint64_t> catch_up{REPLICA_CATCH_UP_MS, 1};
+    ASSERT_TRUE(IsOK(TestReplica::CreateReplica()));
+    TestReplica writer;
+    ASSERT_TRUE(IsOK(writer.Open()));
+    Word yarn{"catch"};
+    ASSERT_TRUE(IsOK(writer.CreateBranch(yarn, true)));
+    Uuid obj = Stamp(writer, yarn);
+    Builder create;
+    create.AppendNewOp(obj, LWW_FORM_UUID, String{"x"}, int64_t{0});
+    Builder resp;
+    ASSERT_TRUE(IsOK(writer.ReceiveFrame(resp, create.Release(), yarn)));
+
+    // the readers reopen as they go, one at a time, under their Commits
+    TestReplica reader;
+    ASSERT_TRUE(IsOK(reader.Open(true)));
+    atomic<bool> writing{true};
+    atomic<size_t> bad{0};
+    vector<thread> readers;
+    for (int r = 0; r < 4; ++r) {
+        readers.emplace_back([&] {
+            while (writing) {
+                if (QueryValues(reader, yarn, {obj}).size() != 1) ++bad;
+            }
+        });
+    }
+    for (int64_t v = 1; v <= 20; ++v) {
+        Builder write;
+        write.AppendNewOp(Stamp(writer, yarn), obj, String{"x"}, v);
+        ASSERT_TRUE(IsOK(writer.ReceiveFrame(resp, write.Release(), yarn)));
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    writing = false;
+    for (auto& t : readers) t.join();
+    ASSERT_EQ(bad, 0);
+    this_thread::sleep_for(chrono::milliseconds(2));
+    ASSERT_EQ(QueryValues(reader, yarn, {obj}), vector<int64_t>{20});
+    ASSERT_TRUE(IsOK(reader.Close()));
+    ASSERT_TRUE(IsOK(writer.Close()));
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -1,3 +1,5 @@
+#include <thread>
+#include <rocksdb/db.h>
 #include "../rocks_store.hpp"
 #include "testutil.hpp"
 
@@ -81,6 +83,183 @@ TEST (Store, Merge) {
     //store.Close();
 }
 
+TEST (Store, Put) {
+    TmpDir tmp;
+    tmp.cd("Put");
+    String frame_a{"@1+A :lww 'int' 1;"};
+    String frame_b{"@2+A :1+A 'string' 'str';"};
+    String frame_c{"@3+A :lww 'int' 3;"};
+    Store store;
+    ASSERT_TRUE(IsOK(store.Create(Uuid::NIL)));
+    Frame a{frame_a}, b{frame_b}, c{frame_c};
+    Key key{Uuid{"1+A"}, LWW_FORM_UUID};
+    ASSERT_TRUE(IsOK(store.Write(key, a)));
+    ASSERT_TRUE(IsOK(store.Write(key, b)));
+    ASSERT_TRUE(IsOK(store.Put(key, c)));
+    Frame read;
+    ASSERT_TRUE(IsOK(store.Read(key, read)));
+    ASSERT_TRUE(CompareFrames(c, read));
+}
+
+TEST (Store, Pinned) {
+    TmpDir tmp;
+    tmp.cd("Pinned");
+    String frame_a{"@1+A :lww 'int' 1;"};
+    String frame_b{"@2+A :1+A 'string' 'str';"};
+    String frame_merged{"@1+A :lww 'int' 1, @2+A 'string' 'str';"};
+    Store store;
+    ASSERT_TRUE(IsOK(store.Create(Uuid::NIL)));
+    Frame a{frame_a}, b{frame_b}, correct{frame_merged};
+    Key key{Uuid{"1+A"}, LWW_FORM_UUID};
+    ASSERT_TRUE(IsOK(store.Write(key, a)));
+    ASSERT_TRUE(IsOK(store.Write(key, b)));
+    Store::Pinned pinned;
+    ASSERT_TRUE(IsOK(store.Read(key, pinned)));
+    ASSERT_FALSE(pinned.empty());
+    ASSERT_TRUE(CompareWithCursors(correct.cursor(), pinned.cursor()));
+    ASSERT_TRUE(IsOK(store.Read(Key{Uuid{"2+A"}, LWW_FORM_UUID}, pinned)));
+    ASSERT_TRUE(pinned.empty());
+}
+
+TEST (Store, MultiRead) {
+    TmpDir tmp;
+    tmp.cd("MultiRead");
+    Store store;
+    ASSERT_TRUE(IsOK(store.Create(Uuid::NIL)));
+    Frame a{"@1+A :lww 'a' 1;"}, b{"@1+B :lww 'b' 2;"};
+    Key ka{Uuid{"1+A"}, LWW_FORM_UUID}, kb{Uuid{"1+B"}, LWW_FORM_UUID};
+    ASSERT_TRUE(IsOK(store.Write(ka, a)));
+    ASSERT_TRUE(IsOK(store.Write(kb, b)));
+    Store::Frames frames;
+    ASSERT_TRUE(IsOK(store.MultiRead(
+        {kb, Key{Uuid{"1+C"}, LWW_FORM_UUID}, ka}, frames)));
+    ASSERT_EQ(frames.size(), 3);
+    ASSERT_TRUE(IsOK(CompareFrames(b, frames[0])));
+    ASSERT_TRUE(frames[1].empty());
+    ASSERT_TRUE(IsOK(CompareFrames(a, frames[2])));
+}
+
+TEST (Store, CompactionGC) {
+    TmpDir tmp;
+    tmp.cd("CompactionGC");
+    Store store;
+    ASSERT_TRUE(IsOK(store.Create(Uuid::NIL)));
+    Frame a{"@1+A :lww, @2+A 'x' 1;"}, b{"@3+A :2+A 'x' 2;"};
+    Frame merged{"@1+A :lww, @2+A 'x' 1, @3+A 'x' 2;"};
+    Frame collected{"@1+A :lww, @3+A :2+A 'x' 2;"};
+    Key key{Uuid{"1+A"}, LWW_FORM_UUID};
+    ASSERT_TRUE(IsOK(store.Write(key, a)));
+    ASSERT_TRUE(IsOK(store.Write(key, b)));
+    ASSERT_TRUE(IsOK(store.Compact()));  // off by default
+    Frame read;
+    ASSERT_TRUE(IsOK(store.Read(key, read)));
+    ASSERT_TRUE(IsOK(CompareFrames(merged, read)));
+    // another db keeps its own config
+    Store other;
+    ASSERT_TRUE(IsOK(other.Create(Uuid::NIL, "other")));
+    ASSERT_TRUE(IsOK(other.Write(key, a)));
+    ASSERT_TRUE(IsOK(other.Write(key, b)));
+    ASSERT_TRUE(IsOK(store.SetCompactionGC(1UL << LWW_RDT_FORM, EMPTY_VV)));
+    ASSERT_TRUE(IsOK(store.Compact()));
+    ASSERT_TRUE(IsOK(store.Read(key, read)));
+    ASSERT_TRUE(IsOK(CompareFrames(collected, read)));
+    ASSERT_TRUE(IsOK(other.Compact()));
+    ASSERT_TRUE(IsOK(other.Read(key, read)));
+    ASSERT_TRUE(IsOK(CompareFrames(merged, read)));
+    // stores created later on the db share it
+    Store more{store.db()};
+    ASSERT_TRUE(IsOK(more.Create(Uuid{"more"})));
+    ASSERT_TRUE(IsOK(more.Write(key, a)));
+    ASSERT_TRUE(IsOK(more.Write(key, b)));
+    ASSERT_TRUE(IsOK(more.Compact()));
+    ASSERT_TRUE(IsOK(more.Read(key, read)));
+    ASSERT_TRUE(IsOK(CompareFrames(collected, read)));
+}
+
+TEST (Store, ReadRepair) {
+    TmpDir tmp;
+    tmp.cd("ReadRepair");
+    Store store;
+    ASSERT_TRUE(IsOK(store.Create(Uuid::NIL)));
+    Key key{Uuid{"1+A"}, LWW_FORM_UUID};
+    ASSERT_TRUE(IsOK(store.Write(key, Frame{"@1+A :lww;"})));
+    ASSERT_TRUE(IsOK(store.Write(key, Frame{"@2+A :1+A 'a' 1;"})));
+    ASSERT_TRUE(IsOK(store.Write(key, Frame{"@3+A :2+A 'b' 2;"})));
+    ASSERT_TRUE(IsOK(store.Write(key, Frame{"@4+A :3+A 'c' 3;"})));
+    Frame correct{"@1+A :lww, @2+A 'a' 1, @3+A 'b' 2, @4+A 'c' 3;"};
+    size_t was = ROCKSDB_READ_REPAIR;
+    ROCKSDB_READ_REPAIR = 2;
+    vector<uint64_t> before, after;
+    Store::ReadMergeHistogram(before);
+    Frame read;
+    ASSERT_TRUE(IsOK(store.Read(key, read)));
+    ASSERT_TRUE(IsOK(CompareFrames(correct, read)));
+    Store::ReadMergeHistogram(after);
+    ASSERT_EQ(after[3] - before[3], 1);  // 4 operands
+    // repaired: nothing to merge
+    ASSERT_TRUE(IsOK(store.Read(key, read)));
+    ASSERT_TRUE(IsOK(CompareFrames(correct, read)));
+    Store::ReadMergeHistogram(before);
+    ASSERT_EQ(before[0] - after[0], 1);
+    ROCKSDB_READ_REPAIR = was;
+}
+
+TEST (Store, GroupCommit) {
+    TmpDir tmp;
+    tmp.cd("GroupCommit");
+    Store store;
+    ASSERT_TRUE(IsOK(store.Create(Uuid::NIL)));
+    size_t was = ROCKSDB_GROUP_COMMIT_WINDOW;
+    ROCKSDB_GROUP_COMMIT_WINDOW = 100;
+    constexpr uint64_t WRITERS = 8, BATCHES = 32;
+    Frame frame{"@1+A :lww 'x' 1;"};
+    vector<Status> oks(WRITERS * BATCHES);
+    vector<std::thread> writers;
+    for (uint64_t w = 0; w < WRITERS; ++w) {
+        writers.emplace_back([&, w] {
+            for (uint64_t n = 0; n < BATCHES; ++n) {
+                ArenaBatch batch;
+                Key key{Uuid{Word{n + 1}, Word{w + 1}}, LWW_RDT_FORM};
+                batch.records.emplace_back(key,
+                                           batch.arena.Append(frame.data()));
+                if (n == BATCHES / 2) {  // only this one fails
+                    batch.records.emplace_back(Key::END, Slice{});
+                }
+                oks[w * BATCHES + n] = store.Write(batch);
+            }
+        });
+    }
+    for (auto& w : writers) w.join();
+    ROCKSDB_GROUP_COMMIT_WINDOW = was;
+    for (uint64_t w = 0; w < WRITERS; ++w) {
+        for (uint64_t n = 0; n < BATCHES; ++n) {
+            ASSERT_EQ(IsOK(oks[w * BATCHES + n]), n != BATCHES / 2);
+            Frame read;
+            Key key{Uuid{Word{n + 1}, Word{w + 1}}, LWW_RDT_FORM};
+            ASSERT_TRUE(IsOK(store.Read(key, read)));
+            ASSERT_EQ(read.empty(), n == BATCHES / 2);
+        }
+    }
+}
+
+TEST (Store, Profiles) {
+    TmpDir tmp;
+    tmp.cd("Profiles");
+    ROCKSDB_STORE_PROFILE = "nonesuch";
+    Store bad;
+    ASSERT_FALSE(IsOK(bad.Create(Uuid::NIL)));
+    ROCKSDB_STORE_PROFILE = "point";
+    Store store;
+    ASSERT_TRUE(IsOK(store.Create(Uuid::NIL)));
+    Frame a{"@1+A :lww 'a' 1;"}, b{"@1+B :lww 'b' 2;"};
+    ASSERT_TRUE(IsOK(store.Write(Key{Uuid{"1+A"}, LWW_FORM_UUID}, a)));
+    ASSERT_TRUE(IsOK(store.Write(Key{Uuid{"1+B"}, LWW_FORM_UUID}, b)));
+    // a yarn-scoped seek finds the yarn's last record
+    Iterator i{store, true};
+    ASSERT_TRUE(IsOK(i.SeekTo(Key{Uuid{"9+A"}, LWW_FORM_UUID}, true)));
+    ASSERT_EQ(i.key(), (Key{Uuid{"1+A"}, LWW_FORM_UUID}));
+    ROCKSDB_STORE_PROFILE = "default";
+}
 
 TEST (Store, Iterator) {
     TmpDir tmp;
@@ -105,6 +284,46 @@ TEST (Store, Iterator) {
     store.Close();
 }
 
+TEST (Store, RangeScan) {
+    TmpDir tmp;
+    tmp.cd("RangeScan");
+    Store store;
+    ASSERT_TRUE(IsOK(store.Create(Uuid::NIL)));
+    Frame a{"@1+A :lww 'int' 1;"};
+    Key a1{Uuid{"1+A"}, LWW_FORM_UUID}, a2{Uuid{"2+A"}, LWW_FORM_UUID};
+    Key b1{Uuid{"1+B"}, LWW_FORM_UUID}, rga{Uuid{"1+A"}, RGA_FORM_UUID};
+    for (auto key : {a1, a2, b1, rga}) {
+        ASSERT_TRUE(IsOK(store.Write(key, a)));
+    }
+
+    Iterator i{store, Range::Yarn(LWW_RDT_FORM, Word{"A"})};
+    ASSERT_TRUE(IsOK(i.SeekTo(Key{})));
+    ASSERT_EQ(i.key(), a1);
+    ASSERT_TRUE(IsOK(i.Next()));
+    ASSERT_EQ(i.key(), a2);
+    ASSERT_TRUE(i.Next() == Status::ENDOFINPUT);
+    ASSERT_EQ(i.key(), Key::END);
+    ASSERT_TRUE(IsOK(i.SeekTo(Key::END, true)));
+    ASSERT_EQ(i.key(), a2);
+    ASSERT_TRUE(IsOK(i.SeekTo(Key{}, true)));
+    ASSERT_EQ(i.key(), Key::END);
+    i.Close();
+
+    Iterator f{store, Range::Form(LWW_RDT_FORM)};
+    ASSERT_TRUE(IsOK(f.SeekTo(Key{})));
+    ASSERT_EQ(f.key(), a1);
+    ASSERT_TRUE(IsOK(f.SeekTo(b1, true)));
+    ASSERT_EQ(f.key(), b1);
+    ASSERT_TRUE(f.Next() == Status::ENDOFINPUT);
+
+    Iterator bulk{store, Range::Bulk()};
+    ASSERT_TRUE(IsOK(bulk.SeekTo(Key{})));
+    ASSERT_EQ(bulk.key(), Key{});
+    size_t count = 1;
+    while (bulk.Next()) ++count;
+    ASSERT_EQ(count, 5);
+}
+
 TEST (Store, Branches) {
     TmpDir tmp;
     tmp.cd("Branches");
@@ -150,6 +369,98 @@ TEST (Store, Branches) {
     
 }
 
+TEST (Store, Fork) {
+    TmpDir tmp;
+    tmp.cd("Fork");
+    Store store;
+    ASSERT_TRUE(IsOK(store.Create(Uuid::NIL)));
+    Uuid branch_id{"0+branchB"}, fork_id{"0+forkF"};
+    Store branch{store.db()};
+    ASSERT_TRUE(IsOK(branch.Create(branch_id)));
+    Key key{Uuid{"1+A"}, LWW_FORM_UUID}, more{Uuid{"1+B"}, LWW_FORM_UUID};
+    Frame a{"@1+A :lww 'a' 1;"}, b{"@2+A :1+A 'b' 2;"}, c{"@3+A :1+A 'c' 3;"};
+    Frame ab{"@1+A :lww 'a' 1, @2+A 'b' 2;"}, ac{"@1+A :lww 'a' 1, @3+A 'c' 3;"};
+    Frame m{"@1+B :lww 'm' 1;"};
+    ASSERT_TRUE(IsOK(branch.Write(key, a)));
+
+    Store fork{store.db()};
+    ASSERT_TRUE(IsOK(branch.Fork(fork_id, fork)));
+    ASSERT_TRUE(IsOK(fork.Write(key, b)));
+    ASSERT_TRUE(IsOK(fork.Write(more, m)));
+    ASSERT_TRUE(IsOK(branch.Write(key, c)));
+
+    auto check = [&](Store& br, Store& fk) {
+        Frame read;
+        ASSERT_TRUE(IsOK(br.Read(key, read)));
+        ASSERT_TRUE(IsOK(CompareFrames(ac, read)));
+        ASSERT_TRUE(IsOK(fk.Read(key, read)));
+        ASSERT_TRUE(IsOK(CompareFrames(ab, read)));
+        ASSERT_TRUE(IsOK(br.Read(more, read)));
+        ASSERT_TRUE(read.empty());
+        Store::Pinned pinned;
+        ASSERT_TRUE(IsOK(fk.Read(more, pinned)));
+        ASSERT_TRUE(IsOK(CompareWithCursors(m.cursor(), pinned.cursor())));
+        // the fork has a tip of its own
+        ASSERT_TRUE(IsOK(fk.Read(Key::ZERO, read)));
+        ASSERT_EQ(read.cursor().id(), Uuid::NIL);
+
+        Iterator i{fk};
+        ASSERT_TRUE(IsOK(i.SeekTo(key)));
+        ASSERT_EQ(i.key(), key);
+        ASSERT_TRUE(IsOK(CompareWithCursors(ab.cursor(), i.value())));
+        ASSERT_TRUE(IsOK(i.Next()));
+        ASSERT_EQ(i.key(), more);
+        ASSERT_TRUE(i.Next() == Status::ENDOFINPUT);
+        ASSERT_TRUE(IsOK(i.SeekTo(Key::END, true)));
+        ASSERT_EQ(i.key(), more);
+    };
+    check(branch, fork);
+    // the merged reads would bring the bases back
+    ASSERT_TRUE(fork.Put(key, b) == Status::NOT_IMPLEMENTED);
+    ASSERT_TRUE(branch.Put(key, c) == Status::NOT_IMPLEMENTED);
+    check(branch, fork);
+
+    fork.Close();
+    branch.Close();
+    store.Close();
+    typename Store::Branches branches;
+    ASSERT_TRUE(IsOK(Store::OpenAll(branches)));
+    ASSERT_EQ(branches.size(), 3);
+    check(branches[branch_id], branches[fork_id]);
+
+    // flat again, one column family each; the frozen one goes once no
+    // store is on it
+    auto families = [&]() {
+        vector<string> names;
+        EXPECT_TRUE(rocksdb::DB::ListColumnFamilies(rocksdb::DBOptions{},
+                                                    ROCKSDB_STORE_DIR, &names)
+                        .ok());
+        return names.size();
+    };
+    ASSERT_EQ(families(), 4);
+    Store& br = branches[branch_id];
+    Store& fk = branches[fork_id];
+    ASSERT_TRUE(br.DropBases() == Status::BAD_STATE);
+    ASSERT_TRUE(IsOK(br.Flatten(1)));
+    ASSERT_TRUE(br.Flatten() == Status::ENDOFINPUT);
+    ASSERT_TRUE(IsOK(br.DropBases()));
+    ASSERT_FALSE(br.layered());
+    check(br, fk);
+    ASSERT_EQ(families(), 4);
+    ASSERT_TRUE(fk.Flatten() == Status::ENDOFINPUT);
+    ASSERT_TRUE(IsOK(fk.DropBases()));
+    check(br, fk);
+    ASSERT_EQ(families(), 3);
+    ASSERT_TRUE(IsOK(br.Put(key, ac)));
+    ASSERT_TRUE(IsOK(fk.Put(key, ab)));
+    check(br, fk);
+    branches.clear();
+    ASSERT_TRUE(IsOK(Store::OpenAll(branches)));
+    ASSERT_EQ(branches.size(), 3);
+    ASSERT_FALSE(branches[branch_id].layered());
+    check(branches[branch_id], branches[fork_id]);
+}
+
 /*
 void test_db_chain_merge () {
     TextReplica db{};
@@ -180,6 +491,151 @@ void test_db_chain_merge () {
 }
  */
 
+TEST (Store, FormFamilies) {
+    TmpDir tmp;
+    tmp.cd("FormFamilies");
+    bool was = ROCKSDB_FORM_FAMILIES;
+    ROCKSDB_FORM_FAMILIES = true;
+    Uuid id{"~+A"};
+    Frame a{"@1+A :lww 'int' 1;"}, b{"@2+A :1+A 'string' 'str';"};
+    Frame merged{"@1+A :lww 'int' 1, @2+A 'string' 'str';"};
+    Frame meta{"@1+A :meta 'parent' 0;"};
+    Key yarn{Uuid{"1+A"}, YARN_RAW_FORM}, op{Uuid{"1+A"}, META_META_FORM};
+    Key lww{Uuid{"1+A"}, LWW_RDT_FORM};
+    {
+        Store store;
+        ASSERT_TRUE(IsOK(store.Create(Uuid::NIL)));
+        Store branch{store.db()};
+        ASSERT_TRUE(IsOK(branch.Create(id)));
+        ASSERT_TRUE(IsOK(branch.Write(yarn, a)));
+        ArenaBatch batch;
+        batch.records.emplace_back(yarn, batch.arena.Append(b.data()));
+        batch.records.emplace_back(lww, batch.arena.Append(a.data()));
+        ASSERT_TRUE(IsOK(branch.Write(batch)));
+        ASSERT_TRUE(IsOK(branch.Write(Store::Records{{lww, b}})));
+        ASSERT_TRUE(IsOK(branch.Put(op, meta)));
+        Store fork{store.db()};
+        ASSERT_TRUE(branch.Fork(Uuid{"1+A"}, fork) == Status::NOT_IMPLEMENTED);
+        String stats;
+        ASSERT_TRUE(IsOK(branch.Stats(stats)));
+        ASSERT_NE(stats.find("~+A#log"), String::npos);
+    }
+    ROCKSDB_FORM_FAMILIES = was;
+
+    Store::Branches branches;
+    ASSERT_TRUE(IsOK(Store::OpenAll(branches)));
+    ASSERT_EQ(branches.size(), 2);
+    Store& branch = branches[id];
+    Frame read;
+    ASSERT_TRUE(IsOK(branch.Read(yarn, read)));
+    ASSERT_TRUE(IsOK(CompareFrames(merged, read)));
+    Store::Frames reads;
+    ASSERT_TRUE(IsOK(branch.MultiRead({lww, op, Key{}}, reads)));
+    ASSERT_TRUE(IsOK(CompareFrames(merged, reads[0])));
+    ASSERT_TRUE(IsOK(CompareFrames(meta, reads[1])));
+    ASSERT_FALSE(reads[2].empty());
+
+    // the families are disjoint key ranges, scans see them in order
+    Iterator i{branch};
+    ASSERT_TRUE(IsOK(i.SeekTo(Key{})));
+    ASSERT_EQ(i.key(), Key{});
+    ASSERT_TRUE(IsOK(i.Next()));
+    ASSERT_EQ(i.key(), yarn);
+    ASSERT_TRUE(IsOK(i.Next()));
+    ASSERT_EQ(i.key(), op);
+    ASSERT_TRUE(IsOK(i.Next()));
+    ASSERT_EQ(i.key(), lww);
+    ASSERT_TRUE(i.Next() == Status::ENDOFINPUT);
+    i.Close();
+    ASSERT_TRUE(IsOK(branch.Drop()));
+    ASSERT_TRUE(IsOK(Store::OpenAll(branches)));
+    ASSERT_EQ(branches.size(), 1);
+}
+
+TEST (Store, Changes) {
+    TmpDir tmp;
+    tmp.cd("Changes");
+    Store meta;
+    ASSERT_TRUE(IsOK(meta.Create(Uuid::NIL)));
+    Store branch{meta.db()};
+    ASSERT_TRUE(IsOK(branch.Create(Uuid{"~+A"})));
+    Frame a{"@1+A :lww 'int' 1;"}, b{"@2+A :1+A 'string' 'str';"};
+    Key ka{Uuid{"1+A"}, LWW_FORM_UUID}, kb{Uuid{"1+B"}, LWW_FORM_UUID};
+    ASSERT_TRUE(IsOK(branch.Write(ka, a)));
+    ASSERT_TRUE(IsOK(meta.Write(ka, a)));  // not the branch's
+    ASSERT_TRUE(IsOK(branch.Write(Store::Records{{ka, b}, {kb, a}})));
+
+    Store::Changes feed{branch};
+    Store::Records batch;
+    ASSERT_TRUE(IsOK(feed.Next(batch)));
+    ASSERT_EQ(batch.size(), 1);  // the zero record, see Create()
+    ASSERT_EQ(batch[0].first, Key::ZERO);
+    ASSERT_TRUE(IsOK(feed.Next(batch)));
+    ASSERT_EQ(batch.size(), 1);
+    ASSERT_EQ(batch[0].first, ka);
+    ASSERT_TRUE(IsOK(CompareFrames(a, batch[0].second)));
+    ASSERT_TRUE(IsOK(feed.Next(batch)));
+    ASSERT_EQ(batch.size(), 2);
+    ASSERT_EQ(batch[1].first, kb);
+    ASSERT_TRUE(feed.Next(batch) == Status::ENDOFINPUT);
+
+    // tails the log, resumes off a seq()
+    ASSERT_TRUE(IsOK(branch.Put(kb, b)));
+    ASSERT_TRUE(IsOK(feed.Next(batch)));
+    ASSERT_EQ(batch.size(), 1);
+    ASSERT_TRUE(IsOK(CompareFrames(b, batch[0].second)));
+    ASSERT_TRUE(IsOK(branch.Write(ka, a)));
+    Store::Changes resumed{branch, feed.seq()};
+    ASSERT_TRUE(IsOK(resumed.Next(batch)));
+    ASSERT_EQ(batch.size(), 1);
+    ASSERT_EQ(batch[0].first, ka);
+    ASSERT_TRUE(resumed.Next(batch) == Status::ENDOFINPUT);
+
+    // a fork moves the store to a new top, the feed follows
+    Store fork{meta.db()};
+    ASSERT_TRUE(IsOK(branch.Fork(Uuid{"~+F"}, fork)));
+    ASSERT_TRUE(IsOK(fork.Write(kb, b)));  // not the branch's
+    ASSERT_TRUE(IsOK(branch.Write(kb, a)));
+    ASSERT_TRUE(IsOK(resumed.Next(batch)));
+    ASSERT_EQ(batch.size(), 1);
+    ASSERT_EQ(batch[0].first, kb);
+    ASSERT_TRUE(IsOK(CompareFrames(a, batch[0].second)));
+    ASSERT_TRUE(resumed.Next(batch) == Status::ENDOFINPUT);
+    // so does a feed that starts after the fork, off the whole log
+    Store::Changes replay{branch};
+    size_t records = 0;
+    while (IsOK(replay.Next(batch))) records += batch.size();
+    ASSERT_EQ(records, 7);  // the fork's records not among them
+}
+
+TEST (Store, ReadOnly) {
+    TmpDir tmp;
+    tmp.cd("ReadOnly");
+    Frame a{"@1+A :lww 'int' 1;"}, b{"@2+A :1+A 'string' 'str';"};
+    Key ka{Uuid{"1+A"}, LWW_FORM_UUID}, kb{Uuid{"1+B"}, LWW_FORM_UUID};
+    Store writer;
+    ASSERT_TRUE(IsOK(writer.Create(Uuid::NIL)));
+    ASSERT_TRUE(IsOK(writer.Write(ka, a)));
+
+    // a reader next to the writer
+    typename Store::Branches readers;
+    ASSERT_TRUE(IsOK(Store::OpenAll(readers, true)));
+    Store reader = readers[Uuid::NIL];
+    Frame read;
+    ASSERT_TRUE(IsOK(reader.Read(ka, read)));
+    ASSERT_TRUE(IsOK(CompareFrames(a, read)));
+    ASSERT_FALSE(IsOK(reader.Write(kb, b)));
+
+    // sees the new data once reopened
+    ASSERT_TRUE(IsOK(writer.Write(kb, b)));
+    reader.Close();
+    readers.clear();
+    ASSERT_TRUE(IsOK(Store::OpenAll(readers, true)));
+    reader = readers[Uuid::NIL];
+    ASSERT_TRUE(IsOK(reader.Read(kb, read)));
+    ASSERT_TRUE(IsOK(CompareFrames(b, read)));
+}
+
 int main (int argc, char** args) {
     ::testing::InitGoogleTest(&argc, args);
     return RUN_ALL_TESTS();
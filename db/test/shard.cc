@@ -0,0 +1,106 @@
+#include "../shard_store.hpp"
+#include "testutil.hpp"
+
+using namespace ron;
+using namespace std;
+
+using Frame = TextFrame;
+using Store = ShardedStore<TextFrame>;
+using Iterator = typename Store::Iterator;
+
+TEST(ShardedStore, Routing) {
+    TmpDir tmp;
+    tmp.cd("ShardRouting");
+    SHARD_STORE_DIRS = {".shard0", ".shard1", ".shard2"};
+    Frame a{"@1+A :lww 'int' 1;"}, b{"@2+A :1+A 'string' 'str';"};
+    Frame merged{"@1+A :lww 'int' 1, @2+A 'string' 'str';"};
+    Store::Keys keys;
+    vector<size_t> hits(SHARD_STORE_DIRS.size());
+    for (auto origin : {"A", "B", "C", "D", "E", "F", "G", "H"}) {
+        Uuid id{String{"1+"} + origin};
+        Key lww{id, LWW_FORM_UUID}, rga{id, RGA_FORM_UUID};
+        // a yarn stays in one shard
+        ASSERT_EQ(Store::shard_of(lww, 3), Store::shard_of(rga, 3));
+        ++hits[Store::shard_of(lww, 3)];
+        keys.push_back(lww);
+    }
+    for (auto h : hits) ASSERT_GT(h, 0);
+
+    Store store;
+    ASSERT_TRUE(IsOK(store.Create(Uuid::NIL)));
+    Store::Records batch;
+    for (auto& key : keys) batch.emplace_back(key, a);
+    ASSERT_TRUE(IsOK(store.Write(batch)));
+    ArenaBatch more;
+    for (auto& key : keys) {
+        more.records.emplace_back(key, more.arena.Append(Slice{b.data()}));
+    }
+    ASSERT_TRUE(IsOK(store.Write(more)));
+
+    Frame read;
+    for (auto& key : keys) {
+        ASSERT_TRUE(IsOK(store.Read(key, read)));
+        ASSERT_TRUE(IsOK(CompareFrames(merged, read)));
+    }
+    Store::Frames reads;
+    ASSERT_TRUE(IsOK(store.MultiRead(keys, reads)));
+    ASSERT_EQ(reads.size(), keys.size());
+    for (auto& r : reads) ASSERT_TRUE(IsOK(CompareFrames(merged, r)));
+
+    // one merged scan, one tip record
+    Iterator i{store};
+    ASSERT_TRUE(IsOK(i.SeekTo(Key{})));
+    ASSERT_EQ(i.key(), Key::ZERO);
+    Key last = i.key();
+    size_t count = 0;
+    while (i.Next()) {
+        ASSERT_TRUE(last < i.key());
+        last = i.key();
+        ++count;
+    }
+    ASSERT_EQ(count, keys.size());
+    ASSERT_TRUE(IsOK(i.SeekTo(Key::END, true)));
+    ASSERT_EQ(i.key(), last);
+    ASSERT_TRUE(i.Next() == Status::ENDOFINPUT);
+    i.Close();
+
+    Iterator y{store, Range::Yarn(LWW_RDT_FORM, Word{"C"})};
+    ASSERT_TRUE(IsOK(y.SeekTo(Key{})));
+    ASSERT_EQ(y.key(), (Key{Uuid{"1+C"}, LWW_FORM_UUID}));
+    ASSERT_TRUE(y.Next() == Status::ENDOFINPUT);
+}
+
+TEST(ShardedStore, Branches) {
+    TmpDir tmp;
+    tmp.cd("ShardBranches");
+    SHARD_STORE_DIRS = {".shard0", ".shard1"};
+    Frame a{"@1+A :lww 'int' 1;"};
+    Key ka{Uuid{"1+A"}, LWW_FORM_UUID}, kb{Uuid{"1+B"}, LWW_FORM_UUID};
+    Uuid branch_id{"0+branchB"};
+    {
+        Store meta;
+        ASSERT_TRUE(IsOK(meta.Create(Uuid::NIL)));
+        Store branch{meta.db()};
+        ASSERT_TRUE(IsOK(branch.Create(branch_id)));
+        ASSERT_TRUE(IsOK(branch.Write(ka, a)));
+        ASSERT_TRUE(IsOK(branch.Write(kb, a)));
+        Store fork{meta.db()};
+        ASSERT_TRUE(IsOK(branch.Fork(Uuid{"0+forkF"}, fork)));
+        ASSERT_TRUE(IsOK(fork.Write(kb, a)));
+    }
+    Store::Branches branches;
+    ASSERT_TRUE(IsOK(Store::OpenAll(branches)));
+    ASSERT_EQ(branches.size(), 3);
+    Frame read;
+    ASSERT_TRUE(IsOK(branches[branch_id].Read(kb, read)));
+    ASSERT_TRUE(IsOK(CompareFrames(a, read)));
+    ASSERT_TRUE(IsOK(branches[Uuid{"0+forkF"}].Read(ka, read)));
+    ASSERT_TRUE(IsOK(CompareFrames(a, read)));
+    ASSERT_TRUE(IsOK(branches[Uuid::NIL].Read(ka, read)));
+    ASSERT_TRUE(read.empty());
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -18,3 +18,16 @@ Status Compare(const Frame& a, const Frame& b) {
     else
         return ::testing::AssertionFailure() << ok.str();
 }
+
+/** Sets a tunable (a global) for the scope; restores it on any exit,
+ * a failed ASSERT included. */
+template <class T>
+class Tunable {
+    T& var_;
+    T was_;
+
+   public:
+    Tunable(T& var, T value) : var_(var), was_(var) { var_ = value; }
+    Tunable(const Tunable&) = delete;
+    ~Tunable() { var_ = was_; }
+};
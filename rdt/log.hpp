@@ -1,21 +1,104 @@
 #ifndef RON_RDT_LOG_HPP
 #define RON_RDT_LOG_HPP
 
+#include <algorithm>
+#include <unordered_map>
 #include "../ron/status.hpp"
 #include "../ron/uuid.hpp"
 #include "merge.hpp"
 
 namespace ron {
 
+/** An object log: op chains ordered by the head op id. As op ids are
+ * causally consistent, so is the log; the object's root chain goes first.
+ * Merge drops repeated chains (or their repeated parts), so the log does
+ * not bloat when the same chains arrive more than once. */
 template <typename Frame>
 class OpLog {
     using Builder = typename Frame::Builder;
     using Cursor = typename Frame::Cursor;
     using Cursors = typename Frame::Cursors;
 
+    /** A solid chain found in one of the inputs: the head op, the raw
+     * text of the ops that follow it, the id of the last op. */
+    struct Chain {
+        Cursor head;
+        Slice body;
+        Uuid tail;
+
+        explicit Chain(const Cursor &at)
+            : head{at}, body{at.at_data().end(), at.at_data().end()},
+              tail{at.id()} {}
+
+        inline bool operator<(const Chain &b) const {
+            return head.id() < b.head.id();
+        }
+    };
+    using Chains = std::vector<Chain>;
+
+    static inline bool continues(const Cursor &op, const Uuid &prev) {
+        return op.ref() == prev && op.id().origin() == prev.origin() &&
+               op.id() > prev;
+    }
+
+    static Status ScanChains(Chains &chains, Cursor &input) {
+        if (!input.valid()) {
+            return Status::OK;
+        }
+        chains.emplace_back(input);
+        Status ok;
+        while ((ok = input.Next())) {
+            Chain &last = chains.back();
+            if (continues(input, last.tail)) {
+                last.body = Slice{last.body.begin(), input.at_data().end()};
+                last.tail = input.id();
+            } else {
+                chains.emplace_back(input);
+            }
+        }
+        return ok == Status::ENDOFFRAME ? Status::OK : ok;
+    }
+
+    /** Skips the chain's ops up to (and including) the given one.
+     * @return false if nothing is left */
+    static bool TrimChain(Chain &chain, Word till) {
+        const CharRef end = chain.body.end();
+        while (chain.head.id().value() <= till) {
+            if (!chain.head.Next()) {
+                return false;
+            }
+        }
+        chain.body = Slice{chain.head.at_data().end(), end};
+        return true;
+    }
+
    public:
     Status Merge(typename Frame::Builder &output, Cursors &inputs) const {
-        for (int i = 0; i < inputs.size(); ++i) output.AppendAll(inputs[i]);
+        Chains chains;
+        for (auto &input : inputs) {
+            IFOK(ScanChains(chains, input));
+        }
+        // normally, the log is sorted already and new chains go last
+        if (!std::is_sorted(chains.begin(), chains.end())) {
+            std::stable_sort(chains.begin(), chains.end());
+        }
+        // a yarn is linear, so a chain is a repeat if its yarn went further
+        std::unordered_map<Word, Word> tips;
+        for (auto &chain : chains) {
+            Word origin = chain.head.id().origin();
+            auto t = tips.find(origin);
+            if (t != tips.end()) {
+                if (chain.tail.value() <= t->second) {
+                    continue;
+                }
+                if (chain.head.id().value() <= t->second &&
+                    !TrimChain(chain, t->second)) {
+                    continue;
+                }
+            }
+            output.AppendChain(chain.head, chain.body, chain.tail);
+            tips[origin] = chain.tail.value();
+        }
         return Status::OK;
     }
 
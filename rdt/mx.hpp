@@ -51,15 +51,15 @@ class MatrixRDT {
     }
 
     Status GC(Builder &output, const Frame &input) const {
-        mx_t max{};
+        std::unordered_map<mxidx_t, Uuid> last{};
         for (Cursor read = input.cursor(); read.valid(); read.Next()) {
-            mxidx_t at{read};
+            mxidx_t at = readmxidx(read);
             if (at == MX_IDX_MAX) continue;
-            max[at] = read.id();
+            last[at] = read.id();
         }
         for (Cursor write = input.cursor(); write.valid(); write.Next()) {
-            mxidx_t at{write};
-            if (at != MX_IDX_MAX && max[at] == write.id())
+            mxidx_t at = readmxidx(write);
+            if (at == MX_IDX_MAX || last[at] == write.id())  // header, cells
                 output.AppendOp(write);
         }
         return Status::OK;
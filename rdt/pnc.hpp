@@ -0,0 +1,118 @@
+#ifndef rdt_pnc_hpp
+#define rdt_pnc_hpp
+
+#include <algorithm>
+#include <map>
+#include "../ron/form.hpp"
+#include "merge.hpp"
+
+namespace ron {
+
+/** A positive-negative counter. An increment is an op with one int atom,
+ * the delta: `@time+origin :prev -5;` The state has one op per origin,
+ * with the origin's running totals and the id of the last delta folded in:
+ * `@obj :pnc, @last+origin :0 12 3, ...` (the counter is 12-3=9). The
+ * null ref marks totals: no event refs it, so a client op can not pass
+ * for totals (extra ints of a delta are ignored). As totals only grow,
+ * states merge by per-origin max (the latest id wins); deltas fold in if
+ * newer than that. Hence, merges are idempotent and the state size is
+ * O(#origins). A merge that lacks the root op (a partial merge of db
+ * operands) can not fold deltas, so it only dedups them. */
+template <class Frame>
+class PNCounterRDT {
+    using Builder = typename Frame::Builder;
+    using Cursor = typename Frame::Cursor;
+    using Cursors = typename Frame::Cursors;
+
+    struct Totals {
+        Uuid last;
+        int64_t positive;
+        int64_t negative;
+        Totals() : last{Uuid::NIL}, positive{0}, negative{0} {}
+    };
+
+    struct Delta {
+        Uuid id;
+        Uuid ref;
+        int64_t value;
+        inline bool operator<(const Delta &b) const { return id < b.id; }
+        inline bool operator==(const Delta &b) const { return id == b.id; }
+    };
+
+    static inline bool is_totals(const Cursor &c) {
+        return c.ref() == Uuid::NIL && c.has(2, INT) && c.has(3, INT);
+    }
+
+   public:
+    Status Merge(typename Frame::Builder &output, Cursors &inputs) const {
+        Uuid root{Uuid::NIL};
+        std::map<Word, Totals> totals;
+        std::vector<Delta> deltas;
+        for (auto &input : inputs) {
+            for (; input.valid(); input.Next()) {
+                if (input.ref() == PNC_FORM_UUID) {
+                    root = input.id();
+                } else if (is_totals(input)) {
+                    Totals &t = totals[input.id().origin()];
+                    if (input.id() > t.last) {
+                        t.last = input.id();
+                        t.positive = input.integer(2);
+                        t.negative = input.integer(3);
+                    }
+                } else if (input.has(2, INT)) {
+                    deltas.push_back(
+                        Delta{input.id(), input.ref(), input.integer(2)});
+                }
+            }
+        }
+        std::sort(deltas.begin(), deltas.end());
+        deltas.erase(std::unique(deltas.begin(), deltas.end()), deltas.end());
+
+        if (!root.zero()) {
+            output.AppendNewOp(root, PNC_FORM_UUID);
+        }
+        auto unfolded = deltas.begin();
+        for (auto &d : deltas) {
+            auto t = totals.find(d.id.origin());
+            if (t != totals.end() && d.id <= t->second.last) {
+                continue;  // seen that
+            }
+            if (root.zero()) {
+                *unfolded++ = d;
+                continue;
+            }
+            Totals &f = totals[d.id.origin()];
+            f.last = d.id;
+            if (d.value > 0) {
+                f.positive += d.value;
+            } else {
+                f.negative -= d.value;
+            }
+        }
+        for (auto &p : totals) {
+            const Totals &t = p.second;
+            output.AppendNewOp(t.last, Uuid::NIL, t.positive, t.negative);
+        }
+        for (auto d = deltas.begin(); d != unfolded; ++d) {
+            output.AppendNewOp(d->id, d->ref, d->value);
+        }
+        output.EndChunk();
+        return Status::OK;
+    }
+
+    /** @return the counter value of a state frame */
+    static int64_t Value(const Frame &state) {
+        int64_t value = 0;
+        Cursor c = state.cursor();
+        for (; c.valid(); c.Next()) {
+            if (is_totals(c)) {
+                value += c.integer(2) - c.integer(3);
+            }
+        }
+        return value;
+    }
+};
+
+}  // namespace ron
+
+#endif
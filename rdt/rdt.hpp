@@ -8,6 +8,7 @@
 #include "max.hpp"
 #include "meta.hpp"
 #include "mx.hpp"
+#include "pnc.hpp"
 #include "rga.hpp"
 
 namespace ron {
@@ -20,6 +21,7 @@ class MasterRDT {
     MatrixRDT<Frame> mx_;
     RGArrayRDT<Frame> rga_;
     MaxRDT<Frame> max_;
+    PNCounterRDT<Frame> pnc_;
 
    public:
     using Builder = typename Frame::Builder;
@@ -36,6 +38,7 @@ class MasterRDT {
             case LOG_RAW_FORM:
                 return log_.Merge(output, inputs);
             case ZERO_RAW_FORM:
+            case SPAN_RAW_FORM:  // a span's log segment, see Replica
                 if (!inputs.empty()) output.AppendAll(inputs.back());
                 return Status::OK;
             case META_META_FORM:
@@ -48,7 +51,10 @@ class MasterRDT {
             case RGA_RDT_FORM:
                 return rga_.Merge(output, inputs);
             case MAX_RDT_FORM:
+            case TAIL_RAW_FORM:  // log segment links, see Replica
                 return max_.Merge(output, inputs);
+            case PNC_RDT_FORM:
+                return pnc_.Merge(output, inputs);
             case ERROR_NO_FORM:
                 if (!inputs.empty()) {
                     output.AppendAll(inputs.back());
@@ -58,6 +64,24 @@ class MasterRDT {
                 return Status::NOT_IMPLEMENTED;
         }
     }
+
+    /** Collects the garbage in an object state, see the forms' GC().
+     * @param stable the causal stability cutoff (RGA needs one; LWW and
+     *        MX drop overwritten values, which never win again anyway)
+     * @return NOT_IMPLEMENTED for forms that have no GC */
+    Status GC(Builder &output, FORM form, const Frame &state,
+              const VV &stable = EMPTY_VV) const {
+        switch (form) {
+            case LWW_RDT_FORM:
+                return lww_.GC(output, state);
+            case MX_RDT_FORM:
+                return mx_.GC(output, state);
+            case RGA_RDT_FORM:
+                return rga_.GC(output, state, stable);
+            default:
+                return Status::NOT_IMPLEMENTED;
+        }
+    }
 };
 
 template <typename Frame>
@@ -81,12 +81,20 @@ class RGArrayRDT {
         return ++added == 1 << inputs.size() ? Status::OK : Status::CAUSEBREAK;
     }
 
-    Status GC(Builder &output, const Frame &input) const {
-        return Status::NOT_IMPLEMENTED;
-    }
+    /** Collects causally stable tombstones. A removed entry becomes a bare
+     * stub (no value, no rm/un subtree) so refs arriving later still find
+     * their position; stable rm/un subtrees are dropped. Stable removals
+     * become final: an undo of a collected removal does not apply.
+     * @param stable the causal stability cutoff (all peers have seen it) */
+    Status GC(Builder &output, const Frame &input,
+              const VV &stable = EMPTY_VV) const;
 
-    Status MergeGC(Builder &output, Cursors &inputs) const {
-        return Status::NOT_IMPLEMENTED;
+    Status MergeGC(Builder &output, Cursors &inputs,
+                   const VV &stable = EMPTY_VV) const {
+        Builder unclean;
+        IFOK(Merge(unclean, inputs));
+        Frame uc = unclean.Release();
+        return GC(output, uc, stable);
     }
 };
 
@@ -213,7 +221,8 @@ Status ScanRGA(std::vector<bool> &tombstones, const Frame &frame) {
             }
         }
 
-        tombstones.push_back(state != ENTRY);
+        // a collected (stub) entry has no value, hence invisible
+        tombstones.push_back(state != ENTRY || cur.size() == 2);
         ++depth;
         path.push_back(id);
         kills.push_back(false);
@@ -228,6 +237,82 @@ Status ScanRGA(std::vector<bool> &tombstones, const Frame &frame) {
     return Status::OK;
 }
 
+template <class Frame>
+Status RGArrayRDT<Frame>::GC(Builder &output, const Frame &input,
+                             const VV &stable) const {
+    std::vector<bool> tombs;
+    IFOK(ScanRGA(tombs, input));
+    const fsize_t size = tombs.size();
+    Cursor cur = input.cursor();
+    if (!stable.covers(cur.id())) {
+        output.AppendAll(cur);
+        return Status::OK;
+    }
+
+    // the tree structure; the stable part of the tree goes to a subframe
+    std::vector<Uuid> ids;
+    std::vector<fsize_t> up(size, 0);
+    std::vector<bool> firm(size, true);   // the op and its ancestors stable
+    std::vector<bool> entry(size, true);  // no rm/un ops on the root path
+    std::vector<fsize_t> sub(size, 0);    // the rm/un subtree root
+    std::vector<fsize_t> at(size, 0);     // the position in the subframe
+    Builder firm_builder;
+    inc_stack<fsize_t> path{};
+    fsize_t pos = 0, firm_size = 0;
+    ids.reserve(size);
+    do {
+        if (pos > 0) {
+            while (!path.empty() && ids[path.back()] != cur.ref()) {
+                path.pop_back();
+            }
+            if (path.empty()) {
+                return Status::CAUSEBREAK.comment("not a CT");
+            }
+            fsize_t p = path.back();
+            up[pos] = p;
+            firm[pos] = firm[p] && stable.covers(cur.id());
+            entry[pos] = entry[p] && entry_type(cur) == ENTRY;
+            sub[pos] = entry[p] ? pos : sub[p];
+        }
+        ids.push_back(cur.id());
+        path.push_back(pos);
+        if (firm[pos]) {
+            at[pos] = firm_size++;
+            firm_builder.AppendAmendedOp(cur, pos ? REDUCED : HEADER,
+                                         cur.id(), cur.ref());
+        }
+        ++pos;
+    } while (cur.Next());
+
+    // removed in the stable subframe and in the full frame => removed for
+    // good, no known unstable op may resurrect it
+    std::vector<bool> firm_tombs;
+    IFOK(ScanRGA(firm_tombs, firm_builder.Release()));
+    // a subtree is done if all of its ops are stable
+    std::vector<bool> done{firm};
+    for (pos = size - 1; pos > 0; --pos) {
+        if (!done[pos]) done[up[pos]] = false;
+    }
+
+    cur = input.cursor();
+    pos = 0;
+    do {
+        if (!entry[pos]) {
+            if (!done[sub[pos]]) {
+                output.AppendAmendedOp(cur, REDUCED, cur.id(), cur.ref());
+            }
+        } else if (pos > 0 && firm[pos] && tombs[pos] && firm_tombs[at[pos]]) {
+            output.AppendNewOp(cur.id(), cur.ref());
+        } else {
+            output.AppendAmendedOp(cur, pos ? REDUCED : HEADER, cur.id(),
+                                   cur.ref());
+        }
+        ++pos;
+    } while (cur.Next());
+
+    return Status::OK;
+}
+
 }  // namespace ron
 
 #endif  // CPP_RGA_HPP
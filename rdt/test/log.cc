@@ -0,0 +1,72 @@
+#include <iostream>
+#include <gtest/gtest.h>
+#include "../../ron/ron.hpp"
+#include "../rdt.hpp"
+#include "testutil.hpp"
+#define DEBUG 1
+
+using namespace ron;
+using namespace std;
+
+using Frame = TextFrame;
+using Log = OpLog<Frame>;
+using Builder = typename Frame::Builder;
+using Cursor = typename Frame::Cursor;
+using Cursors = typename Frame::Cursors;
+
+Status MergeLogs(Frame& into, const Strings& logs) {
+    Log rdt;
+    Builder b;
+    Cursors inputs;
+    for (auto& l : logs) inputs.emplace_back(l);
+    IFOK(rdt.Merge(b, inputs));
+    into = b.Release();
+    return Status::OK;
+}
+
+TEST(Log, Append) {
+    Frame merged;
+    ASSERT_TRUE(IsOK(MergeLogs(
+        merged, {"@1+A :lww, @2+A 'a' 1, @3+A 'b' 2;", "@4+A :3+A 'c' 3;"})));
+    Frame correct{"@1+A :lww, @2+A 'a' 1, @3+A 'b' 2, @4+A 'c' 3;"};
+    ASSERT_TRUE(IsOK(CompareFrames(merged, correct)));
+}
+
+TEST(Log, Order) {
+    Frame merged;
+    ASSERT_TRUE(IsOK(MergeLogs(
+        merged, {"@1+A :lww, @2+A 'a' 1;", "@4+B :2+A 'd' 4;",
+                 "@3+C :2+A 'c' 3, @4+C 'e' 5;"})));
+    Frame correct{"@1+A :lww, @2+A 'a' 1, @3+C 'c' 3, @4+C 'e' 5, "
+                  "@4+B :2+A 'd' 4;"};
+    ASSERT_TRUE(IsOK(CompareFrames(merged, correct)));
+}
+
+TEST(Log, Repeats) {
+    Frame merged;
+    ASSERT_TRUE(IsOK(MergeLogs(
+        merged, {"@1+A :lww, @2+A 'a' 1; @3+B :2+A 'b' 2;", "@3+B :2+A 'b' 2;",
+                 "@1+A :lww, @2+A 'a' 1;"})));
+    Frame correct{"@1+A :lww, @2+A 'a' 1, @3+B 'b' 2;"};
+    ASSERT_TRUE(IsOK(CompareFrames(merged, correct)));
+}
+
+TEST(Log, Overlaps) {
+    Frame merged;
+    ASSERT_TRUE(IsOK(MergeLogs(
+        merged, {"@1+A :lww, @2+A 'a' 1, @3+A 'b' 2;",
+                 "@2+A :1+A 'a' 1, @3+A 'b' 2, @4+A 'c' 3;"})));
+    Frame correct{"@1+A :lww, @2+A 'a' 1, @3+A 'b' 2, @4+A 'c' 3;"};
+    ASSERT_TRUE(IsOK(CompareFrames(merged, correct)));
+    // the merged log is a valid log
+    Frame again;
+    ASSERT_TRUE(IsOK(MergeLogs(again, {merged.data(), "@5+A :4+A 'd' 4;"})));
+    Frame correct2{"@1+A :lww, @2+A 'a' 1, @3+A 'b' 2, @4+A 'c' 3, "
+                   "@5+A 'd' 4;"};
+    ASSERT_TRUE(IsOK(CompareFrames(again, correct2)));
+}
+
+int main(int argn, char** args) {
+    ::testing::InitGoogleTest(&argn, args);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,81 @@
+#include <iostream>
+#include <gtest/gtest.h>
+#include "../../ron/ron.hpp"
+#include "../rdt.hpp"
+#include "testutil.hpp"
+#define DEBUG 1
+
+using namespace ron;
+using namespace std;
+
+using Frame = TextFrame;
+using Counter = PNCounterRDT<Frame>;
+using Builder = typename Frame::Builder;
+using Cursor = typename Frame::Cursor;
+using Cursors = typename Frame::Cursors;
+
+Status MergeCounters(Frame& into, const Strings& inputs) {
+    Counter rdt;
+    Builder b;
+    Cursors cursors;
+    for (auto& i : inputs) cursors.emplace_back(i);
+    IFOK(rdt.Merge(b, cursors));
+    into = b.Release();
+    return Status::OK;
+}
+
+TEST(PNC, Fold) {
+    Frame state;
+    ASSERT_TRUE(IsOK(MergeCounters(
+        state, {"@1+A :pnc;", "@2+A :1+A 5, @3+A -2;", "@2+B :1+A 1;"})));
+    Frame correct{"@1+A :pnc, @3+A :0 5 2, @2+B :0 1 0;"};
+    ASSERT_TRUE(IsOK(CompareFrames(state, correct)));
+    ASSERT_EQ(Counter::Value(state), 4);
+}
+
+TEST(PNC, Idempotent) {
+    Frame state;
+    String s1{"@1+A :pnc, @3+A :0 5 2;"};
+    ASSERT_TRUE(IsOK(MergeCounters(
+        state, {s1, "@2+A :1+A 5;", "@3+A :2+A -2;", "@4+A :3+A 7;", s1})));
+    Frame correct{"@1+A :pnc, @4+A :0 12 2;"};
+    ASSERT_TRUE(IsOK(CompareFrames(state, correct)));
+    // states merge by per-origin max
+    Frame again;
+    ASSERT_TRUE(IsOK(MergeCounters(again, {s1, state.data(), "@2+B :1+A 3;"})));
+    Frame correct2{"@1+A :pnc, @4+A :0 12 2, @2+B :0 3 0;"};
+    ASSERT_TRUE(IsOK(CompareFrames(again, correct2)));
+    ASSERT_EQ(Counter::Value(again), 13);
+}
+
+TEST(PNC, Partial) {
+    // no root => deltas can not be folded, but their repeats are dropped
+    Frame partial;
+    ASSERT_TRUE(IsOK(MergeCounters(
+        partial, {"@3+A :2+A 2;", "@2+A :1+A 1, @3+A 2;"})));
+    Frame correct{"@2+A :1+A 1, @3+A 2;"};
+    ASSERT_TRUE(IsOK(CompareFrames(partial, correct)));
+    Frame state;
+    ASSERT_TRUE(IsOK(MergeCounters(state, {"@1+A :pnc;", partial.data()})));
+    ASSERT_EQ(Counter::Value(state), 3);
+}
+
+TEST(PNC, DeltaIsNoTotals) {
+    // a delta with two ints adds its first, the origin's totals stay
+    Frame state;
+    String s1{"@1+A :pnc, @3+A :0 5 2;"};
+    ASSERT_TRUE(IsOK(MergeCounters(state, {s1, "@4+A :3+A 1 -3;"})));
+    Frame correct{"@1+A :pnc, @4+A :0 6 2;"};
+    ASSERT_TRUE(IsOK(CompareFrames(state, correct)));
+    ASSERT_EQ(Counter::Value(state), 4);
+    // no root: the delta stays a delta
+    Frame partial;
+    ASSERT_TRUE(IsOK(MergeCounters(partial, {"@4+A :3+A 1 -3;"})));
+    ASSERT_TRUE(IsOK(MergeCounters(state, {s1, partial.data()})));
+    ASSERT_EQ(Counter::Value(state), 4);
+}
+
+int main(int argn, char** args) {
+    ::testing::InitGoogleTest(&argn, args);
+    return RUN_ALL_TESTS();
+}
@@ -169,6 +169,91 @@ TEST(Log2State, Cutoff) {
     ASSERT_TRUE(!tombs[5]); // t
 }
 
+TEST(GC, Stub) {
+    //  !
+    //    a
+    //      b
+    //        rm  c
+    String RM{"@1i08e4+A :rga! 'a', 'b', @1i08k+B rm, @1i08e40003+A :1i08e40002+A 'c',"};
+    VV stable;
+    stable.add(Uuid{"1i08e40003+A"});
+    stable.add(Uuid{"1i08k+B"});
+    RGA rga;
+    TextFrame::Builder b;
+    ASSERT_TRUE(IsOK(rga.GC(b, Frame{RM}, stable)));
+    Frame gc = b.Release();
+    vector<bool> tombs{};
+    ASSERT_TRUE(IsOK(ScanRGA<Frame>(tombs, gc)));
+    ASSERT_EQ(tombs.size(), 4);  // the rm is gone
+    ASSERT_TRUE( tombs[0]);
+    ASSERT_TRUE(!tombs[1]);
+    ASSERT_TRUE( tombs[2]);  // b is a stub now
+    ASSERT_TRUE(!tombs[3]);
+    ASSERT_EQ(gc.data().find("'b'"), string::npos);
+    // the stub keeps the position
+    string late;
+    ASSERT_TRUE(IsOK(MergeStrings<TextFrame>(
+        late, RGA_RDT_FORM, Strings{gc.data(), "@1i08z+C :1i08e40002+A 'x';"})));
+    ASSERT_TRUE(IsOK(ScanRGA<Frame>(tombs, Frame{late})));
+    ASSERT_EQ(tombs.size(), 5);
+    ASSERT_TRUE( tombs[2]);
+    ASSERT_TRUE(!tombs[3]);  // x
+    ASSERT_TRUE(!tombs[4]);  // c
+    // GC is idempotent
+    TextFrame::Builder again;
+    ASSERT_TRUE(IsOK(rga.GC(again, gc, stable)));
+    String once = gc.data(), twice = again.Release().data();
+    ASSERT_EQ(despace(twice), despace(once));
+}
+
+TEST(GC, Unstable) {
+    String RM{"@1i08e4+A :rga! 'a', 'b', @1i08k+B rm, @1i08e40003+A :1i08e40002+A 'c',"};
+    VV stable;
+    stable.add(Uuid{"1i08e40003+A"});  // the rm is not stable
+    RGA rga;
+    TextFrame::Builder b;
+    ASSERT_TRUE(IsOK(rga.GC(b, Frame{RM}, stable)));
+    Frame gc = b.Release();
+    vector<bool> tombs{};
+    ASSERT_TRUE(IsOK(ScanRGA<Frame>(tombs, gc)));
+    ASSERT_EQ(tombs.size(), 5);
+    ASSERT_TRUE( tombs[2]);
+    ASSERT_TRUE( tombs[3]);
+    ASSERT_NE(gc.data().find("'b'"), string::npos);
+}
+
+TEST(GC, Undo) {
+    //  !
+    //    a
+    //      b
+    //        rm       c
+    //           rm
+    //              un
+    String RMUN{"@1i08e4+A :rga! 'a', 'b', @1i08k+B rm, rm, @1i08z+C un, @1i08e40003+A :1i08e40002+A 'c',"};
+    vector<bool> orig{};
+    ASSERT_TRUE(IsOK(ScanRGA<Frame>(orig, Frame{RMUN})));
+    VV stable;
+    stable.add(Uuid{"1i08e40003+A"});
+    stable.add(Uuid{"1i08k0001+B"});  // the undo is not stable
+    RGA rga;
+    TextFrame::Builder b;
+    ASSERT_TRUE(IsOK(rga.GC(b, Frame{RMUN}, stable)));
+    Frame gc = b.Release();
+    vector<bool> tombs{};
+    ASSERT_TRUE(IsOK(ScanRGA<Frame>(tombs, gc)));
+    ASSERT_EQ(tombs, orig);
+    ASSERT_NE(gc.data().find("'a'"), string::npos);  // may be back on undo
+    // once the undo is stable, the rm/un subtree is dropped
+    stable.add(Uuid{"1i08z+C"});
+    TextFrame::Builder b2;
+    ASSERT_TRUE(IsOK(rga.GC(b2, Frame{RMUN}, stable)));
+    ASSERT_TRUE(IsOK(ScanRGA<Frame>(tombs, b2.Release())));
+    ASSERT_EQ(tombs.size(), 4);
+    ASSERT_TRUE(!tombs[1]);
+    ASSERT_TRUE( tombs[2]);
+    ASSERT_TRUE(!tombs[3]);
+}
+
 int main (int argc, char** args) {
     ::testing::InitGoogleTest(&argc, args);
     return RUN_ALL_TESTS();
@@ -37,6 +37,7 @@ const uint64_t FORMS[]{
     718297752286527488UL,   // csv
     1025941105738252288UL,  // txt
     893383983893577728UL,   // max
+    950993995142529024UL,   // pnc
 
 };
 
@@ -63,6 +64,7 @@ enum FORM : uint8_t {
     JSON_MAP_FORM = 16,
     CSV_MAP_FORM = 17,
     TXT_MAP_FORM = 18,
+    PNC_RDT_FORM = 20,
     RESERVED_ANY_FORM = 200,
     ERROR_NO_FORM = 255
 };
@@ -83,6 +85,7 @@ const Uuid LWW_FORM_UUID{FORMS[LWW_RDT_FORM], 0UL};      // NOLINT
 const Uuid RGA_FORM_UUID{FORMS[RGA_RDT_FORM], 0UL};      // NOLINT
 const Uuid MX_FORM_UUID{FORMS[MX_RDT_FORM], 0UL};        // NOLINT
 const Uuid MAX_FORM_UUID{FORMS[MAX_RDT_FORM], 0UL};      // NOLINT
+const Uuid PNC_FORM_UUID{FORMS[PNC_RDT_FORM], 0UL};      // NOLINT
 const Uuid JSON_FORM_UUID{FORMS[JSON_MAP_FORM], 0UL};    // NOLINT
 const Uuid CSV_FORM_UUID{FORMS[CSV_MAP_FORM], 0UL};      // NOLINT
 const Uuid TXT_FORM_UUID{FORMS[TXT_MAP_FORM], 0UL};      // NOLINT
@@ -98,6 +101,7 @@ const std::unordered_map<Uuid, FORM> UUID2FORM = {
     {RGA_FORM_UUID, RGA_RDT_FORM},     {MX_FORM_UUID, MX_RDT_FORM},
     {MAX_FORM_UUID, MAX_RDT_FORM},     {JSON_FORM_UUID, JSON_MAP_FORM},
     {CSV_FORM_UUID, CSV_MAP_FORM},     {TXT_FORM_UUID, TXT_MAP_FORM},
+    {PNC_FORM_UUID, PNC_RDT_FORM},
     {Uuid::FATAL, ERROR_NO_FORM}
 
 };
@@ -65,19 +65,26 @@ struct SHA2 {
         SHA2 ret;
         assert(hash.size() <= HEX_SIZE);
         uint32_t b = uint32_t(hash.size()) << 2;
-        if (b > BIT_SIZE) b = BIT_SIZE;
-        if (decode<4, ABC16>(ret.bits_, hash, ret.known_bits_))
-            ret.known_bits_ = b;
+        String raw;
+        if (decode<4, ABC16>(raw, hash, b)) {
+            raw.resize(SIZE, 0);
+            std::swap(ret.bits_, raw);
+            ret.known_bits_ = b > BIT_SIZE ? BIT_SIZE : b;
+        }
         return ret;
     }
 
     static SHA2 ParseBase64(const String& hash) {
         SHA2 ret;
         assert(hash.size() <= BASE64_SIZE);
+        // all the digits, the last one's padding bits too
         uint32_t b = uint32_t(hash.size()) * 6;
-        if (b > BIT_SIZE) b = BIT_SIZE;
-        if (decode<6, ABC64>(ret.bits_, hash, ret.known_bits_))
-            ret.known_bits_ = b;
+        String raw;
+        if (decode<6, ABC64>(raw, hash, b)) {
+            raw.resize(SIZE, 0);
+            std::swap(ret.bits_, raw);
+            ret.known_bits_ = b > BIT_SIZE ? BIT_SIZE : b;
+        }
         return ret;
     }
 
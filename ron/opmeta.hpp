@@ -24,6 +24,11 @@ struct OpMeta {
     Word prev;
     /** chain id */
     Word chain;
+    /** span id: the op's nearest preceding yarn op that has a meta
+     * record, i.e. is indexed (chain heads always are) */
+    Word span;
+    /** the number of ops in the span, this one included */
+    uint32_t span_ops;
 
     static Uuid SHA2_UUID;
     static Uuid OBJ_UUID;
@@ -40,7 +45,9 @@ struct OpMeta {
           object{Uuid::NIL},
           hash{SHA2::ZERO},
           prev{Word{}},
-          chain{Word{}} {}
+          chain{Word{}},
+          span{Word{}},
+          span_ops{0} {}
 
     /** Causal tree root (object creation).
       @param{op} the root op
@@ -52,7 +59,9 @@ struct OpMeta {
           rdt{op.ref()},
           object{id},
           prev{prev.id.value()},
-          chain{id.value()} {
+          chain{id.value()},
+          span{id.value()},
+          span_ops{1} {
         assert(id.version() == TIME);
         assert(rdt.version() == NAME);
         hash = SHA2::OpMerkleHash(op, prev.hash, SHA2{rdt});
@@ -82,7 +91,10 @@ struct OpMeta {
         Uuid ref = op.ref();
         if (ref.origin() != id.origin() || prev != ref.value()) {
             chain = id.value();
+            span = chain;
+            span_ops = 0;
         }
+        ++span_ops;
         rdt = refd.rdt;
         object = refd.object;
         hash = SHA2::OpMerkleHash(op, hash, refd.hash);
@@ -109,9 +121,17 @@ struct OpMeta {
         return Status::OK;
     }
 
+    /** Starts a new span at this op; its meta record is its index
+     * entry, see Save() */
+    inline void Index() {
+        span = id.value();
+        span_ops = 1;
+    }
+
     template <class Builder>
     void Save(Builder& save) {
-        save.AppendNewOp(id, META_FORM_UUID, object, rdt, hash.base64());
+        save.AppendNewOp(id, META_FORM_UUID, object, rdt, hash.base64(),
+                         chain_id());
     }
 
     template <class Cursor>
@@ -131,7 +151,17 @@ struct OpMeta {
             return Status::BADSYNTAX.comment("no rdt id");
         }
         rdt = load.uuid(3);
-        // hash;
+        if (load.has(4, STRING)) {
+            String hash64 = load.string(4);
+            if (hash64.size() <= SHA2::BASE64_SIZE) {
+                hash = SHA2::ParseBase64(hash64);
+            }
+        }
+        // older records are chain heads only
+        if (load.has(5, UUID)) {
+            chain = load.uuid(5).value();
+        }
+        Index();
         return Status::OK;
     }
 
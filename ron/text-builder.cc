@@ -71,6 +71,20 @@ void TextFrame::Builder::AppendAmendedOp(const Cursor& cur, TERM newterm,
     WriteTerm(newterm);
 }
 
+void TextFrame::Builder::AppendChain(const Cursor& head, Slice body,
+                                     const Uuid& tail) {
+    AppendOp(head);
+    WriteTerm(head.term());
+    if (body.empty()) {
+        return;
+    }
+    Write(body);
+    prev_ = tail;
+    CharRef last = body.end() - 1;
+    while (last > body.begin() && isspace(*last)) --last;
+    unterm_ = strchr((const char*)TERM_PUNCT, *last) == nullptr;
+}
+
 template <typename Cursor2>
 void TextFrame::Builder::AppendOp(const Cursor& cur) {
     const Op& op = cur.op();
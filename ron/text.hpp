@@ -231,6 +231,14 @@ class TextFrame {
         void AppendAmendedOp(const Cursor& cur, TERM newterm, const Uuid& newid,
                              const Uuid& newref);
 
+        /** Appends a solid op chain: the head op is re-serialized (its spec
+         *  may depend on whatever preceded it), the rest of the chain is
+         *  copied verbatim as every op there is relative to its predecessor.
+         *  @param head the cursor positioned at the chain head
+         *  @param body the raw text of the ops following the head
+         *  @param tail the id of the last op in the chain */
+        void AppendChain(const Cursor& head, Slice body, const Uuid& tail);
+
         /**  */
         inline void EndChunk(TERM term = RAW) {
             assert(term != REDUCED);
@@ -244,6 +252,7 @@ class TextFrame {
             }
             std::swap(data_, to);
             data_.clear();
+            prev_ = Uuid::NIL;  // the next frame spells its first op out
         }
 
         void Release(TextFrame& to) { Release(to.data_); }
@@ -68,18 +68,19 @@ String Uuid::str() const {
 }
 
 Word Uuid::HybridTime(time_t seconds, long int nanos) {
-    tm* t = gmtime(&seconds);
-    uint64_t ret = 1900U + t->tm_year - 2010U;
+    tm t{};
+    gmtime_r(&seconds, &t);  // gmtime() shares its result between threads
+    uint64_t ret = 1900U + t.tm_year - 2010U;
     ret *= 12;
-    ret += t->tm_mon;
+    ret += t.tm_mon;
     ret <<= 6;
-    ret |= t->tm_mday - 1;
+    ret |= t.tm_mday - 1;
     ret <<= 6;
-    ret |= t->tm_hour;
+    ret |= t.tm_hour;
     ret <<= 6;
-    ret |= t->tm_min;
+    ret |= t.tm_min;
     ret <<= 6;
-    ret |= t->tm_sec;
+    ret |= t.tm_sec;
     ret <<= 24;
     ret |= nanos / 100;
     return ret;
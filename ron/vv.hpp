@@ -18,6 +18,11 @@ class VV {
         return get(point.origin()).value() >= point.value();
     }
     inline bool empty() const { return vv_.empty(); }
+    /** Raises the origin's entry up to the point (never lowers it). */
+    inline void add(Uuid point) {
+        Word &at = vv_[point.origin()];
+        if (at < point.value()) at = point.value();
+    }
 };
 
 const VV EMPTY_VV{};